@@ -32,6 +32,9 @@ equals(QCP_VER,"2"){
     message("Using QCP2 with OpenGL support")
 }
 
+# Count heap allocations in debug builds; see allocationcounter.h
+CONFIG(debug, debug|release): DEFINES += LABRADOR_COUNT_ALLOCATIONS
+
 include(ui_elements.pri)
 !win32: include(../libdfuprog/libdfuprog.pri)
 
@@ -54,7 +57,21 @@ SOURCES += \
     daqloadprompt.cpp \
     isobuffer_file.cpp \
     i2cdecoder.cpp \
-    asyncdft.cpp
+    asyncdft.cpp \
+    allocationcounter.cpp \
+    samplekernels.cpp \
+    persistencehistogram.cpp \
+    framegovernor.cpp \
+    spectrogram.cpp \
+    lockin.cpp \
+    bodesweep.cpp \
+    distortion.cpp \
+    crosscorrelator.cpp \
+    clockrecovery.cpp \
+    decoderworker.cpp \
+    decoderrecord.cpp \
+    eyehistogram.cpp \
+    zoomviews.cpp
 
 HEADERS += \
     spline.h \
@@ -74,7 +91,27 @@ HEADERS += \
     daqloadprompt.h \
     isobuffer_file.h \
     i2cdecoder.h \
-    asyncdft.h
+    asyncdft.h \
+    frameexchange.h \
+    renderframe.h \
+    framearena.h \
+    allocationcounter.h \
+    samplekernels.h \
+    conversiontable.h \
+    persistencehistogram.h \
+    framegovernor.h \
+    spectrogram.h \
+    lockin.h \
+    bodesweep.h \
+    distortion.h \
+    crosscorrelation.h \
+    crosscorrelator.h \
+    clockrecovery.h \
+    jitter.h \
+    decoderworker.h \
+    decoderrecord.h \
+    eyehistogram.h \
+    zoomviews.h
 
 FORMS += \
     ui_files_desktop/mainwindow.ui \
@@ -118,16 +155,16 @@ win32 {
         DEFINES += "WINDOWS_32_BIT"
 
         INCLUDEPATH += build_win/fftw/x86
-        LIBS += -L$$PWD/build_win/fftw/x86 -llibfftw3-3
-        lib_deploy.files += build_win/fftw/x86/libfftw3-3.dll
+        LIBS += -L$$PWD/build_win/fftw/x86 -llibfftw3f-3
+        lib_deploy.files += build_win/fftw/x86/libfftw3f-3.dll
         LIBS += -L$$PWD/build_win/libusbk/bin/lib/x86 -llibusbK
         lib_deploy.files += build_win/libusbk/bin/dll/x86/libusbK.dll
     } else {
         DEFINES += "WINDOWS_64_BIT"
 
         INCLUDEPATH += build_win/fftw/x64
-        LIBS += -L$$PWD/build_win/fftw/x64 -llibfftw3-3
-        lib_deploy.files += build_win/fftw/x64/libfftw3-3.dll
+        LIBS += -L$$PWD/build_win/fftw/x64 -llibfftw3f-3
+        lib_deploy.files += build_win/fftw/x64/libfftw3f-3.dll
         LIBS += -L$$PWD/build_win/libusbk/bin/lib/amd64 -llibusbK
         lib_deploy.files += build_win/libusbk/bin/dll/amd64/libusbK.dll
     }
@@ -152,7 +189,7 @@ unix:!macx {
 
     CONFIG += link_pkgconfig
     PKGCONFIG += libusb-1.0  ##make sure you have the libusb-1.0-0-dev package!
-    PKGCONFIG += fftw3       ##make sure you have the libfftw3-dev package!
+    PKGCONFIG += fftw3f      ##make sure you have the libfftw3-dev package!
     PKGCONFIG += eigen3      ##make sure you have the libeigen3-dev package!
 
     isEmpty(PREFIX): PREFIX = /usr/local
@@ -229,7 +266,7 @@ unix:HEADERS += unixusbdriver.h
 # For multithreading on Unix fftw
 unix:!macx: LIBS += -fopenmp
 macx: LIBS += -lomp
-unix: LIBS += -lfftw3_omp
+unix: LIBS += -lfftw3f_omp
 
 #############################################
 ########       LINUX GCC FLAGS      #########
@@ -240,3 +277,12 @@ unix:!macx: QMAKE_CXXFLAGS_RELEASE -= -O1
 unix:!macx: QMAKE_CXXFLAGS_RELEASE -= -O2
 unix:!macx: QMAKE_CXXFLAGS_RELEASE -= -O3
 
+
+#############################################
+########    FLOATING POINT FLAGS    #########
+#############################################
+
+# No fused multiply-adds, which round differently, so the SIMD sample
+# kernels match the scalar one bit for bit (see samplekernels.h).
+# qmake has no per-file flags, so this covers the whole build.
+!msvc: QMAKE_CXXFLAGS += -ffp-contract=off
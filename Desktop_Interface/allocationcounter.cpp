@@ -0,0 +1,138 @@
+#include "allocationcounter.h"
+
+#ifdef LABRADOR_COUNT_ALLOCATIONS
+
+#include <QDebug>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+thread_local uint64_t tAllocationCount = 0;
+thread_local int tExemptDepth = 0;
+
+void countAllocation()
+{
+    if (tExemptDepth == 0)
+        tAllocationCount++;
+}
+}
+
+#ifdef __GLIBC__
+// Everything, Qt included, mallocs through these rather than glibc's own,
+// which they hand on to.  free() needn't change: the memory still comes
+// from glibc's allocator.
+#define LABRADOR_COUNTS_MALLOC
+extern "C"
+{
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* p, std::size_t size);
+
+void* malloc(std::size_t size) noexcept
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) noexcept
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, std::size_t size) noexcept
+{
+    countAllocation();
+    return __libc_realloc(p, size);
+}
+}
+#endif
+
+namespace
+{
+void* countedAlloc(std::size_t size)
+{
+#ifndef LABRADOR_COUNTS_MALLOC
+    countAllocation();
+#endif
+    if (size == 0)
+        size = 1;
+    return std::malloc(size);
+}
+}
+
+void* operator new(std::size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+allocationCheck::allocationCheck(char const* scope, bool enabled)
+    : m_scope(scope)
+    , m_enabled(enabled)
+    , m_startCount(tAllocationCount)
+{
+}
+
+allocationCheck::~allocationCheck()
+{
+    uint64_t allocations = tAllocationCount - m_startCount;
+    if (m_enabled && allocations)
+    {
+        allocationExempt exempt;
+        qDebug() << m_scope << "made" << allocations << "heap allocations";
+    }
+}
+
+allocationExempt::allocationExempt()
+{
+    tExemptDepth++;
+}
+
+allocationExempt::~allocationExempt()
+{
+    tExemptDepth--;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// Debug-only heap allocation counter, used to check that the frame
+// pipeline doesn't touch the heap once it has warmed up.
+// Built in when LABRADOR_COUNT_ALLOCATIONS is defined (debug builds, see
+// Labrador.pro); otherwise both classes are empty and compile away.
+// operator new is counted everywhere.  With glibc, malloc(), calloc() and
+// realloc() are counted too, so the QVectors the frames are built in are
+// covered; elsewhere they allocate unseen.
+
+#ifdef LABRADOR_COUNT_ALLOCATIONS
+
+// Counts the allocations the current thread makes while it is alive,
+// and complains through qDebug if there were any.
+class allocationCheck
+{
+public:
+    explicit allocationCheck(char const* scope, bool enabled = true);
+    ~allocationCheck();
+private:
+    char const* m_scope;
+    bool m_enabled;
+    uint64_t m_startCount;
+};
+
+// Allocations made while one of these is alive are not counted.
+// For work that is expected to allocate, such as emitting queued signals.
+class allocationExempt
+{
+public:
+    allocationExempt();
+    ~allocationExempt();
+};
+
+#else
+
+class allocationCheck
+{
+public:
+    explicit allocationCheck(char const*, bool = true) {}
+};
+
+class allocationExempt
+{
+public:
+    allocationExempt() {}
+};
+
+#endif
+
+#endif // ALLOCATIONCOUNTER_H
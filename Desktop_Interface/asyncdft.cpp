@@ -1,60 +1,373 @@
 #include "asyncdft.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <omp.h>
+#include "samplekernels.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
 
+#define PI 3.141592653589793  // Predefined value for pi
+#define PI_2 2*PI
+#define PI_4 4*PI
+#define PI_6 6*PI
+#define PI_8 8*PI
+
+static int sizeIndex(int size)
+{
+    int index = 0;
+    while ((AsyncDFT::kMinSize << index) < size)
+        index++;
+    return index;
+}
 
 AsyncDFT::AsyncDFT()
 {
-    /*FFTW3 inits*/
-    fftw_init_threads();
-    fftw_plan_with_nthreads(omp_get_max_threads() * 2);
-    out_buffer = fftw_alloc_complex(n_samples);
-    plan = fftw_plan_dft_r2c_1d(n_samples,in_buffer, out_buffer,0);
+    initFftw();
+    for (auto& plans : m_plans)
+        for (std::atomic<fftwf_plan>& plan : plans)
+            plan.store(nullptr, std::memory_order_relaxed);
+    m_job.setAutoDelete(false);
+    m_job.engine = this;
+    m_pool.setMaxThreadCount(1);
+
+    QString const wisdom = wisdomPath();
+    if (fftwf_import_wisdom_from_filename(QFile::encodeName(wisdom).constData()))
+        qDebug() << "FFTW wisdom loaded from" << wisdom;
+
+    m_syncIn = fftwf_alloc_real(n_samples);
+    m_syncOut = fftwf_alloc_complex(n_samples/2 + 1);
+    plan(RealPlan, n_samples);
+    plan(PairPlan, n_samples);
 }
 
 AsyncDFT::~AsyncDFT()
 {
+    for (std::thread& planner : m_planners)
+        planner.join();
+    m_pool.waitForDone();
+    for (auto& plans : m_plans) {
+        for (std::atomic<fftwf_plan>& plan : plans) {
+            if (fftwf_plan p = plan.load(std::memory_order_acquire))
+                fftwf_destroy_plan(p);
+        }
+    }
+    for (fftwf_plan plan : m_retiredPlans)
+        fftwf_destroy_plan(plan);
+    fftwf_free(m_job.in_buffer);
+    fftwf_free(m_job.out_buffer);
+    fftwf_free(m_syncIn);
+    fftwf_free(m_syncOut);
 }
 
-QVector<double> AsyncDFT::getPowerSpectrum_dBmV(QVector<double> input, double wind_fact_sum)
+void AsyncDFT::initFftw()
 {
-    /*Before doing anything, check if sliding DFT is computable*/
-    if (input.size() < n_samples) {
-        return QVector<double>();
+    static std::once_flag once;
+    std::call_once(once, []{
+        fftwf_init_threads();
+        // Plans for new lengths are made on the processing thread while others are measured
+        fftwf_make_planner_thread_safe();
+        // One transform runs at a time, so it gets all the threads
+        fftwf_plan_with_nthreads(fftwThreads());
+    });
+}
+
+int AsyncDFT::fftwThreads()
+{
+    return omp_get_max_threads();
+}
+
+QString AsyncDFT::wisdomPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/fftwf_wisdom";
+}
+
+static fftwf_plan makePlan(bool pair, int size, unsigned flags)
+{
+    fftwf_complex* in = fftwf_alloc_complex(size);
+    fftwf_complex* out = fftwf_alloc_complex(size);
+    fftwf_plan made = pair ? fftwf_plan_dft_1d(size, in, out, FFTW_FORWARD, flags)
+                           : fftwf_plan_dft_r2c_1d(size, reinterpret_cast<float*>(in), out, flags);
+    fftwf_free(in);
+    fftwf_free(out);
+    return made;
+}
+
+// The plan for a transform, made the first time it is asked for
+fftwf_plan AsyncDFT::plan(planKind kind, int size)
+{
+    std::atomic<fftwf_plan>& slot = m_plans[kind][sizeIndex(size)];
+    fftwf_plan existing = slot.load(std::memory_order_acquire);
+    if (existing)
+        return existing;
+
+    // FFTW_ESTIMATE and FFTW_WISDOM_ONLY don't touch the arrays, but still want some
+    fftwf_plan made = makePlan(kind == PairPlan, size, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    bool const measured = made != nullptr;
+    if (!measured)
+        made = makePlan(kind == PairPlan, size, FFTW_ESTIMATE);
+
+    slot.store(made, std::memory_order_release);
+    if (!measured)
+        m_planners.emplace_back(&AsyncDFT::measurePlan, this, kind, size);
+    return made;
+}
+
+// Planner thread.  FFTW_MEASURE runs trial transforms, so it gets arrays of
+// its own rather than the ones the worker is using.
+void AsyncDFT::measurePlan(planKind kind, int size)
+{
+    std::lock_guard<std::mutex> lock(m_measureMutex);
+    fftwf_plan measured = makePlan(kind == PairPlan, size, FFTW_MEASURE);
+    if (!measured)
+        return;
+
+    fftwf_plan replaced = m_plans[kind][sizeIndex(size)].exchange(measured, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> retiredLock(m_retiredMutex);
+        m_retiredPlans.push_back(replaced);
     }
 
-    for(int i = 0; i < n_samples; i++) {
-        in_buffer[i] = input[i];
+    QString const wisdom = wisdomPath();
+    QDir().mkpath(QFileInfo(wisdom).absolutePath());
+    if (fftwf_export_wisdom_to_filename(QFile::encodeName(wisdom).constData()))
+        qDebug() << "FFTW plan for" << size << "samples measured, wisdom saved to" << wisdom;
+    else
+        qDebug() << "FFTW plan for" << size << "samples measured, but wisdom could not be saved to" << wisdom;
+}
+
+// Evaluate the windowing factor for a given window function, number of samples and at a given index
+double AsyncDFT::windowFactor(int type, int N, int n)
+{
+    double factor = 1.0;
+    switch (type)
+    {
+    case 0: // Rectangular window
+        factor = 1.0;
+        break;
+    case 1: // Hann window or raised cosine
+        factor = 0.5 - 0.5*std::cos(PI_2*n/(N-1));
+        break;
+    case 2: // Hamming window
+        factor = 0.54 - 0.46*std::cos(PI_2*n/(N-1));
+        break;
+    case 3: // Blackman window
+        factor = 0.42 - 0.5*std::cos(PI_2*n/N) + 0.08*std::cos(PI_4*n/N);
+        break;
+    case 4: // Flat top window
+        factor = 0.21557895 - 0.41663158*std::cos(PI_2*n/N) + 0.277263158*std::cos(PI_4*n/N) - 0.083578947*std::cos(PI_6*n/N) + 0.006947368*std::cos(PI_8*n/N);
+        break;
+    default:
+        factor = 1.0;
+    }
+    return factor;
+}
+
+AsyncDFT::windowTable const& AsyncDFT::window(int type, int size)
+{
+    windowTable& table = m_windows[std::make_pair(type, size)];
+    if (table.factors.empty()) {
+        table.factors.resize(size);
+        table.type = type;
+        for (int i = 0; i < size; ++i) {
+            double const factor = windowFactor(type, size, i);
+            table.factors[i] = float(factor);
+            table.sum += factor;
+            table.sumSquares += factor * factor;
+        }
     }
+    return table;
+}
+
+void AsyncDFT::setSettings(Settings const& settings)
+{
+    m_settings = settings;
+    m_settings.size = kMinSize << sizeIndex(std::max(int(kMinSize), std::min(settings.size, int(kMaxSize))));
+    m_settings.averages = std::max(1, settings.averages);
+    m_settings.overlap = std::max(0.0, std::min(settings.overlap, 0.9));
+}
+
+int AsyncDFT::hop(Settings const& settings)
+{
+    return std::max(1, int(settings.size * (1 - settings.overlap)));
+}
+
+short* AsyncDFT::input(int channel, int count)
+{
+    std::vector<short>& raw = m_job.raw[channel];
+    raw.resize(count);
+    return raw.data();
+}
+
+void AsyncDFT::start(int channelCount, int count, ChannelScale const (&scales)[2])
+{
+    int const size = m_settings.size;
+    fftwf_plan const sizePlan = plan(channelCount > 1 ? PairPlan : RealPlan, size);
+    windowTable const& table = window(m_settings.windowType, size);
+
+    m_writing = m_published.load(std::memory_order_acquire) == 0 ? 1 : 0;
+    m_channels[m_writing] = channelCount;
+    m_sizes[m_writing] = size;
+    m_pending.store(1, std::memory_order_release);
+
+    transformJob& job = m_job;
+    if (job.bufferSize != size) {
+        fftwf_free(job.in_buffer);
+        fftwf_free(job.out_buffer);
+        job.in_buffer = fftwf_alloc_complex(size);
+        job.out_buffer = fftwf_alloc_complex(size);
+        job.bufferSize = size;
+    }
+    job.scale[0] = scales[0];
+    job.scale[1] = scales[1];
+    job.channels = channelCount;
+    job.size = size;
+    job.count = count;
+    job.hop = hop(m_settings);
+    job.plan = sizePlan;
+    job.window = &table;
+    job.writing = m_writing;
+    m_pool.start(&job);
+}
+
+int AsyncDFT::takeSpectra(QVector<double>& ch1, QVector<double>& ch2, distortionFigures (*figures)[2])
+{
+    unsigned const generation = m_generation.load(std::memory_order_acquire);
+    if (generation == m_takenGeneration)
+        return 0;
+    m_takenGeneration = generation;
 
-    /*Zero-padding for better resolution of DFT*/
-    QVector<double> amplitude(n_samples/2+1,0);
+    // Copied rather than shared, so neither side's storage is reallocated
+    auto copyInto = [](QVector<double>& dst, QVector<double> const& src) {
+        dst.resize(src.size());
+        std::copy(src.begin(), src.end(), dst.begin());
+    };
+    int const published = m_published.load(std::memory_order_acquire);
+    copyInto(ch1, m_job.spectrum[0][published]);
+    if (m_channels[published] > 1)
+        copyInto(ch2, m_job.spectrum[1][published]);
+    else
+        ch2.clear();
+    if (figures) {
+        (*figures)[0] = m_job.distortion[0][published];
+        (*figures)[1] = m_channels[published] > 1 ? m_job.distortion[1][published] : distortionFigures();
+    }
+    return m_sizes[published];
+}
 
-    /*Executing FFTW plan*/
-    fftw_execute(plan);
+void AsyncDFT::transformJob::run()
+{
+    float gain[2];
+    float bias[2];
+    for (int channel = 0; channel < channels; ++channel) {
+        double offset = scale[channel].bias;
+        if (scale[channel].ac) {
+            int64_t rawSum = std::accumulate(raw[channel].begin(), raw[channel].begin() + count, int64_t(0));
+            offset -= scale[channel].scale * (double(rawSum) / count);
+        }
+        gain[channel] = float(scale[channel].scale);
+        bias[channel] = float(offset);
+        power[channel].assign(size/2 + 1, 0.f);
+    }
 
-    /* dBmV = 20*log10(|V_fft,mv/N|) - wind_corr
-       dBmV = 20*log10(|V_fft,mv/N|) - 20*log10(∑(Wi)/N)
-       dBmV = 20*log10((10^3) * |V_fft| / N) - 20*log10(∑(Wi) / N)
-       dBmV = 20*(log10(10^3)) + 20*log10(|V_fft|) - 20*log10(N)) - 20*log10(∑Wi) + 20*log10(N)
-       dBmV = 60 + 20*log10(|V_fft|)) - 20*log10(∑Wi)
-       dBmV = 60 + 10*log10(|V_fft|^2) - 20*log10(∑Wi)
-    */
-    for (int k = 0; k <= (n_samples+1)/2; ++k) {
-         amplitude[k] = 60 + 10*std::log10(out_buffer[k][0]*out_buffer[k][0] + out_buffer[k][1]*out_buffer[k][1]) - 20*std::log10(wind_fact_sum);
+    // As many transforms as fit, the last ending at the newest sample
+    int const averages = 1 + (count - size) / hop;
+    int const first = count - size - (averages - 1) * hop;
+    int const bins = size/2 + 1;
+    float const* factors = window->factors.data();
+    for (int segment = 0; segment < averages; ++segment) {
+        int const offset = first + segment * hop;
+        if (channels == 1) {
+            short const* samples = raw[0].data() + offset;
+            float* real = reinterpret_cast<float*>(in_buffer);
+            for (int i = 0; i < size; i++) {
+                real[i] = (samples[i] * gain[0] + bias[0]) * factors[i];
+            }
+
+            /*Executing FFTW plan*/
+            fftwf_execute_dft_r2c(plan, real, out_buffer);
+            float* sum = power[0].data();
+            for (int k = 0; k < bins; ++k) {
+                sum[k] += out_buffer[k][0]*out_buffer[k][0] + out_buffer[k][1]*out_buffer[k][1];
+            }
+            continue;
+        }
+
+        // Two real signals x and y as one complex z = x + iy.  With
+        // A = Z[k] and B = conj(Z[N-k]), X[k] = (A + B)/2 and Y[k] = (A - B)/2i.
+        short const* samples1 = raw[0].data() + offset;
+        short const* samples2 = raw[1].data() + offset;
+        for (int i = 0; i < size; i++) {
+            in_buffer[i][0] = (samples1[i] * gain[0] + bias[0]) * factors[i];
+            in_buffer[i][1] = (samples2[i] * gain[1] + bias[1]) * factors[i];
+        }
+
+        /*Executing FFTW plan*/
+        fftwf_execute_dft(plan, in_buffer, out_buffer);
+        float* sum1 = power[0].data();
+        float* sum2 = power[1].data();
+        for (int k = 0; k < bins; ++k) {
+            fftwf_complex const& a = out_buffer[k];
+            fftwf_complex const& b = out_buffer[(size - k) & (size - 1)];
+            float const xRe = a[0] + b[0];
+            float const xIm = a[1] - b[1];
+            float const yRe = a[1] + b[1];
+            float const yIm = a[0] - b[0];
+            sum1[k] += 0.25f * (xRe*xRe + xIm*xIm);
+            sum2[k] += 0.25f * (yRe*yRe + yIm*yIm);
+        }
     }
 
-    return amplitude;
+    float const dBReference = float(reference(window->sum, averages));
+    for (int channel = 0; channel < channels; ++channel) {
+        QVector<double>& amplitude = spectrum[channel][writing];
+        amplitude.resize(bins);
+        powerToDecibels(power[channel].data(), amplitude.data(), bins, dBReference);
+        distortion[channel][writing] = measureDistortion(power[channel].data(), bins, size, averages,
+                                                         window->type, window->sumSquares);
+    }
+
+    // Done; publish the pair
+    engine->m_published.store(writing, std::memory_order_release);
+    engine->m_generation.fetch_add(1, std::memory_order_release);
+    engine->m_pending.store(0, std::memory_order_release);
 }
 
-QVector<double> AsyncDFT::getFrequencyWindow(int samplesPerSeconds)
+void AsyncDFT::getPowerSpectrum_dBmV(QVector<double> const& input, double wind_fact_sum, QVector<double>& amplitude)
 {
-    double delta_freq = ((double)  samplesPerSeconds)/ ((double) n_samples);
-    QVector<double> f(n_samples/2 + 1);
+    /*Before doing anything, check if sliding DFT is computable*/
+    if (input.size() < n_samples) {
+        amplitude.clear();
+        return;
+    }
 
-    for (int i = 0; i < n_samples/2 + 1; i++) {
-        f[i] = i*delta_freq;
+    for(int i = 0; i < n_samples; i++) {
+        m_syncIn[i] = float(input[i]);
+    }
+    fftwf_execute_dft_r2c(plan(RealPlan, n_samples), m_syncIn, m_syncOut);
+    int const bins = n_samples/2 + 1;
+    m_syncPower.resize(bins);
+    for (int k = 0; k < bins; ++k) {
+        m_syncPower[k] = m_syncOut[k][0]*m_syncOut[k][0] + m_syncOut[k][1]*m_syncOut[k][1];
     }
+    amplitude.resize(bins);
+    powerToDecibels(m_syncPower.data(), amplitude.data(), bins, float(reference(wind_fact_sum, 1)));
+}
 
-    return f;
+/* dBmV = 20*log10(|V_fft,mv/N|) - wind_corr
+   dBmV = 20*log10(|V_fft,mv/N|) - 20*log10(∑(Wi)/N)
+   dBmV = 20*log10((10^3) * |V_fft| / N) - 20*log10(∑(Wi) / N)
+   dBmV = 20*(log10(10^3)) + 20*log10(|V_fft|) - 20*log10(N)) - 20*log10(∑Wi) + 20*log10(N)
+   dBmV = 60 + 20*log10(|V_fft|)) - 20*log10(∑Wi)
+   dBmV = 60 + 10*log10(|V_fft|^2) - 20*log10(∑Wi)
+   Averaged over K transforms, |V_fft|^2 becomes ∑|V_fft,k|^2 / K.
+   This is the part that doesn't depend on the bin.
+*/
+double AsyncDFT::reference(double wind_fact_sum, int averages)
+{
+    return 60 - 20*std::log10(wind_fact_sum) - 10*std::log10(averages);
 }
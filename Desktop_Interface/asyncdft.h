@@ -1,23 +1,175 @@
 #ifndef ASYNCDFT_H
 #define ASYNCDFT_H
+#include <QRunnable>
+#include <QThreadPool>
 #include <QVector>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <fftw3.h>
+#include "distortion.h"
 
+// Spectrum view engine.  The processing thread hands over the newest raw
+// samples of each channel and carries on; they are windowed, transformed
+// and converted to dBmV on a worker thread.
+// A spectrum is a Welch estimate: the mean power of one or more overlapping
+// transforms, the last of which ends at the newest sample.
+// Everything is single precision: the samples are 8-bit, so double
+// precision would only double the memory traffic.  With both channels on,
+// they go through one complex transform as its real and imaginary parts
+// and are separated afterwards, rather than two real ones.
+// Each spectrum comes with its distortion figures (see measureDistortion()),
+// from the same power sums.
+// Finished spectra are double buffered, so the processing thread can take
+// the last pair while the next is being computed.
+// Planning never holds anything up: each transform starts with an
+// FFTW_ESTIMATE plan (or a measured one straight from saved wisdom) and a
+// better one is measured in the background, saving the wisdom for next time.
 class AsyncDFT
 {
 public:
     AsyncDFT();
     ~AsyncDFT();
+    // Default transform length, and the one getPowerSpectrum_dBmV() uses
     static const int n_samples = 1<<17;
+    static const int kMinSize = 1<<10;
+    static const int kMaxSize = 1<<20;
 
-    QVector<double> getPowerSpectrum_dBmV(QVector<double> input, double wind_fact_sum);
-    QVector<double> getFrequencyWindow(int samplesPerSeconds);
+    struct Settings
+    {
+        int size = n_samples;   // Power of two, kMinSize to kMaxSize
+        int averages = 1;       // Transforms per spectrum
+        double overlap = 0.5;   // Fraction of each transform shared with the next
+        int windowType = 0;     // As for windowFactor()
+    };
+
+    // How a channel's raw samples become volts: raw * scale + bias, or with
+    // ac set, raw * scale with the mean taken out, plus bias.
+    struct ChannelScale
+    {
+        double scale = 1;
+        double bias = 0;
+        bool ac = false;
+    };
+
+    // Everything from here on is for the processing thread.
+    // Settings take effect from the next start().
+    void setSettings(Settings const& settings);
+    Settings const& settings() const { return m_settings; }
+
+    // Raw samples per channel the next start() wants
+    int samplesNeeded() const { return m_settings.size + (m_settings.averages - 1) * hop(m_settings); }
+
+    // False while the last request is still running
+    bool idle() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    // Where the next request's count raw samples for a channel go, oldest
+    // first.  Only to be written while idle().
+    short* input(int channel, int count);
+
+    // Starts on the first channelCount inputs, count samples each, which
+    // must be at least one transform's worth.  Must be idle().
+    void start(int channelCount, int count, ChannelScale const (&scales)[2]);
+
+    // Copies out the newest finished spectra, in dBmV, and returns their
+    // transform length, or 0 if there hasn't been a new pair since the last call.
+    // figures, if given, gets both channels' distortion figures, with the
+    // fundamental's frequency in bins.
+    int takeSpectra(QVector<double>& ch1, QVector<double>& ch2, distortionFigures (*figures)[2] = nullptr);
+
+    // Synchronous n_samples transform, for the eye diagram's clock estimate.
+    // amplitude is left empty if there are fewer than n_samples of input.
+    void getPowerSpectrum_dBmV(QVector<double> const& input, double wind_fact_sum, QVector<double>& amplitude);
+
+    // Window of the given type (0 rectangular, 1 Hann, 2 Hamming,
+    // 3 Blackman, 4 flat top) at sample n of N
+    static double windowFactor(int type, int N, int n);
+    // Sets up FFTW's threads, which has to come before any other FFTW call,
+    // so everything that plans transforms calls this first.  Plans then use
+    // fftwThreads() threads unless asked otherwise.
+    static void initFftw();
+    static int fftwThreads();
+    double windowSum(int type, int size) { return window(type, size).sum; }
 
 private:
-    double in_buffer[n_samples];
-    /*FFTW3*/
-    fftw_plan plan;
-    fftw_complex *out_buffer;
+    struct windowTable
+    {
+        std::vector<float> factors;
+        double sum = 0;
+        double sumSquares = 0;
+        int type = 0;
+    };
+    // Built on first use and kept, so flipping between windows or lengths
+    // costs nothing and a running job's table never goes away.
+    windowTable const& window(int type, int size);
+    std::map<std::pair<int, int>, windowTable> m_windows;
+
+    // Real-to-complex for one channel, complex-to-complex for two
+    enum planKind { RealPlan, PairPlan, kPlanKinds };
+
+    class transformJob : public QRunnable
+    {
+    public:
+        void run() override;
+
+        AsyncDFT* engine = nullptr;
+        std::vector<short> raw[2];
+        ChannelScale scale[2];
+        // This request's channels, transform length, samples and step between transforms
+        int channels = 0;
+        int size = 0;
+        int count = 0;
+        int hop = 0;
+        fftwf_plan plan = nullptr;
+        windowTable const* window = nullptr;
+        int writing = 0;
+        // A real plan uses in_buffer as size floats
+        fftwf_complex* in_buffer = nullptr;
+        fftwf_complex* out_buffer = nullptr;
+        int bufferSize = 0;
+        std::vector<float> power[2];
+        QVector<double> spectrum[2][2]; // By channel, then half
+        distortionFigures distortion[2][2];
+    };
+
+    static int hop(Settings const& settings);
+    static double reference(double wind_fact_sum, int averages);
+    static QString wisdomPath();
+
+    // One plan per kind and transform length, all run through the
+    // fftwf_execute_dft*() calls, which are safe from several threads at
+    // once.  fftwf_alloc_*() aligns every buffer alike, so a plan serves
+    // every buffer of its length.
+    // A plan that has been replaced may still be running, so it is kept until the end.
+    static const int kSizeCount = 11; // kMinSize to kMaxSize
+    fftwf_plan plan(planKind kind, int size);
+    void measurePlan(planKind kind, int size);
+    std::atomic<fftwf_plan> m_plans[kPlanKinds][kSizeCount];
+    std::vector<std::thread> m_planners;
+    std::mutex m_measureMutex; // One measurement and wisdom export at a time
+    std::mutex m_retiredMutex;
+    std::vector<fftwf_plan> m_retiredPlans;
+
+    Settings m_settings;
+    transformJob m_job;
+    float* m_syncIn = nullptr;
+    fftwf_complex* m_syncOut = nullptr;
+    std::vector<float> m_syncPower;
+
+    // Set while the job is running, and which half of each channel's
+    // spectrum pair it is writing; the other half is the published one.
+    std::atomic<int> m_pending{0};
+    int m_writing = 0;
+    int m_channels[2] = {0, 0};
+    int m_sizes[2] = {0, 0};
+    std::atomic<int> m_published{-1};
+    std::atomic<unsigned> m_generation{0};
+    unsigned m_takenGeneration = 0;
+
+    QThreadPool m_pool;
 };
 
 #endif // ASYNCDFT_H
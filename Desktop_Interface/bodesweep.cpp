@@ -0,0 +1,103 @@
+#include "bodesweep.h"
+#include "functiongencontrol.h"
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <cmath>
+
+// Frequencies closer than this, relative, are the same point
+static constexpr double kSameFrequency = 1e-6;
+
+static bool sameFrequency(double a, double b)
+{
+    return std::abs(a - b) <= kSameFrequency * std::max(a, b);
+}
+
+void bodeSweep::setPlan(Plan const& plan)
+{
+    m_plan = plan;
+    m_points.clear();
+
+    std::vector<double> nominal;
+    if (plan.log) {
+        double const decadesPerPoint = 1.0 / std::max(plan.pointsPerDecade, 1);
+        for (int i = 0; plan.min * std::pow(10.0, i * decadesPerPoint) <= plan.max * (1 + kSameFrequency); ++i)
+            nominal.push_back(plan.min * std::pow(10.0, i * decadesPerPoint));
+    } else {
+        double const step = std::max(plan.step, 0.01);
+        for (int i = 0; plan.min + i * step <= plan.max * (1 + kSameFrequency); ++i)
+            nominal.push_back(plan.min + i * step);
+    }
+    if (nominal.empty())
+        nominal.push_back(plan.min);
+
+    for (double frequency : nominal) {
+        if (plan.waveLength > 0) {
+            // The shift that keeps the DAC under DAC_SPS can change with the
+            // frequency, so settle on one the generator gives back unchanged.
+            for (int i = 0; i < 3; ++i) {
+                double const played = functionGen::timerSetting(plan.waveLength, frequency).frequency();
+                if (played == frequency)
+                    break;
+                frequency = played;
+            }
+        }
+        m_points.push_back(frequency);
+    }
+    // Neighbours can land on the same timer setting at the top end
+    std::sort(m_points.begin(), m_points.end());
+    m_points.erase(std::unique(m_points.begin(), m_points.end(), sameFrequency), m_points.end());
+
+    restart();
+}
+
+void bodeSweep::restart()
+{
+    m_frequencies.clear();
+    m_gains.clear();
+    m_phases.clear();
+    m_restarting = true;
+}
+
+double bodeSweep::finishPoint(double frequency, bool converged, double gain_dB, double phaseDegrees)
+{
+    if (m_restarting) {
+        // Whatever was being measured belongs to the old plan
+        m_restarting = false;
+        return m_points.front();
+    }
+
+    if (converged) {
+        int const index = std::lower_bound(m_frequencies.begin(), m_frequencies.end(), frequency * (1 - kSameFrequency)) - m_frequencies.begin();
+        if (index < m_frequencies.size() && sameFrequency(m_frequencies[index], frequency)) {
+            // Update if record exists
+            m_gains[index] = gain_dB;
+            m_phases[index] = phaseDegrees;
+        } else {
+            m_frequencies.insert(index, frequency);
+            m_gains.insert(index, gain_dB);
+            m_phases.insert(index, phaseDegrees);
+        }
+    }
+
+    auto next = std::upper_bound(m_points.begin(), m_points.end(), frequency * (1 + kSameFrequency));
+    return next == m_points.end() ? m_points.front() : *next;
+}
+
+bool bodeSweep::exportCsv(QString const& fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not open" << fileName;
+        return false;
+    }
+
+    file.write("f, gain (dB), phase (degrees)\n");
+    char tempchar[64];
+    for (int i = 0; i < m_frequencies.size(); i++) {
+        snprintf(tempchar, sizeof tempchar, "%f, %f, %f\n", m_frequencies.at(i), m_gains.at(i), m_phases.at(i));
+        file.write(tempchar);
+    }
+    file.close();
+    return true;
+}
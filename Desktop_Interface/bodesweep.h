@@ -0,0 +1,56 @@
+#ifndef BODESWEEP_H
+#define BODESWEEP_H
+
+#include <QString>
+#include <QVector>
+#include <vector>
+
+// Frequency response sweep: which points to measure, and what was measured
+// there.  The points are worked out when the plan changes, linearly or log
+// spaced, and each is moved to the nearest frequency the signal generator
+// can actually play (see functionGen::timerSetting()).  The lock-in then
+// mixes at exactly what comes out, and stepping to the next point is just
+// a lookup.  How long each point takes is up to lockInDemodulator.
+// Lives on the processing thread.
+class bodeSweep
+{
+public:
+    struct Plan
+    {
+        double min = 100;
+        double max = 32500;
+        double step = 100;          // Linear sweeps, in Hz
+        bool log = false;
+        int pointsPerDecade = 20;   // Log sweeps
+        int waveLength = 0;         // Generator samples per cycle, 0 if not known
+    };
+
+    bodeSweep() { setPlan(Plan()); }
+
+    // Starts again from the first point with no results
+    void setPlan(Plan const& plan);
+    Plan const& plan() const { return m_plan; }
+    void restart();
+
+    // The point at frequency is done; the result is kept if it converged and
+    // the sweep hasn't restarted since.  Returns the point to measure next,
+    // wrapping round to the first.
+    double finishPoint(double frequency, bool converged, double gain_dB, double phaseDegrees);
+
+    // Measured points, in frequency order
+    QVector<double> const& frequencies() const { return m_frequencies; }
+    QVector<double> const& gains() const { return m_gains; }
+    QVector<double> const& phases() const { return m_phases; }
+
+    bool exportCsv(QString const& fileName) const;
+
+private:
+    Plan m_plan;
+    std::vector<double> m_points;
+    bool m_restarting = true;
+    QVector<double> m_frequencies;
+    QVector<double> m_gains;
+    QVector<double> m_phases;
+};
+
+#endif // BODESWEEP_H
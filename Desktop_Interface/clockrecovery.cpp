@@ -0,0 +1,308 @@
+#include "clockrecovery.h"
+#include "isobuffer.h"
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <cmath>
+#include <fftw3.h>
+
+#define PI 3.141592653589793  // Predefined value for pi
+
+clockRecovery::clockRecovery()
+{
+    // So a backlog never allocates on the processing thread
+    m_raw.reserve(kMaxBacklog);
+    m_intervals.reserve(kAcquireEdges);
+    m_record.resize(kRecordEdges);
+}
+
+void clockRecovery::reset()
+{
+    // The next update() picks up from the buffer as it is then
+    m_buffer = nullptr;
+}
+
+void clockRecovery::update(isoBuffer const* buffer)
+{
+    if (buffer != m_buffer || buffer->m_samplesPerSecond != m_samplesPerSecond) {
+        m_buffer = buffer;
+        m_position = buffer->m_sampleCount;
+        m_samplesPerSecond = buffer->m_samplesPerSecond;
+        restart();
+        return;
+    }
+
+    uint64_t arrived = buffer->m_sampleCount - m_position;
+    m_position = buffer->m_sampleCount;
+    if (arrived == 0)
+        return;
+    // Anything older than the backlog is lost, and the loop can't bridge the gap
+    if (arrived > kMaxBacklog) {
+        arrived = kMaxBacklog;
+        restart();
+    }
+
+    m_raw.resize(arrived);
+    uint32_t const got = buffer->readLatest(m_raw.data(), uint32_t(arrived));
+    // Fewer come back if the buffer has been cleared since
+    if (got < arrived)
+        restart();
+    process(m_raw.data(), int(got));
+}
+
+jitterFigures clockRecovery::figures() const
+{
+    jitterFigures figures;
+    figures.locked = m_locked;
+    if (!m_tracking || m_samplesPerSecond <= 0)
+        return figures;
+    figures.unitInterval = m_period / m_samplesPerSecond;
+    figures.edges = m_recordCount;
+    if (m_recordCount < 2)
+        return figures;
+
+    double sum = 0;
+    double sumSquares = 0;
+    float lowest = m_record[0].tie;
+    float highest = lowest;
+    for (int i = 0; i < m_recordCount; ++i) {
+        float const tie = m_record[i].tie;
+        sum += tie;
+        sumSquares += double(tie) * tie;
+        lowest = std::min(lowest, tie);
+        highest = std::max(highest, tie);
+    }
+    // Mean taken out; a steady offset is the slicer's, not jitter
+    double const mean = sum / m_recordCount;
+    double const variance = std::max(0.0, sumSquares / m_recordCount - mean * mean);
+    figures.rms = std::sqrt(variance) / m_samplesPerSecond;
+    figures.peakToPeak = (highest - lowest) / m_samplesPerSecond;
+    return figures;
+}
+
+void clockRecovery::restart()
+{
+    m_sampleIndex = 0;
+    m_started = false;
+    m_level = false;
+    m_crossing = 0;
+    m_intervals.clear();
+    m_lastEdge = -1;
+    m_tracking = false;
+    m_locked = false;
+    m_recordNext = 0;
+    m_recordCount = 0;
+}
+
+void clockRecovery::process(short const* samples, int count)
+{
+    int i = 0;
+    if (!m_started && count > 0) {
+        m_high = m_low = m_previous = samples[0];
+        m_started = true;
+        ++i;
+        ++m_sampleIndex;
+    }
+
+    for (; i < count; ++i, ++m_sampleIndex) {
+        float const x = samples[i];
+        // Each side of the envelope jumps out to a new extreme and leaks
+        // slowly back towards the other
+        float const swing = m_high - m_low;
+        m_high = std::max(x, m_high - kEnvelopeLeak * swing);
+        m_low = std::min(x, m_low + kEnvelopeLeak * swing);
+
+        float const previous = m_previous;
+        m_previous = samples[i];
+        if (swing < kMinSwing)
+            continue;
+        float const threshold = 0.5f * (m_high + m_low);
+        float const hysteresis = 0.1f * swing;
+
+        // The latest crossing in the direction of the next transition is
+        // where the edge is timed from
+        bool const crossed = m_level ? (previous >= threshold && x < threshold)
+                                     : (previous < threshold && x >= threshold);
+        if (crossed)
+            m_crossing = double(m_sampleIndex - 1) + (threshold - previous) / (x - previous);
+
+        if (m_level ? x < threshold - hysteresis : x > threshold + hysteresis) {
+            m_level = !m_level;
+            edge(m_crossing);
+        }
+    }
+}
+
+void clockRecovery::edge(double time)
+{
+    if (m_tracking)
+        track(time);
+    else
+        acquire(time);
+}
+
+void clockRecovery::acquire(double time)
+{
+    if (m_lastEdge >= 0)
+        m_intervals.push_back(time - m_lastEdge);
+    m_lastEdge = time;
+    if (int(m_intervals.size()) < kAcquireEdges)
+        return;
+
+    // Every interval should be close to a whole number of the shortest
+    double const shortest = *std::min_element(m_intervals.begin(), m_intervals.end());
+    double total = 0;
+    double unitIntervals = 0;
+    for (double interval : m_intervals) {
+        total += interval;
+        unitIntervals += std::max(1.0, std::round(interval / shortest));
+    }
+    m_intervals.clear();
+    double const period = total / unitIntervals;
+    if (!(period >= 2))
+        return;
+
+    m_tracking = true;
+    m_clock = time;
+    m_period = period;
+    m_unitIntervals = 0;
+    std::fill(m_lockErrors, m_lockErrors + kLockEdges, 0.f);
+    m_lockErrorSum = 0;
+    m_lockIndex = 0;
+    m_lockCount = 0;
+    m_locked = false;
+    m_recordNext = 0;
+    m_recordCount = 0;
+}
+
+void clockRecovery::track(double time)
+{
+    // Which boundary this edge belongs to, and how far off it is
+    int64_t const boundaries = std::llround((time - m_clock) / m_period);
+    double const error = time - (m_clock + boundaries * m_period);
+
+    m_clock += boundaries * m_period + kPhaseGain * error;
+    m_period += kFrequencyGain * error;
+    m_unitIntervals += boundaries;
+
+    // Lock detector, the mean |error| over the last kLockEdges edges in UI
+    float const relativeError = float(std::abs(error) / m_period);
+    m_lockErrorSum += relativeError - m_lockErrors[m_lockIndex];
+    m_lockErrors[m_lockIndex] = relativeError;
+    m_lockIndex = (m_lockIndex + 1) % kLockEdges;
+    m_lockCount = std::min(m_lockCount + 1, int(kLockEdges));
+    if (m_lockCount == kLockEdges) {
+        double const meanError = m_lockErrorSum / kLockEdges;
+        if (meanError < kLockTolerance) {
+            m_locked = true;
+        } else if (meanError > kLossTolerance || !(m_period >= 2)) {
+            // Lost it; start over from this edge
+            m_tracking = false;
+            m_locked = false;
+            m_recordCount = 0;
+            m_recordNext = 0;
+            m_intervals.clear();
+            m_lastEdge = time;
+            return;
+        }
+    }
+
+    if (m_locked) {
+        m_record[m_recordNext] = {m_unitIntervals, float(error)};
+        m_recordNext = (m_recordNext + 1) % kRecordEdges;
+        m_recordCount = std::min(m_recordCount + 1, int(kRecordEdges));
+    }
+}
+
+bool clockRecovery::exportCsv(QString const& fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not open" << fileName;
+        return false;
+    }
+
+    jitterFigures const summary = figures();
+    char tempchar[128];
+    snprintf(tempchar, sizeof tempchar, "Unit interval (s), %g\nRMS jitter (s), %g\nPeak-to-peak jitter (s), %g\n\n",
+             summary.unitInterval, summary.rms, summary.peakToPeak);
+    file.write(tempchar);
+
+    // Oldest first
+    std::vector<tieSample> record(m_recordCount);
+    int const oldest = m_recordCount < kRecordEdges ? 0 : m_recordNext;
+    for (int i = 0; i < m_recordCount; ++i)
+        record[i] = m_record[(oldest + i) % kRecordEdges];
+    double const secondsPerSample = m_samplesPerSecond > 0 ? 1 / m_samplesPerSecond : 0;
+
+    file.write("UI, t (s), TIE (s)\n");
+    for (tieSample const& sample : record) {
+        int64_t const unitInterval = sample.unitInterval - record.front().unitInterval;
+        snprintf(tempchar, sizeof tempchar, "%lld, %g, %g\n", (long long)unitInterval,
+                 unitInterval * summary.unitInterval, sample.tie * secondsPerSample);
+        file.write(tempchar);
+    }
+
+    if (record.size() < 2) {
+        file.close();
+        return true;
+    }
+
+    // Histogram over the range of the record
+    static const int kHistogramBins = 64;
+    auto const range = std::minmax_element(record.begin(), record.end(),
+        [](tieSample const& a, tieSample const& b) { return a.tie < b.tie; });
+    double const lowest = range.first->tie;
+    double const binWidth = std::max(double(range.second->tie) - lowest, 1e-9) / kHistogramBins;
+    std::vector<int> histogram(kHistogramBins, 0);
+    for (tieSample const& sample : record)
+        ++histogram[std::min(int((sample.tie - lowest) / binWidth), kHistogramBins - 1)];
+    file.write("\nTIE bin centre (s), edges\n");
+    for (int bin = 0; bin < kHistogramBins; ++bin) {
+        snprintf(tempchar, sizeof tempchar, "%g, %d\n", (lowest + (bin + 0.5) * binWidth) * secondsPerSample, histogram[bin]);
+        file.write(tempchar);
+    }
+
+    // Spectrum of TIE sampled once per UI, each held until the next edge.
+    // Hann windowed, and the mean taken out.
+    static const int64_t kMaxSpectrumLength = 1 << 16;
+    int64_t const span = record.back().unitInterval - record.front().unitInterval + 1;
+    int const length = int(std::min(span, kMaxSpectrumLength));
+    int64_t const first = record.back().unitInterval - length + 1;
+    float* in = static_cast<float*>(fftwf_malloc(sizeof(float) * length));
+    fftwf_complex* out = static_cast<fftwf_complex*>(fftwf_malloc(sizeof(fftwf_complex) * (length / 2 + 1)));
+    fftwf_plan plan = fftwf_plan_dft_r2c_1d(length, in, out, FFTW_ESTIMATE);
+
+    double mean = 0;
+    size_t next = 0;
+    float held = record.front().tie;
+    for (int i = 0; i < length; ++i) {
+        while (next < record.size() && record[next].unitInterval <= first + i)
+            held = record[next++].tie;
+        in[i] = held;
+        mean += held;
+    }
+    mean /= length;
+    double windowSum = 0;
+    for (int i = 0; i < length; ++i) {
+        double const window = 0.5 - 0.5 * std::cos(2 * PI * i / length);
+        in[i] = float((in[i] - mean) * window);
+        windowSum += window;
+    }
+    fftwf_execute(plan);
+
+    // Amplitude of each jitter component, in seconds
+    file.write("\nJitter frequency (Hz), amplitude (s)\n");
+    double const unitIntervalsPerSecond = summary.unitInterval > 0 ? 1 / summary.unitInterval : 0;
+    for (int bin = 1; bin <= length / 2; ++bin) {
+        double const amplitude = 2 * std::hypot(out[bin][0], out[bin][1]) / windowSum;
+        snprintf(tempchar, sizeof tempchar, "%g, %g\n", bin * unitIntervalsPerSecond / length, amplitude * secondsPerSample);
+        file.write(tempchar);
+    }
+
+    fftwf_destroy_plan(plan);
+    fftwf_free(in);
+    fftwf_free(out);
+    file.close();
+    return true;
+}
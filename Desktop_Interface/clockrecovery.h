@@ -0,0 +1,101 @@
+#ifndef CLOCKRECOVERY_H
+#define CLOCKRECOVERY_H
+
+#include <cstdint>
+#include <vector>
+#include <QString>
+#include "jitter.h"
+
+class isoBuffer;
+
+// Streaming clock recovery on one analog channel.  Follows the channel
+// sample by sample, whatever the display is doing, so each call only
+// handles what has arrived since the last.
+//  - Slicer: the threshold sits halfway between a slowly leaking envelope
+//    of the signal, with hysteresis of a tenth of its swing.  Each edge is
+//    timed to a fraction of a sample where the signal crosses the
+//    threshold.
+//  - Acquisition: the unit interval is estimated from the first kAcquireEdges
+//    edges, as the interval that makes every gap between them closest to a
+//    whole number of unit intervals.
+//  - Tracking: a second order PLL, updated at each edge.  Its phase error
+//    there is the edge's time interval error (TIE).  It is locked while the
+//    mean |TIE| over the last kLockEdges edges is under kLockTolerance UI,
+//    and starts acquiring again if it climbs over kLossTolerance UI.
+// TIE is recorded for the last kRecordEdges edges while locked.
+class clockRecovery
+{
+public:
+    static const int kAcquireEdges = 64;
+    static const int kLockEdges = 32;
+    static const int kRecordEdges = 4096;
+
+    clockRecovery();
+
+    // Forgets everything; the next update() starts on whatever arrives then
+    void reset();
+    // Handles everything buffer has received since the last call
+    void update(isoBuffer const* buffer);
+
+    jitterFigures figures() const;
+
+    // The TIE record, a histogram of it, and its spectrum against jitter
+    // frequency, as CSV.  Only the processing thread may call this.
+    bool exportCsv(QString const& fileName) const;
+
+private:
+    void restart();
+    void process(short const* samples, int count);
+    void edge(double time);
+    void acquire(double time);
+    void track(double time);
+
+    static const uint32_t kMaxBacklog = 1 << 18;
+    static constexpr float kEnvelopeLeak = 1.f / 8192;
+    static constexpr float kMinSwing = 8;           // Raw counts
+    static constexpr double kPhaseGain = 1.0 / 16;
+    static constexpr double kFrequencyGain = 1.0 / 512; // Damping of about 0.7
+    static constexpr double kLockTolerance = 0.1;
+    static constexpr double kLossTolerance = 0.25;
+
+    isoBuffer const* m_buffer = nullptr;
+    uint64_t m_position = 0;
+    double m_samplesPerSecond = 0;
+    std::vector<short> m_raw;
+
+    // Slicer; times are in samples since the last restart
+    int64_t m_sampleIndex = 0;
+    bool m_started = false;
+    float m_high = 0;
+    float m_low = 0;
+    bool m_level = false;
+    short m_previous = 0;
+    double m_crossing = 0;      // Last time the signal crossed the threshold
+
+    // Acquisition
+    std::vector<double> m_intervals;
+    double m_lastEdge = -1;
+
+    // Tracking, in samples
+    bool m_tracking = false;
+    double m_clock = 0;         // A unit interval boundary
+    double m_period = 0;
+    int64_t m_unitIntervals = 0; // Boundaries since acquisition, up to m_clock
+    float m_lockErrors[kLockEdges];
+    double m_lockErrorSum = 0;
+    int m_lockIndex = 0;
+    int m_lockCount = 0;
+    bool m_locked = false;
+
+    // Record, a ring of the last kRecordEdges edges while locked
+    struct tieSample
+    {
+        int64_t unitInterval;
+        float tie;              // Samples
+    };
+    std::vector<tieSample> m_record;
+    int m_recordNext = 0;
+    int m_recordCount = 0;
+};
+
+#endif // CLOCKRECOVERY_H
@@ -0,0 +1,50 @@
+#ifndef CONVERSIONTABLE_H
+#define CONVERSIONTABLE_H
+
+#include <vector>
+
+// Raw ADC samples to volts for one channel at one sample width:
+//     volts = sample * voltsPerCount + offset
+// Samples in [-top, top) are looked up in a precomputed table: 256 entries
+// for the 8-bit scope modes, 4096 for the 12-bit multimeter.  Anything
+// outside that range (samples rescaled by a gain change, say) falls back
+// to the formula, which the table entries are computed with anyway.
+class conversionTable
+{
+public:
+    // Cheap when nothing changed, so it can be called once per frame.
+    void update(int top, double voltsPerCount, double offset)
+    {
+        if (top == m_top && voltsPerCount == m_voltsPerCount && offset == m_offset)
+            return;
+
+        m_top = top;
+        m_voltsPerCount = voltsPerCount;
+        m_offset = offset;
+        m_volts.resize(2 * top);
+        for (int i = 0; i < 2 * top; ++i)
+            m_volts[i] = (i - top) * voltsPerCount + offset;
+    }
+
+    double toVolts(int sample) const
+    {
+        unsigned const index = static_cast<unsigned>(sample + m_top);
+        return index < m_volts.size() ? m_volts[index] : sample * m_voltsPerCount + m_offset;
+    }
+
+    short toSample(double volts) const
+    {
+        return static_cast<short>((volts - m_offset) / m_voltsPerCount);
+    }
+
+    double voltsPerCount() const { return m_voltsPerCount; }
+    double offset() const { return m_offset; }
+
+private:
+    int m_top = 0;
+    double m_voltsPerCount = 0;
+    double m_offset = 0;
+    std::vector<double> m_volts;
+};
+
+#endif // CONVERSIONTABLE_H
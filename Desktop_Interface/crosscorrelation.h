@@ -0,0 +1,16 @@
+#ifndef CROSSCORRELATION_H
+#define CROSSCORRELATION_H
+
+// How CH2 relates to CH1 over one stretch of both
+struct crossCorrelationFigures
+{
+    int samples = 0;        // Per channel; 0 if nothing has been measured
+    bool valid = false;     // False if either channel is flat
+    double delay = 0;       // Seconds CH2 lags CH1 by, at the correlation peak
+    double correlation = 0; // Normalised correlation at that peak, -1 to 1
+    double frequency = 0;   // Hz, where the channels have the most power in common
+    double phase = 0;       // Degrees CH2 leads CH1 by at frequency, -180 to 180
+    double coherence = 0;   // Magnitude squared coherence at frequency, 0 to 1
+};
+
+#endif // CROSSCORRELATION_H
@@ -0,0 +1,236 @@
+#include "crosscorrelator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include "asyncdft.h"
+
+#define PI 3.141592653589793  // Predefined value for pi
+
+crossCorrelator::crossCorrelator()
+{
+    AsyncDFT::initFftw();
+    m_job.setAutoDelete(false);
+    m_job.engine = this;
+    m_pool.setMaxThreadCount(1);
+}
+
+crossCorrelator::~crossCorrelator()
+{
+    m_pool.waitForDone();
+    for (auto& entry : m_plans)
+        fftwf_destroy_plan(entry.second);
+    fftwf_free(m_job.in_buffer);
+    fftwf_free(m_job.out_buffer);
+    fftwf_free(m_job.cross);
+    fftwf_free(m_job.correlation);
+}
+
+static fftwf_plan makePlan(bool inverse, int size, unsigned flags)
+{
+    fftwf_complex* in = fftwf_alloc_complex(size);
+    fftwf_complex* out = fftwf_alloc_complex(size);
+    fftwf_plan made = inverse ? fftwf_plan_dft_c2r_1d(size, in, reinterpret_cast<float*>(out), flags)
+                              : fftwf_plan_dft_1d(size, in, out, FFTW_FORWARD, flags);
+    fftwf_free(in);
+    fftwf_free(out);
+    return made;
+}
+
+// The plan for a transform, made the first time it is asked for.  The
+// forward ones are the spectrum view's pair transforms, so their measured
+// plans are often in the wisdom already; otherwise FFTW_ESTIMATE will do.
+fftwf_plan crossCorrelator::plan(planKind kind, int size)
+{
+    fftwf_plan& slot = m_plans[std::make_pair(int(kind), size)];
+    if (!slot)
+        slot = makePlan(kind == InversePlan, size, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    if (!slot)
+        slot = makePlan(kind == InversePlan, size, FFTW_ESTIMATE);
+    return slot;
+}
+
+short* crossCorrelator::input(int channel, int count)
+{
+    std::vector<short>& raw = m_job.raw[channel];
+    raw.resize(count);
+    return raw.data();
+}
+
+void crossCorrelator::start(int count, double samplesPerSecond)
+{
+    correlationJob& job = m_job;
+    count = std::max(int(kMinSamples), std::min(count, int(kMaxSamples)));
+
+    // Twice the samples or more, so no lag wraps round onto another
+    int size = 2 * kMinSamples;
+    while (size < 2 * count)
+        size *= 2;
+    // A quarter of the samples or less, for seven segments or more
+    int segmentSize = kMinSamples / 4;
+    while (segmentSize * 2 <= count / 4)
+        segmentSize *= 2;
+
+    job.forward = plan(ForwardPlan, size);
+    job.inverse = plan(InversePlan, size);
+    job.segmentForward = plan(ForwardPlan, segmentSize);
+    if (job.bufferSize != size) {
+        fftwf_free(job.in_buffer);
+        fftwf_free(job.out_buffer);
+        fftwf_free(job.cross);
+        fftwf_free(job.correlation);
+        job.in_buffer = fftwf_alloc_complex(size);
+        job.out_buffer = fftwf_alloc_complex(size);
+        job.cross = fftwf_alloc_complex(size/2 + 1);
+        job.correlation = fftwf_alloc_real(size);
+        job.bufferSize = size;
+    }
+    if (int(job.window.size()) != segmentSize) {
+        job.window.resize(segmentSize);
+        for (int i = 0; i < segmentSize; ++i)
+            job.window[i] = float(AsyncDFT::windowFactor(1, segmentSize, i));
+    }
+
+    job.count = count;
+    job.samplesPerSecond = samplesPerSecond;
+    job.size = size;
+    job.segmentSize = segmentSize;
+    m_taken = false;
+    m_pending.store(1, std::memory_order_release);
+    m_pool.start(&job);
+}
+
+bool crossCorrelator::takeFigures(crossCorrelationFigures& figures)
+{
+    if (m_taken)
+        return false;
+    m_taken = true;
+    figures = m_job.figures;
+    return true;
+}
+
+// Two real signals x and y as one complex z = x + iy, as in AsyncDFT.
+// Gives 2X[k] and 2Y[k].
+static inline void separate(fftwf_complex const* z, int size, int k, float& xRe, float& xIm, float& yRe, float& yIm)
+{
+    fftwf_complex const& a = z[k];
+    fftwf_complex const& b = z[(size - k) & (size - 1)];
+    xRe = a[0] + b[0];
+    xIm = a[1] - b[1];
+    yRe = a[1] + b[1];
+    yIm = b[0] - a[0];
+}
+
+// Offset of a peak from its middle sample, from a parabola through three
+static inline double parabolicOffset(double before, double peak, double after)
+{
+    double const curvature = before - 2 * peak + after;
+    return curvature < 0 ? 0.5 * (before - after) / curvature : 0;
+}
+
+void crossCorrelator::correlationJob::run()
+{
+    figures = crossCorrelationFigures();
+    figures.samples = count;
+
+    float mean[2];
+    double energy[2];
+    for (int channel = 0; channel < 2; ++channel) {
+        short const* samples = raw[channel].data();
+        int64_t const sum = std::accumulate(samples, samples + count, int64_t(0));
+        mean[channel] = float(double(sum) / count);
+        double squares = 0;
+        for (int i = 0; i < count; ++i)
+            squares += (samples[i] - mean[channel]) * (samples[i] - mean[channel]);
+        energy[channel] = squares;
+    }
+    if (energy[0] <= 0 || energy[1] <= 0) {
+        engine->m_pending.store(0, std::memory_order_release);
+        return;
+    }
+
+    // Cross-correlation at every lag
+    short const* samples1 = raw[0].data();
+    short const* samples2 = raw[1].data();
+    for (int i = 0; i < count; ++i) {
+        in_buffer[i][0] = samples1[i] - mean[0];
+        in_buffer[i][1] = samples2[i] - mean[1];
+    }
+    float* const padding = reinterpret_cast<float*>(in_buffer);
+    std::fill(padding + 2 * count, padding + 2 * size, 0.f);
+    fftwf_execute_dft(forward, in_buffer, out_buffer);
+    for (int k = 0; k <= size/2; ++k) {
+        float xRe, xIm, yRe, yIm;
+        separate(out_buffer, size, k, xRe, xIm, yRe, yIm);
+        cross[k][0] = 0.25f * (yRe*xRe + yIm*xIm);
+        cross[k][1] = 0.25f * (yIm*xRe - yRe*xIm);
+    }
+    fftwf_execute_dft_c2r(inverse, cross, correlation);
+
+    // Lag l is at l, or size + l when negative
+    int best = 0;
+    float peak = correlation[0];
+    for (int lag = -(count - 1); lag < count; ++lag) {
+        float const value = correlation[lag < 0 ? size + lag : lag];
+        if (value > peak) {
+            peak = value;
+            best = lag;
+        }
+    }
+    int const bestIndex = best < 0 ? size + best : best;
+    double const lagOffset = parabolicOffset(correlation[(bestIndex - 1) & (size - 1)], peak,
+                                          correlation[(bestIndex + 1) & (size - 1)]);
+    figures.delay = (best + lagOffset) / samplesPerSecond;
+    figures.correlation = peak / (double(size) * std::sqrt(energy[0] * energy[1]));
+
+    // Welch cross spectrum, the last segment ending at the newest sample
+    int const bins = segmentSize/2 + 1;
+    int const hop = segmentSize/2;
+    int const segments = 1 + (count - segmentSize) / hop;
+    int const first = count - segmentSize - (segments - 1) * hop;
+    for (std::vector<double>* sums : {&segmentPower[0], &segmentPower[1], &segmentCrossRe, &segmentCrossIm})
+        sums->assign(bins, 0.0);
+    float const* factors = window.data();
+    for (int segment = 0; segment < segments; ++segment) {
+        int const offset = first + segment * hop;
+        for (int i = 0; i < segmentSize; i++) {
+            in_buffer[i][0] = (samples1[offset + i] - mean[0]) * factors[i];
+            in_buffer[i][1] = (samples2[offset + i] - mean[1]) * factors[i];
+        }
+        fftwf_execute_dft(segmentForward, in_buffer, out_buffer);
+        for (int k = 0; k < bins; ++k) {
+            float xRe, xIm, yRe, yIm;
+            separate(out_buffer, segmentSize, k, xRe, xIm, yRe, yIm);
+            segmentPower[0][k] += xRe*xRe + xIm*xIm;
+            segmentPower[1][k] += yRe*yRe + yIm*yIm;
+            segmentCrossRe[k] += yRe*xRe + yIm*xIm;
+            segmentCrossIm[k] += yIm*xRe - yRe*xIm;
+        }
+    }
+
+    // Largest cross spectrum bin, DC and Nyquist aside
+    int peakBin = 1;
+    double peakMagnitude = 0;
+    for (int k = 1; k < bins - 1; ++k) {
+        double const magnitude = std::hypot(segmentCrossRe[k], segmentCrossIm[k]);
+        if (magnitude > peakMagnitude) {
+            peakMagnitude = magnitude;
+            peakBin = k;
+        }
+    }
+    double const autoPower = segmentPower[0][peakBin] * segmentPower[1][peakBin];
+    if (peakMagnitude <= 0 || autoPower <= 0) {
+        engine->m_pending.store(0, std::memory_order_release);
+        return;
+    }
+    auto logMagnitude = [this](int k) {
+        return std::log(std::max(std::hypot(segmentCrossRe[k], segmentCrossIm[k]), 1e-30));
+    };
+    double const binOffset = parabolicOffset(logMagnitude(peakBin - 1), logMagnitude(peakBin), logMagnitude(peakBin + 1));
+    figures.frequency = (peakBin + binOffset) * samplesPerSecond / segmentSize;
+    figures.phase = std::atan2(segmentCrossIm[peakBin], segmentCrossRe[peakBin]) * 180 / PI;
+    figures.coherence = peakMagnitude * peakMagnitude / autoPower;
+    figures.valid = true;
+
+    engine->m_pending.store(0, std::memory_order_release);
+}
@@ -0,0 +1,89 @@
+#ifndef CROSSCORRELATOR_H
+#define CROSSCORRELATOR_H
+#include <QRunnable>
+#include <QThreadPool>
+#include <atomic>
+#include <map>
+#include <utility>
+#include <vector>
+#include <fftw3.h>
+#include "crosscorrelation.h"
+
+// CH1 against CH2, for arbitrary signals.  The processing thread hands over
+// the same stretch of both channels' raw samples and carries on; a worker
+// thread does the rest, in O(N log N):
+//  - Delay: the cross-correlation over every lag, as the inverse transform
+//    of Y conj(X) with both zero padded to twice their length so it doesn't
+//    wrap round.  Its peak is interpolated to a fraction of a sample.
+//    The estimate tapers with lag, so for a periodic signal the peak nearest
+//    zero lag wins.
+//  - Phase and coherence: from a Welch estimate of the cross spectrum
+//    (Hann, 50% overlap, at least seven segments), at its largest bin.
+//    Coherence needs the averaging; a single transform always gives 1.
+// Both channels go through one complex transform, as in AsyncDFT.
+// Raw samples are enough: converting to volts scales each channel by a
+// positive constant and shifts it, and the means are taken out anyway.
+class crossCorrelator
+{
+public:
+    crossCorrelator();
+    ~crossCorrelator();
+    static const int kMinSamples = 1<<10;
+    static const int kMaxSamples = 1<<19;
+
+    // Everything here is for the processing thread.
+    // False while the last request is still running
+    bool idle() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    // Where the next request's count raw samples for a channel go, oldest
+    // first.  Only to be written while idle().
+    short* input(int channel, int count);
+
+    // Starts on count samples of each input, kMinSamples to kMaxSamples,
+    // taken at samplesPerSecond.  Must be idle().
+    void start(int count, double samplesPerSecond);
+
+    // Copies out the last request's figures if they haven't been taken yet.
+    // Must be idle().
+    bool takeFigures(crossCorrelationFigures& figures);
+
+private:
+    enum planKind { ForwardPlan, InversePlan };
+    fftwf_plan plan(planKind kind, int size);
+    std::map<std::pair<int, int>, fftwf_plan> m_plans;
+
+    class correlationJob : public QRunnable
+    {
+    public:
+        void run() override;
+
+        crossCorrelator* engine = nullptr;
+        std::vector<short> raw[2];
+        int count = 0;
+        double samplesPerSecond = 0;
+        // Zero padded transform over everything, and Welch segments
+        int size = 0;
+        int segmentSize = 0;
+        fftwf_plan forward = nullptr;
+        fftwf_plan inverse = nullptr;
+        fftwf_plan segmentForward = nullptr;
+        fftwf_complex* in_buffer = nullptr;
+        fftwf_complex* out_buffer = nullptr;
+        fftwf_complex* cross = nullptr;     // size/2 + 1 bins, destroyed by the inverse
+        float* correlation = nullptr;
+        int bufferSize = 0;
+        std::vector<float> window;          // Hann, segmentSize long
+        std::vector<double> segmentPower[2];
+        std::vector<double> segmentCrossRe;
+        std::vector<double> segmentCrossIm;
+        crossCorrelationFigures figures;
+    };
+    correlationJob m_job;
+
+    std::atomic<int> m_pending{0};
+    bool m_taken = true;
+
+    QThreadPool m_pool;
+};
+
+#endif // CROSSCORRELATOR_H
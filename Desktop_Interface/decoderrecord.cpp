@@ -0,0 +1,102 @@
+#include "decoderrecord.h"
+#include "isobufferbuffer.h"
+#include <QIODevice>
+#include <QPlainTextEdit>
+#include <cstdio>
+
+namespace
+{
+// The console's maximumBlockCount only bounds the number of lines, so a
+// stream without newlines would grow a single block without limit.
+// Past this many characters the console is rebuilt from the buffer.
+constexpr int kConsoleCharacterLimitFactor = 4;
+
+char const* kindName(decoderRecord::Kind kind)
+{
+    switch (kind)
+    {
+    case decoderRecord::Kind::UartByte:
+        return "Byte";
+    case decoderRecord::Kind::I2cStart:
+        return "Start";
+    case decoderRecord::Kind::I2cAddress:
+        return "Address";
+    case decoderRecord::Kind::I2cData:
+        return "Data";
+    case decoderRecord::Kind::I2cStop:
+        return "Stop";
+    case decoderRecord::Kind::I2cError:
+        return "Error";
+    case decoderRecord::Kind::SamplesLost:
+        return "Samples lost";
+    }
+    return "";
+}
+}
+
+void decoderRecordLog::add(decoderRecord const& record)
+{
+    if (m_records.size() < kLength)
+    {
+        m_records.push_back(record);
+        return;
+    }
+    m_records[m_next] = record;
+    m_next = (m_next + 1) % kLength;
+}
+
+void decoderRecordLog::writeCsvHeader(QIODevice& file)
+{
+    file.write("Decoder, Sample, t (s), Kind, Value, R/W, ACK, Parity\n");
+}
+
+void decoderRecordLog::writeCsv(QIODevice& file, char const* decoder, double samplesPerSecond) const
+{
+    double const secondsPerSample = samplesPerSecond > 0 ? 1 / samplesPerSecond : 0;
+    char tempchar[128];
+    for (size_t i = 0; i < m_records.size(); ++i)
+    {
+        decoderRecord const& record = m_records[(m_next + i) % m_records.size()];
+        bool const hasValue = record.kind == decoderRecord::Kind::UartByte
+                           || record.kind == decoderRecord::Kind::I2cAddress
+                           || record.kind == decoderRecord::Kind::I2cData;
+        bool const hasAck = record.kind == decoderRecord::Kind::I2cAddress
+                         || record.kind == decoderRecord::Kind::I2cData;
+        char value[8] = "";
+        if (hasValue)
+            snprintf(value, sizeof value, "0x%02x", record.value);
+
+        snprintf(tempchar, sizeof tempchar, "%s, %llu, %.9g, %s, %s, %s, %s, %s\n",
+                 decoder, (unsigned long long)record.sample, record.sample * secondsPerSample,
+                 kindName(record.kind), value,
+                 record.kind == decoderRecord::Kind::I2cAddress ? (record.read ? "R" : "W") : "",
+                 hasAck ? (record.nack ? "NACK" : "ACK") : "",
+                 record.kind == decoderRecord::Kind::UartByte ? (record.parityError ? "Error" : "OK") : "");
+        file.write(tempchar);
+    }
+}
+
+void appendToConsole(QPlainTextEdit* console, isoBufferBuffer& text, bool autoScroll)
+{
+    if (console->document()->characterCount() > int(text.capacity()) * kConsoleCharacterLimitFactor)
+    {
+        console->setPlainText(QString::fromLocal8Bit(text.begin(), text.size()));
+    }
+    else if (text.unread() != 0)
+    {
+        // Insert through a separate cursor so that the user's selection
+        // and scroll position are left alone.
+        QTextCursor tail(console->document());
+        tail.movePosition(QTextCursor::End);
+        tail.insertText(QString::fromLocal8Bit(text.end() - text.unread(), text.unread()));
+    }
+    text.markRead();
+
+    if (autoScroll)
+    {
+        //http://stackoverflow.com/questions/21059678/how-can-i-set-auto-scroll-for-a-qtgui-qtextedit-in-pyqt4   DANKON
+        QTextCursor c = console->textCursor();
+        c.movePosition(QTextCursor::End);
+        console->setTextCursor(c);
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef DECODERRECORD_H
+#define DECODERRECORD_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "frameexchange.h"
+
+class QIODevice;
+class QPlainTextEdit;
+class isoBufferBuffer;
+
+// One thing a serial or I2C decoder found on the wire
+struct decoderRecord
+{
+    enum class Kind : uint8_t
+    {
+        UartByte,
+        I2cStart,
+        I2cAddress,
+        I2cData,
+        I2cStop,
+        I2cError,       // SCL fell as SDA rose, which no transfer does
+        SamplesLost     // The decoder fell a whole buffer behind, and restarted at sample
+    };
+
+    uint64_t sample = 0;        // Logic samples since the buffer was created, where it was decoded
+    Kind kind = Kind::UartByte;
+    uint8_t value = 0;          // The byte, or the 7 bit address
+    bool read = false;          // I2cAddress: the R/W bit
+    bool nack = false;          // I2cAddress and I2cData
+    bool parityError = false;   // UartByte
+};
+
+// Hands records from the decoder worker to whatever shows or saves them on
+// the GUI thread, without either side waiting.  If the reader falls a whole
+// ring behind, new records are dropped and counted rather than blocking
+// the decoder.
+class decoderRecordRing
+{
+public:
+    static constexpr size_t kLength = 1 << 14;
+
+    // Decoder worker
+    void push(decoderRecord const& record)
+    {
+        decoderRecord* slot = m_queue.writeSlot();
+        if (!slot)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        *slot = record;
+        m_queue.push();
+    }
+
+    // Reader.  Calls function on every record waiting, oldest first, and
+    // returns how many there were.
+    template<typename Function>
+    int drain(Function function)
+    {
+        int count = 0;
+        while (decoderRecord const* record = m_queue.readSlot())
+        {
+            function(*record);
+            m_queue.pop();
+            count++;
+        }
+        return count;
+    }
+
+    // Records lost to a full ring since the last call
+    uint32_t takeDropped()
+    {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    spscQueue<decoderRecord, kLength> m_queue;
+    std::atomic<uint32_t> m_dropped{0};
+};
+
+// The last kLength records a decoder's console has shown, kept on the GUI
+// thread so they can be saved as CSV
+class decoderRecordLog
+{
+public:
+    static constexpr size_t kLength = 1 << 18;
+
+    void add(decoderRecord const& record);
+
+    // The column names, for the first line of the file
+    static void writeCsvHeader(QIODevice& file);
+    // Oldest first, each line starting with decoder's name.  samplesPerSecond
+    // is of logic samples, to put a time to each.
+    void writeCsv(QIODevice& file, char const* decoder, double samplesPerSecond) const;
+
+private:
+    std::vector<decoderRecord> m_records;
+    size_t m_next = 0; // Where the next goes once m_records is full
+};
+
+// Shows the text a decoder's console has not shown yet at the end of
+// console, and marks it as read.  GUI thread.
+void appendToConsole(QPlainTextEdit* console, isoBufferBuffer& text, bool autoScroll);
+
+#endif // DECODERRECORD_H
@@ -0,0 +1,79 @@
+#include "decoderworker.h"
+#include "uartstyledecoder.h"
+#include "i2cdecoder.h"
+
+decoderWorker::decoderWorker()
+{
+    m_job.setAutoDelete(false);
+    m_job.worker = this;
+    m_pool.setMaxThreadCount(1);
+}
+
+decoderWorker::~decoderWorker()
+{
+    m_pool.waitForDone();
+}
+
+void decoderWorker::addUart(uartStyleDecoder* decoder, isoBufferPosition const& position)
+{
+    if (m_job.count == kMaxTasks)
+        return;
+    decodeTask& task = m_job.tasks[m_job.count++];
+    task.uart = decoder;
+    task.twoWire = nullptr;
+    task.position = position;
+}
+
+void decoderWorker::addTwoWire(i2c::i2cDecoder* decoder, isoBufferPosition const& position)
+{
+    if (m_job.count == kMaxTasks)
+        return;
+    decodeTask& task = m_job.tasks[m_job.count++];
+    task.uart = nullptr;
+    task.twoWire = decoder;
+    task.position = position;
+}
+
+void decoderWorker::start()
+{
+    if (m_job.count == 0)
+        return;
+    m_pending.store(1, std::memory_order_release);
+    m_pool.start(&m_job);
+}
+
+void decoderWorker::wait()
+{
+    m_pool.waitForDone();
+}
+
+void decoderWorker::decodeJob::run()
+{
+    for (int i = 0; i < count; ++i)
+    {
+        decodeTask const& task = tasks[i];
+        // The processing thread keeps writing while this reads, so a big
+        // enough backlog can be written over before it is decoded.
+        if (task.uart)
+        {
+            uint64_t const oldest = task.uart->serialDecode(task.position);
+            if (task.uart->buffer()->overwritten(oldest))
+                task.uart->samplesLost();
+        }
+        else
+        {
+            try
+            {
+                uint64_t const oldest = task.twoWire->run(task.position);
+                if (task.twoWire->sda->overwritten(oldest) || task.twoWire->scl->overwritten(oldest))
+                    task.twoWire->samplesLost();
+            }
+            catch(...)
+            {
+                task.twoWire->restart(task.position.back);
+            }
+        }
+    }
+    count = 0;
+    worker->m_pending.store(0, std::memory_order_release);
+}
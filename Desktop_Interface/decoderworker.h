@@ -0,0 +1,65 @@
+#ifndef DECODERWORKER_H
+#define DECODERWORKER_H
+#include <QRunnable>
+#include <QThreadPool>
+#include <atomic>
+#include "isobuffer.h"
+
+class uartStyleDecoder;
+namespace i2c { class i2cDecoder; }
+
+// Runs the serial and I2C decoders off the processing thread.  Each frame
+// that decodes, the processing thread queues whichever decoders are on,
+// with how far their buffers had been written, and starts them; they catch
+// up to there on a worker thread while it carries on.  A backlog only makes
+// the next batch wait, never a frame; one so big the processing thread
+// writes over it mid-decode restarts the decoder, with a SamplesLost record.
+// Their output goes to each decoder's decoderRecordRing, so nothing the
+// worker touches is shared with the GUI thread.
+class decoderWorker
+{
+public:
+    decoderWorker();
+    ~decoderWorker();
+
+    // Everything here is for the processing thread.
+    // False while the last batch is still running.  The decoders, and
+    // the buffers they read, are only to be changed while idle().
+    bool idle() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    // Queue a decoder for the next batch.  Must be idle().
+    void addUart(uartStyleDecoder* decoder, isoBufferPosition const& position);
+    void addTwoWire(i2c::i2cDecoder* decoder, isoBufferPosition const& position);
+
+    // Runs everything queued, if anything was.  Must be idle().
+    void start();
+    // Blocks until idle()
+    void wait();
+
+private:
+    static const int kMaxTasks = 3;
+
+    struct decodeTask
+    {
+        uartStyleDecoder* uart = nullptr;
+        i2c::i2cDecoder* twoWire = nullptr;
+        isoBufferPosition position;
+    };
+
+    class decodeJob : public QRunnable
+    {
+    public:
+        void run() override;
+
+        decoderWorker* worker = nullptr;
+        decodeTask tasks[kMaxTasks];
+        int count = 0;
+    };
+    decodeJob m_job;
+
+    std::atomic<int> m_pending{0};
+
+    QThreadPool m_pool;
+};
+
+#endif // DECODERWORKER_H
@@ -0,0 +1,100 @@
+#include "distortion.h"
+#include <algorithm>
+#include <cmath>
+
+// Harmonics looked for, counting the fundamental as the 1st
+static const int kMaxHarmonic = 10;
+
+// Bins either side of a tone's peak that still belong to it, by window
+// type: out to where its leakage is well under the noise of an 8-bit
+// capture.  The rectangular window leaks everywhere, so its figures are
+// only rough whatever is done here.
+static int lobeHalfWidth(int windowType)
+{
+    switch (windowType)
+    {
+    case 1: // Hann
+    case 2: // Hamming
+        return 10;
+    case 3: // Blackman
+    case 4: // Flat top
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+static double decibels(double ratio)
+{
+    // Clear of log10(0) for a perfectly clean synthetic input
+    return 10 * std::log10(std::max(ratio, 1e-30));
+}
+
+distortionFigures measureDistortion(float const* power, int bins, int size, int averages,
+                                    int windowType, double windowSumSquares)
+{
+    distortionFigures figures;
+    int const lobe = lobeHalfWidth(windowType);
+    // Clear of DC and the window's leakage from it
+    int const first = lobe + 1;
+    if (bins <= first + 2 * lobe)
+        return figures;
+
+    // Sums a tone's lobe, clipped to the band, and says which bins it took
+    auto lobeSum = [&](int centre, int& lower, int& upper) {
+        lower = std::max(first, centre - lobe);
+        upper = std::min(bins - 1, centre + lobe);
+        double sum = 0;
+        for (int k = lower; k <= upper; ++k)
+            sum += power[k];
+        return sum;
+    };
+
+    double total = 0;
+    for (int k = first; k < bins; ++k)
+        total += power[k];
+
+    int const peak = int(std::max_element(power + first, power + bins) - power);
+    // Any lower and the harmonics' lobes would run into each other
+    if (peak < 4 * lobe + 1 || total <= 0)
+        return figures;
+
+    int lower, upper;
+    double const fundamental = lobeSum(peak, lower, upper);
+    int toneBins = upper - lower + 1;
+    // Centroid of the lobe, between the bins
+    double weighted = 0;
+    for (int k = lower; k <= upper; ++k)
+        weighted += k * double(power[k]);
+    figures.frequency = weighted / fundamental;
+
+    double harmonics = 0;
+    for (int harmonic = 2; harmonic <= kMaxHarmonic; ++harmonic) {
+        int const predicted = int(std::lround(harmonic * figures.frequency));
+        if (predicted + lobe >= bins)
+            break;
+        // The prediction drifts with the harmonic number, so look around it
+        int const searchLower = std::max(first, predicted - lobe);
+        int const centre = int(std::max_element(power + searchLower, power + predicted + lobe + 1) - power);
+        harmonics += lobeSum(centre, lower, upper);
+        toneBins += upper - lower + 1;
+        figures.harmonics++;
+    }
+
+    int const noiseBins = (bins - first) - toneBins;
+    if (noiseBins <= 0)
+        return figures;
+    // Everything but DC; the bins under the tones are taken to be as noisy as the rest
+    double const noise = std::max(total - fundamental - harmonics, 0.0) / noiseBins * (bins - 1);
+
+    // Parseval: sum |X|^2 = N sum (wx)^2, and a sine's power is split between
+    // +f and -f, so V_RMS^2 = 2 * lobe sum / (N * sum w^2), per transform.
+    figures.amplitude = std::sqrt(2 * fundamental / (double(averages) * size * windowSumSquares));
+    figures.thd = decibels(harmonics / fundamental);
+    figures.thdPlusNoise = decibels((harmonics + noise) / fundamental);
+    figures.snr = decibels(fundamental / noise);
+    figures.sinad = decibels(fundamental / (harmonics + noise));
+    figures.enob = (figures.sinad - 1.76) / 6.02;
+    figures.valid = true;
+    return figures;
+}
@@ -0,0 +1,30 @@
+#ifndef DISTORTION_H
+#define DISTORTION_H
+
+// Harmonic distortion and noise of a sine, worked out from a power spectrum
+// that has already been made for the spectrum view, so no transforms of
+// its own.  Each tone's power is summed over its main lobe and the worst of
+// its leakage, which makes the figures independent of where the tone falls
+// between bins.  The window only changes how many bins that takes, apart
+// from the fundamental's level, which is corrected by its sum of squares.
+// Noise is measured in the bins left over and scaled up to the whole band.
+struct distortionFigures
+{
+    bool valid = false;     // False if there is no clear fundamental
+    double frequency = 0;   // Of the fundamental, in bins until converted to Hz
+    double amplitude = 0;   // Of the fundamental, V RMS
+    int harmonics = 0;      // Found below Nyquist, from the 2nd up
+    double thd = 0;         // All in dB relative to the fundamental's power
+    double thdPlusNoise = 0;
+    double snr = 0;         // dB
+    double sinad = 0;       // dB
+    double enob = 0;        // Bits, from SINAD
+};
+
+// power is the sum of averages one-sided |X[k]|^2 spectra of size-point
+// transforms, bins = size/2 + 1, windowed with windowType (as for
+// AsyncDFT::windowFactor()) whose squares sum to windowSumSquares.
+distortionFigures measureDistortion(float const* power, int bins, int size, int averages,
+                                    int windowType, double windowSumSquares);
+
+#endif // DISTORTION_H
@@ -0,0 +1,242 @@
+#include "eyehistogram.h"
+#include "asyncdft.h"
+#include "allocationcounter.h"
+#include "spline.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+int eyeHistogram::update(QVector<double> const& volts, double samplesPerSecond, AsyncDFT& dft)
+{
+    if (volts.size() < AsyncDFT::n_samples || !estimateSymbolRate(volts, dft))
+        return 0;
+    resample(volts);
+
+    int const first = recoverClock();
+    if (first < 0)
+        return 0;
+
+    // Rounded out to whole volts, so noise doesn't keep moving it
+    auto const range = std::minmax_element(m_resampled.begin() + first, m_resampled.end());
+    double const vBottom = std::round(*range.first) - 1;
+    double const vTop = std::round(*range.second) + 1;
+    double const symbolPeriod = double(volts.size()) / m_symbols / samplesPerSecond;
+    if (vBottom != m_vBottom || vTop != m_vTop || std::abs(symbolPeriod - m_symbolPeriod) > 0.01 * m_symbolPeriod) {
+        m_vBottom = vBottom;
+        m_vTop = vTop;
+        m_symbolPeriod = symbolPeriod;
+        clear();
+    } else {
+        for (float& count : m_counts)
+            count *= kFade;
+        m_maxCount *= kFade;
+    }
+    return fold(first);
+}
+
+void eyeHistogram::clear()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0.f);
+    m_maxCount = 0;
+}
+
+// Sets m_average, m_samplesPerSymbol and m_symbols from the fundamental of
+// the signal's edges
+bool eyeHistogram::estimateSymbolRate(QVector<double> const& volts, AsyncDFT& dft)
+{
+    // Analog to digital conversion
+    double const HYSTERESIS = 0.5;
+    m_average = std::accumulate(volts.begin(), volts.end(), 0.0) / volts.size();
+    m_binary.resize(volts.size());
+    m_binary[0] = 0;
+    for (int i = 1; i < volts.size(); ++i)
+    {
+        if (!m_binary[i-1] && volts[i] > m_average+HYSTERESIS)
+            m_binary[i] = 1;
+        else if (m_binary[i-1] && volts[i] < m_average-HYSTERESIS)
+            m_binary[i] = 0;
+        else
+            m_binary[i] = m_binary[i-1];
+    }
+
+    // Calculate edges
+    m_edges.resize(volts.size());
+    m_edges[0] = 0;
+    for (int i = 1; i < volts.size(); ++i)
+        m_edges[i] = m_binary[i] != m_binary[i-1];
+
+    // Power spectrum of the edges, Hann windowed
+    QVector<double>& yf = m_edgeSpectrum;
+    dft.getPowerSpectrum_dBmV(m_edges, dft.windowSum(1, AsyncDFT::n_samples), yf);
+    if (yf.size() < 32)
+        return false;
+
+    // The lowest of the five strongest bins, DC aside.  Only those five
+    // need to be found, in no particular order.
+    std::vector<int>& indices = m_indices;
+    indices.resize(yf.size()-10);
+    std::iota(indices.begin(), indices.end(), 10);
+    std::nth_element(indices.begin(), indices.end() - 5, indices.end(),
+        [&yf](int i, int j) {
+            return yf[i] < yf[j];
+        });
+    int peak_idx = *std::min_element(indices.end() - 5, indices.end());
+    peak_idx = std::min(peak_idx, int(yf.size()) - 6);
+
+    // Create a cubic spline interpolation function.
+    // tk::spline keeps its coefficients on the heap, so this is exempt.
+    allocationExempt splineExempt;
+    std::vector<double> xf_partial(11);
+    std::vector<double> yf_partial(11);
+    for (int i = 0; i < 11; ++i) {
+        xf_partial[i] = peak_idx-5+i;
+        yf_partial[i] = std::abs(yf[int(xf_partial[i])]);
+    }
+    tk::spline cs(xf_partial, yf_partial);
+
+    // Generate a fine grid of x values to evaluate the cubic spline
+    m_fineX.resize(201);
+    m_fineY.resize(201);
+    double step = (xf_partial[10] - xf_partial[0]) / 200;
+    for (int i = 0; i < 201; ++i) {
+        m_fineX[i] = xf_partial[0] + i * step;
+        m_fineY[i] = cs(m_fineX[i]);
+    }
+
+    // calculate normalized fundamental frequency
+    auto max_it = std::max_element(m_fineY.begin(), m_fineY.end());
+    double fundamental_frequency_normalized = m_fineX[std::distance(m_fineY.begin(), max_it)]/volts.size();
+
+    // Edges can only fall on symbol boundaries, so their fundamental is
+    // the symbol rate itself.  Calculate samples per symbol and number of symbols
+    double const samplesPerSymbol = 1 / fundamental_frequency_normalized;
+    m_symbols = std::round(volts.size()/samplesPerSymbol);
+    m_samplesPerSymbol = std::round(samplesPerSymbol);
+    return m_samplesPerSymbol >= 2 && m_symbols >= 4;
+}
+
+// Resample at a whole m_samplesPerSymbol
+void eyeHistogram::resample(QVector<double> const& volts)
+{
+    int const numOutputSamples = m_symbols * m_samplesPerSymbol;
+    m_resampled.resize(numOutputSamples);
+    double const inputSize = static_cast<double>(volts.size());
+    double const outputSize = static_cast<double>(numOutputSamples);
+    for (int i = 0; i < numOutputSamples; ++i) {
+        double idx = (i + 0.5) * (inputSize-1) / outputSize;
+        int lb_idx = static_cast<int>(idx);
+        int ub_idx = std::min(lb_idx + 1, volts.size() - 1);
+        double fraction = idx - lb_idx;
+
+        // Interpolate between data points
+        m_resampled[i] = volts[lb_idx] * (1.0 - fraction) + volts[ub_idx] * fraction;
+    }
+}
+
+// Runs the digital PLL over the resampled signal, leaving the moving
+// average of its phase error at each sample in m_errorAverage.
+// Returns where the first symbol to fold starts, half a symbol after an
+// edge, or -1 if it never holds lock for long enough.
+int eyeHistogram::recoverClock()
+{
+    int const n = m_resampled.size();
+    m_binary.resize(n);
+    for (int i = 0; i < n; ++i)
+        m_binary[i] = m_resampled[i] > m_average;
+
+    // Clock Recovery using digital PLL
+    uint16_t NCO_BIAS  = (1l << 16) / m_samplesPerSymbol;
+    uint16_t PHASE_TARGET = 300 * (1l << 16) / 360;
+
+    uint16_t nco_phase = 0;
+    int32_t nco_word = 0;
+
+    constexpr int16_t Kp = 6; // bit shift division
+    constexpr int16_t Ki = 9; // bit shift division
+    int32_t integrator = 0;
+    int32_t error = 0;
+
+    // The moving average is kept as a running sum
+    int const moving_avg_size = 5 * m_samplesPerSymbol;
+    int64_t errorSum = 0;
+    m_errors.resize(n);
+    m_errorAverage.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        // Edge detection
+        if (i > 0 && m_binary[i] != m_binary[i-1])
+        {
+            error = (int32_t)PHASE_TARGET - nco_phase;
+            integrator += error;
+            nco_word = (error >> Kp) + (integrator >> Ki);
+        }
+        nco_phase += (nco_word + NCO_BIAS);
+
+        m_errors[i] = std::abs(error);
+        errorSum += m_errors[i];
+        if (i >= moving_avg_size)
+            errorSum -= m_errors[i - moving_avg_size];
+        m_errorAverage[i] = i + 1 >= moving_avg_size ? float(errorSum) / moving_avg_size
+                                                     : std::numeric_limits<float>::infinity();
+    }
+
+    // After PLL is locked (small average error), it can loose lock due to noise or other disturbances.
+    // Hence, we need to find a segment where the average error is below a given threshold
+    // for a given number of samples.
+    int const N = 10000;
+    float const error_threshold = 100.0f;
+    int counter = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        if (m_errorAverage[i] < error_threshold) {
+            counter += 1;
+            if (counter == N) {
+                for (int j = i - N + 1; j < n; ++j) {
+                    if (j > 0 && m_binary[j] != m_binary[j-1])
+                        return j + m_samplesPerSymbol/2;
+                }
+                return -1;
+            }
+        } else {
+            counter = 0;  // Reset counter if value is not less than threshold
+        }
+    }
+    return -1;
+}
+
+// Folds in every two symbol stretch from first on, one symbol apart, until
+// the PLL loses lock
+int eyeHistogram::fold(int first)
+{
+    int const span = 2 * m_samplesPerSymbol;
+    float const error_threshold = 100.0f;
+    double const rowsPerVolt = kRows / (m_vTop - m_vBottom);
+
+    // Where each column falls between the resampled samples
+    int columnIndex[kColumns];
+    float columnFraction[kColumns];
+    for (int column = 0; column < kColumns; ++column) {
+        double const position = (column + 0.5) * span / kColumns;
+        columnIndex[column] = int(position);
+        columnFraction[column] = float(position - columnIndex[column]);
+    }
+
+    int folded = 0;
+    double const* samples = m_resampled.constData();
+    for (int start = first; start + span < m_resampled.size(); start += m_samplesPerSymbol) {
+        if (!(m_errorAverage[start + span] < error_threshold))
+            break;
+        for (int column = 0; column < kColumns; ++column) {
+            double const* at = samples + start + columnIndex[column];
+            double const v = at[0] + (at[1] - at[0]) * columnFraction[column];
+            int const row = std::max(0, std::min(int((v - m_vBottom) * rowsPerVolt), kRows - 1));
+            float& count = m_counts[row * kColumns + column];
+            count += 1;
+            m_maxCount = std::max(m_maxCount, count);
+        }
+        ++folded;
+    }
+    return folded;
+}
@@ -0,0 +1,70 @@
+#ifndef EYEHISTOGRAM_H
+#define EYEHISTOGRAM_H
+
+#include <vector>
+#include <QVector>
+
+class AsyncDFT;
+
+// Density eye diagram: how often a channel has passed through each point
+// of a two symbol window, by time and voltage.
+// Each update estimates the symbol rate from the spectrum of the signal's
+// edges, resamples to a whole number of samples per symbol and runs a
+// digital PLL over it.  Every symbol from where the PLL locks for as long
+// as it stays locked is folded in, each drawn across every column.
+// Old hits fade by kFade per update, and everything starts over when the
+// symbol rate or the voltage range changes.
+// Only the processing thread uses it; frames get a copy.
+class eyeHistogram
+{
+public:
+    static constexpr int kColumns = 128;
+    static constexpr int kRows = 256;
+    static constexpr float kFade = 0.95f;
+
+    // volts is at least AsyncDFT::n_samples of the channel, oldest first.
+    // Returns the number of symbols folded in, 0 if there was no clear
+    // symbol rate or the PLL never locked.
+    int update(QVector<double> const& volts, double samplesPerSecond, AsyncDFT& dft);
+
+    void clear();
+
+    // Counts row by row, kColumns per row, earliest column first.  The
+    // columns run from half a symbol before one symbol boundary to half a
+    // symbol after the next, with the eye opening in the middle.
+    float const* counts() const { return m_counts.data(); }
+    float maxCount() const { return m_maxCount; }
+    double symbolPeriod() const { return m_symbolPeriod; }
+    double vBottom() const { return m_vBottom; }
+    double vTop() const { return m_vTop; }
+
+private:
+    bool estimateSymbolRate(QVector<double> const& volts, AsyncDFT& dft);
+    void resample(QVector<double> const& volts);
+    int recoverClock();
+    int fold(int first);
+
+    std::vector<float> m_counts = std::vector<float>(kRows * kColumns, 0.f);
+    float m_maxCount = 0;
+    double m_symbolPeriod = 0;  // Seconds
+    double m_vBottom = 0;
+    double m_vTop = 0;
+
+    // From the last update
+    double m_average = 0;
+    int m_samplesPerSymbol = 0; // After resampling
+    int m_symbols = 0;
+
+    // Scratch, kept between updates so they don't touch the heap
+    std::vector<char> m_binary;
+    QVector<double> m_edges;
+    QVector<double> m_edgeSpectrum;
+    std::vector<int> m_indices;
+    std::vector<double> m_fineX;
+    std::vector<double> m_fineY;
+    QVector<double> m_resampled;
+    std::vector<int> m_errors;
+    std::vector<float> m_errorAverage;
+};
+
+#endif // EYEHISTOGRAM_H
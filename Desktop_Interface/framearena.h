@@ -0,0 +1,38 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <vector>
+#include <QVector>
+
+// Scratch space for one pass through isoDriver's frame pipeline.
+// Everything is passed by reference into the read and convert stages,
+// which resize() rather than reconstruct.  Neither std::vector nor QVector
+// give capacity back when shrinking, so after the first few frames the
+// pipeline runs without touching the heap.
+// Only the processing thread uses it.
+struct frameArena
+{
+    // Raw samples from isoBuffer::readBuffer()/readLatest()
+    std::vector<short> raw_CH1;
+    std::vector<short> raw_CH2;
+
+    // Peak detect, from isoBuffer::readEnvelope()
+    std::vector<short> rawMin_CH1;
+    std::vector<short> rawMax_CH1;
+    std::vector<short> rawMin_CH2;
+    std::vector<short> rawMax_CH2;
+
+    // Intensity-graded persistence, from isoBuffer::readRaw()
+    std::vector<short> persistenceRaw;
+
+    // Converted samples, swapped into the RenderFrame when published
+    QVector<double> volts_CH1;
+    QVector<double> volts_CH2;
+    QVector<double> voltsMin_CH1;
+    QVector<double> voltsMax_CH1;
+    QVector<double> voltsMin_CH2;
+    QVector<double> voltsMax_CH2;
+    QVector<double> x;
+};
+
+#endif // FRAMEARENA_H
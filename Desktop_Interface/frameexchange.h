@@ -0,0 +1,109 @@
+#ifndef FRAMEEXCHANGE_H
+#define FRAMEEXCHANGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/** @file frameexchange.h
+ *  @brief Lock-free  containers  used  to hand data between the GUI
+ *  thread and the processing thread.
+ *
+ *  Both  containers  hand  out  references  to  slots  that  live for
+ *  the  lifetime  of  the container, so whatever capacity a slot grew
+ *  to  on  one  frame  is  still  there  on  the  next  one.
+ */
+
+// Bounded single-producer, single-consumer queue.
+// The producer fills writeSlot() and then calls push(); the consumer
+// reads readSlot() and then calls pop().  Neither side ever blocks.
+template<typename T, size_t N>
+class spscQueue
+{
+	static_assert(N >= 2, "spscQueue needs at least two slots");
+public:
+	// Returns nullptr if the queue is full.
+	T* writeSlot()
+	{
+		size_t const head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) == N)
+			return nullptr;
+		return &m_slots[head % N];
+	}
+
+	void push()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Returns nullptr if the queue is empty.
+	T* readSlot()
+	{
+		size_t const tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+			return nullptr;
+		return &m_slots[tail % N];
+	}
+
+	void pop()
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Only meaningful as a hint, the other side may be mid-operation.
+	size_t size() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T m_slots[N];
+	std::atomic<size_t> m_head{0};
+	std::atomic<size_t> m_tail{0};
+};
+
+// Triple buffer for publishing the latest state from one thread to another.
+// The writer always has a back slot to fill and never waits for the reader;
+// the reader always sees the most recently published slot, and frames it
+// was too slow to pick up are simply skipped.
+template<typename T>
+class tripleBuffer
+{
+public:
+	// Writer side
+	T& back()
+	{
+		return m_slots[m_back];
+	}
+
+	void publish()
+	{
+		m_back = m_shared.exchange(m_back | kFreshBit, std::memory_order_acq_rel) & kIndexMask;
+	}
+
+	// Reader side. Returns false if nothing new was published since the
+	// last call, in which case front() still refers to the previous slot.
+	bool update()
+	{
+		if (!(m_shared.load(std::memory_order_relaxed) & kFreshBit))
+			return false;
+		m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & kIndexMask;
+		return true;
+	}
+
+	T const& front() const
+	{
+		return m_slots[m_front];
+	}
+
+private:
+	static constexpr uint8_t kIndexMask = 0x03;
+	static constexpr uint8_t kFreshBit = 0x04;
+
+	T m_slots[3];
+	uint8_t m_back = 0;
+	uint8_t m_front = 1;
+	std::atomic<uint8_t> m_shared{2};
+};
+
+#endif // FRAMEEXCHANGE_H
@@ -0,0 +1,86 @@
+#include "framegovernor.h"
+#include "desktop_settings.h"
+#include "genericusbdriver.h"
+#include <QDebug>
+#include <algorithm>
+
+namespace
+{
+constexpr int kSpectrumCadence = 4;
+constexpr qint64 kMeasurePeriodMs = 1000;
+
+struct governorLevel
+{
+    int displayStride;
+    int graphSamplesShift; // GRAPH_SAMPLES >> this
+    int spectrumCadence;
+    int decoderStride;
+};
+
+// Full quality first.  Display stride is in frames from the device, which
+// arrive every ISO_PACKETS_PER_CTX ms, so 1, 2, 3, 4, 6, 12 is about
+// 60, 30, 20, 15, 10 and 5 FPS where that is 17.
+constexpr governorLevel kLevels[] = {
+    {1, 0, kSpectrumCadence, 1},
+    {2, 0, kSpectrumCadence, 1},
+    {3, 0, kSpectrumCadence, 2},
+    {4, 1, 6, 2},
+    {6, 1, 8, 4},
+    {12, 2, 8, 4},
+};
+constexpr int kLevelCount = sizeof(kLevels) / sizeof(kLevels[0]);
+}
+
+frameGovernor::frameGovernor()
+{
+    reset();
+}
+
+void frameGovernor::reset()
+{
+    m_level = 0;
+    m_busyNs = 0;
+    m_clock.start();
+}
+
+bool frameGovernor::frameDone(qint64 processingNs, qint64 renderNs)
+{
+    m_busyNs += processingNs + renderNs;
+    qint64 const elapsedNs = m_clock.nsecsElapsed();
+    if (elapsedNs < kMeasurePeriodMs * 1000000)
+        return false;
+
+    double const load = double(m_busyNs) / elapsedNs;
+    m_busyNs = 0;
+    m_clock.restart();
+
+    int level = m_level;
+    if (load > kCpuBudget && level < kLevelCount - 1) {
+        level++;
+    } else if (level > 0) {
+        // Most of the work is per drawn frame, so going back up costs about
+        // the ratio of the strides.  Leave some headroom so it doesn't oscillate.
+        double const predicted = load * kLevels[level].displayStride / kLevels[level - 1].displayStride;
+        if (predicted < kCpuBudget * 0.75)
+            level--;
+    }
+
+    if (level == m_level)
+        return false;
+
+    qDebug() << "Frame governor: load" << load << "of one core, moving to level" << level;
+    m_level = level;
+    return true;
+}
+
+frameBudget frameGovernor::budget() const
+{
+    governorLevel const& level = kLevels[m_level];
+    return {level.displayStride, GRAPH_SAMPLES >> level.graphSamplesShift, level.spectrumCadence, level.decoderStride};
+}
+
+frameBudget frameGovernor::fixedBudget(int timerPeriod)
+{
+    int const stride = std::max(1, (timerPeriod + ISO_PACKETS_PER_CTX / 2) / ISO_PACKETS_PER_CTX);
+    return {stride, GRAPH_SAMPLES, kSpectrumCadence, 1};
+}
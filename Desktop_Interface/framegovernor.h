@@ -0,0 +1,44 @@
+#ifndef FRAMEGOVERNOR_H
+#define FRAMEGOVERNOR_H
+
+#include <QElapsedTimer>
+
+// How much work each frame from the device gets.  Samples are always
+// written to the buffers; these only scale what is done with them.
+struct frameBudget
+{
+    int displayStride;   // Draw every Nth frame
+    int graphSamples;    // Points per trace
+    int spectrumCadence; // Eye diagram on every Nth drawn frame
+    int decoderStride;   // Serial and I2C decoders on every Nth frame, catching up in one batch
+};
+
+// Automatic frame rate.  Measures how long the processing thread and the
+// replot take, and steps the budget down (or back up) so that together they
+// stay under kCpuBudget of one core.  Lives on the GUI thread.
+class frameGovernor
+{
+public:
+    static constexpr double kCpuBudget = 0.5;
+
+    frameGovernor();
+
+    // Back to full quality
+    void reset();
+
+    // Called after each replot, with the processing thread's time since the
+    // last call.  Returns true when budget() has changed.
+    bool frameDone(qint64 processingNs, qint64 renderNs);
+
+    frameBudget budget() const;
+
+    // What the frame rate menu's fixed rates mean in the same terms
+    static frameBudget fixedBudget(int timerPeriod);
+
+private:
+    int m_level = 0;
+    QElapsedTimer m_clock;
+    qint64 m_busyNs = 0;
+};
+
+#endif // FRAMEGOVERNOR_H
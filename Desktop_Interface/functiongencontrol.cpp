@@ -7,6 +7,28 @@
 
 namespace functionGen {
 
+TimerSetting timerSetting(int length, double freq)
+{
+	TimerSetting setting;
+
+	//Need to increase size of wave if its freq too high, or too low!
+	while ((length >> setting.shift) * freq > DAC_SPS)
+		setting.shift++;
+	setting.length = length >> setting.shift;
+
+	static const int validClockDivs[7] = {1, 2, 4, 8, 64, 256, 1024};
+	for (int i = 0; i < 7; ++i)
+	{
+		setting.clockDivision = validClockDivs[i];
+		// +1 to change from [0:n) to [1:n]
+		setting.clkSetting = i + 1;
+		setting.period = CLOCK_FREQ / (setting.clockDivision * setting.length * freq) - 0.5;
+		if (setting.period < 65535)
+			break;
+	}
+	return setting;
+}
+
 ChannelData const& SingleChannelController::getData() const {
 	return m_data;
 }
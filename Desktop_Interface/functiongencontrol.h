@@ -29,6 +29,22 @@ struct ChannelData
 	double dutyCycle = 50;
 };
 
+// How genericUsbDriver::sendFunctionGenData() sets up the DAC timer to play
+// length samples at freq.  The timer counts whole clock ticks, so the
+// frequency that actually comes out is only close to freq.
+struct TimerSetting
+{
+	int shift = 0;          // Every 2^shift'th sample is played, to stay under DAC_SPS
+	int length = 0;         // Samples played per cycle
+	int clockDivision = 1;
+	int clkSetting = 1;     // Index of clockDivision, from 1
+	int period = 0;         // Timer top; each sample lasts period + 1 ticks
+
+	double frequency() const { return CLOCK_FREQ / (double(clockDivision) * length * (period + 1)); }
+};
+
+TimerSetting timerSetting(int length, double freq);
+
 class SingleChannelController : public QObject
 {
 	Q_OBJECT
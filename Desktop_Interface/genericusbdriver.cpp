@@ -198,44 +198,26 @@ void genericUsbDriver::sendFunctionGenData(functionGen::ChannelID channelID)
 	               channelData.samples.begin(), // transform in place
 	               applyAmplitudeAndOffset);
 
+	functionGen::TimerSetting const timer = functionGen::timerSetting(channelData.samples.size(), channelData.freq);
+
     //Need to increase size of wave if its freq too high, or too low!
+	if (timer.shift != 0)
 	{
-		int shift = 0;
-		int newLength = channelData.samples.size();
-
-		while ((newLength >> shift) * channelData.freq > DAC_SPS)
-			shift++;
+		channelData.divisibility -= timer.shift;
 
-		if (shift != 0)
-		{
-			channelData.divisibility -= shift;
-			newLength >>= shift;
+		for (int i = 0; i < timer.length; ++i)
+			channelData.samples[i] = channelData.samples[i << timer.shift];
 
-			for (int i = 0; i < newLength; ++i)
-				channelData.samples[i] = channelData.samples[i << shift];
+		channelData.samples.resize(timer.length);
+		channelData.samples.shrink_to_fit();
 
-			channelData.samples.resize(newLength);
-			channelData.samples.shrink_to_fit();
-
-			if (channelData.divisibility <= 0)
-				qDebug("genericUsbDriver::setFunctionGen: channel divisibility <= 0 after T-stretching");
-		}
+		if (channelData.divisibility <= 0)
+			qDebug("genericUsbDriver::setFunctionGen: channel divisibility <= 0 after T-stretching");
 	}
 
     // Timer Setup
-    int validClockDivs[7] = {1, 2, 4, 8, 64, 256, 1024};
-	auto period = [&](int division) -> int
-	{
-		return CLOCK_FREQ / (division * channelData.samples.size() * channelData.freq) - 0.5;
-	};
-
-	int* clkSettingIt = std::find_if(std::begin(validClockDivs), std::end(validClockDivs),
-	                                 [&](int division) -> bool { return period(division) < 65535; });
-
-    int timerPeriod = period(*clkSettingIt);
-
-	// +1 to change from [0:n) to [1:n]
-    int clkSetting = std::distance(std::begin(validClockDivs), clkSettingIt) + 1;
+    int timerPeriod = timer.period;
+    int clkSetting = timer.clkSetting;
 
     if(deviceMode == 5)
         qDebug("DEVICE IS IN MODE 5");
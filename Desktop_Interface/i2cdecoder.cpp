@@ -2,6 +2,39 @@
 
 using namespace i2c;
 
+namespace
+{
+// Index of the lowest set bit of x, which must not be 0, by de Bruijn
+// multiplication: x & -x times the sequence puts a different pattern in
+// the top six bits for each bit.
+constexpr uint64_t kDeBruijn = 0x03f79d71b4cb0a89ull;
+
+struct lowestBitTable
+{
+    uint8_t bit[64] = {};
+    constexpr lowestBitTable()
+    {
+        for (int i = 0; i < 64; ++i)
+            bit[((uint64_t(1) << i) * kDeBruijn) >> 58] = i;
+    }
+};
+constexpr lowestBitTable kLowestBit;
+
+int lowestSetBit(uint64_t x)
+{
+    return kLowestBit.bit[((x & (~x + 1)) * kDeBruijn) >> 58];
+}
+
+// The 64 samples held by the 8 shorts from element on, earliest in bit 0
+uint64_t sampleWord(short const* buffer, int element)
+{
+    uint64_t word = 0;
+    for (int i = 0; i < 8; ++i)
+        word |= uint64_t(uint8_t(buffer[element + i])) << (8 * i);
+    return word;
+}
+}
+
 i2cDecoder::i2cDecoder(isoBuffer* sda_in, isoBuffer* scl_in, QPlainTextEdit* console_in)
     : QObject(nullptr)
     , sda(sda_in)
@@ -25,8 +58,6 @@ i2cDecoder::~i2cDecoder()
 
 void i2cDecoder::reset()
 {
-    qDebug () << "Resetting I2C";
-
     if (sda->m_back != scl->m_back)
     {
         // Perhaps the data could be saved, but just resetting them seems much safer
@@ -34,52 +65,87 @@ void i2cDecoder::reset()
         scl->clearBuffer();
     }
 
-    serialPtr_bit = sda->m_back * 8;
+    restart(sda->m_back);
+    epoch = sda->m_epoch;
+}
 
+void i2cDecoder::restart(uint32_t back)
+{
+    serialPtr_bit = back * 8;
+    state = transmissionState::unknown;
+    currentBitIndex = 0;
+    currentBitStream = 0x0000;
+}
+
+
+uint64_t i2cDecoder::run(isoBufferPosition const& position)
+{
+    // The buffers were cleared since the last call, so everything before
+    // index 0 is stale.  Drop the transmission in progress and decode from there.
+    if (epoch != position.epoch)
     {
-        std::lock_guard<std::mutex> lock(mutex);
+        restart(0);
+        epoch = position.epoch;
+    }
+    else if (lostSamples)
+    {
+        restart(position.back);
+        serialSample = position.sampleCount * 8;
+        push(decoderRecord::Kind::SamplesLost);
+        lostSamples = false;
+    }
+
+    uint64_t const bufferBits = sda->m_bufferLen * 8;
+    int64_t const distance = serialDistance(position.back);
+    int64_t available = distance - int64_t(SERIAL_DELAY * sda->m_sampleRate_bit);
+    serialSample = position.sampleCount * 8 - distance;
+    uint64_t const oldest = serialSample / 8;
 
-        serialBuffer->clear();
+    // The buffers are stored twice over, so a word never needs to wrap
+    while (available >= 64)
+    {
+        int const element = int(serialPtr_bit / 8);
+        uint64_t const sdaWord = sampleWord(sda->m_buffer, element);
+        uint64_t const sclWord = sampleWord(scl->m_buffer, element);
+        // Each sample's predecessor, the last of the previous word first
+        uint64_t const sdaPrevious = sdaWord << 1 | (currentSdaValue ? 1 : 0);
+        uint64_t const sclPrevious = sclWord << 1 | (currentSclValue ? 1 : 0);
+
+        uint64_t const wordStart = serialPtr_bit;
+        uint64_t const wordSample = serialSample;
+        for (uint64_t changes = (sdaWord ^ sdaPrevious) | (sclWord ^ sclPrevious); changes; changes &= changes - 1)
+        {
+            int const bit = lowestSetBit(changes);
+            previousSdaValue = (sdaPrevious >> bit) & 1;
+            currentSdaValue = (sdaWord >> bit) & 1;
+            previousSclValue = (sclPrevious >> bit) & 1;
+            currentSclValue = (sclWord >> bit) & 1;
+            serialPtr_bit = wordStart + bit;
+            serialSample = wordSample + bit;
+            runStateMachine();
+        }
+
+        currentSdaValue = sdaWord >> 63;
+        currentSclValue = sclWord >> 63;
+        serialPtr_bit = wordStart + 64;
+        serialSample = wordSample + 64;
+        if (serialPtr_bit >= bufferBits)
+            serialPtr_bit -= bufferBits;
+        available -= 64;
     }
+    return oldest;
 }
 
-
-void i2cDecoder::run()
+int i2cDecoder::serialDistance(uint32_t back) const
 {
-//    qDebug() << "i2cDecoder::run()";
-    while (serialDistance(sda) > SERIAL_DELAY * sda->m_sampleRate_bit)
-	{
-		updateBitValues();
-		runStateMachine();
-		serialPtr_bit ++;
-        if (serialPtr_bit >= (sda->m_bufferLen * 8))
-            serialPtr_bit -= (sda->m_bufferLen * 8);
-	}	
-} 
-
-int i2cDecoder::serialDistance(isoBuffer* buffer)
-{
-    int back_bit = buffer->m_back * 8;
-    int bufferEnd_bit = buffer->m_bufferLen * 8;
+    int back_bit = back * 8;
+    int bufferEnd_bit = sda->m_bufferLen * 8;
     if (back_bit >= serialPtr_bit)
         return back_bit - serialPtr_bit;
     else
 		return bufferEnd_bit - serialPtr_bit + back_bit;
 }
 
-void i2cDecoder::updateBitValues(){
-    previousSdaValue = currentSdaValue;
-    previousSclValue = currentSclValue;
-
-    int coord_byte = serialPtr_bit/8;
-    int coord_bit = serialPtr_bit - (8*coord_byte);
-    unsigned char dataByteSda = sda->m_buffer[coord_byte];
-    unsigned char dataByteScl = scl->m_buffer[coord_byte];
-    unsigned char mask = (0x01 << coord_bit);
-    currentSdaValue = dataByteSda & mask;
-	currentSclValue = dataByteScl & mask;
-}
-
 void i2cDecoder::runStateMachine()
 {
     edge sdaEdge = edgeDetection(currentSdaValue, previousSdaValue);
@@ -87,11 +153,11 @@ void i2cDecoder::runStateMachine()
 
 	if ((sdaEdge == edge::rising) && (sclEdge == edge::falling)) // INVALID STATE TRANSITION
 	{
+        // Wait for the next start condition
         state = transmissionState::unknown;
-        qDebug() << "Dumping I2C state and aborting...";
-        for (int i=31; i>=0; i--)
-            qDebug("%02x\t%02x", sda->m_buffer[serialPtr_bit/8 - i] & 0xFF, scl->m_buffer[serialPtr_bit/8 - i] & 0xFF);
-        throw std::runtime_error("unknown i2c transmission state");
+        currentBitIndex = 0;
+        currentBitStream = 0x0000;
+        push(decoderRecord::Kind::I2cError);
         return;
 	}
 
@@ -146,19 +212,8 @@ void i2cDecoder::decodeAddress(edge sdaEdge, edge sclEdge)
 
     if (currentBitIndex == addressBitStreamLength)
     {
-        qDebug() << "Finished Address Decode";
-        if (currentBitStream & 0b0000000000000010)
-            serialBuffer->insert("READ:  ");
-        else
-            serialBuffer->insert("WRITE: ");
-
-        serialBuffer->insert_hex((uint8_t)((currentBitStream & 0b0000000111111100) >> 2));
-        serialBuffer->insert(' ');
-
-        if (currentBitStream & 0b0000000000000001)
-            serialBuffer->insert("(NACK)");
-
-        consoleStateInvalid = true;
+        push(decoderRecord::Kind::I2cAddress, (uint8_t)((currentBitStream & 0b0000000111111100) >> 2),
+             currentBitStream & 0b0000000000000010, currentBitStream & 0b0000000000000001);
 
         // Prepare for next bit
         currentBitIndex = 0;
@@ -179,15 +234,8 @@ void i2cDecoder::decodeData(edge sdaEdge, edge sclEdge)
 
     if (currentBitIndex == dataBitStreamLength)
     {
-        qDebug() << "Finished Data byte Decode";
-
-        serialBuffer->insert_hex((uint8_t)((currentBitStream & 0b0000000111111110) >> 1));
-        serialBuffer->insert(' ');
-
-        if (currentBitStream & 0b0000000000000001)
-            serialBuffer->insert("(NACK)");
-
-        consoleStateInvalid = true;
+        push(decoderRecord::Kind::I2cData, (uint8_t)((currentBitStream & 0b0000000111111110) >> 1),
+             false, currentBitStream & 0b0000000000000001);
 
         // Prepare for next bit
         currentBitIndex = 0;
@@ -200,26 +248,62 @@ void i2cDecoder::startCondition()
 	currentBitIndex = 0;
     currentBitStream = 0x0000;
 	state = transmissionState::address;	
-    qDebug() << "I2C START";
+    push(decoderRecord::Kind::I2cStart);
 }
 
 void i2cDecoder::stopCondition()
 {
     state = transmissionState::idle;
-    serialBuffer->insert('\n');
-    qDebug() << "I2C STOP";
+    push(decoderRecord::Kind::I2cStop);
+}
+
+void i2cDecoder::push(decoderRecord::Kind kind, uint8_t value, bool read, bool nack)
+{
+    decoderRecord record;
+    record.sample = serialSample;
+    record.kind = kind;
+    record.value = value;
+    record.read = read;
+    record.nack = nack;
+    records.push(record);
 }
 
 void i2cDecoder::updateConsole(){
-    std::lock_guard<std::mutex> lock(mutex);
-    if (!consoleStateInvalid)
+    int const count = records.drain([this](decoderRecord const& record) {
+        recordLog.add(record);
+        switch (record.kind)
+        {
+        case decoderRecord::Kind::I2cAddress:
+            serialBuffer->insert(record.read ? "READ:  " : "WRITE: ");
+            serialBuffer->insert_hex(record.value);
+            serialBuffer->insert(' ');
+            if (record.nack)
+                serialBuffer->insert("(NACK)");
+            break;
+        case decoderRecord::Kind::I2cData:
+            serialBuffer->insert_hex(record.value);
+            serialBuffer->insert(' ');
+            if (record.nack)
+                serialBuffer->insert("(NACK)");
+            break;
+        case decoderRecord::Kind::I2cStop:
+            serialBuffer->insert('\n');
+            break;
+        case decoderRecord::Kind::I2cError:
+            serialBuffer->insert("\n<ERROR: SCL fell as SDA rose; waiting for the next start>\n");
+            break;
+        case decoderRecord::Kind::SamplesLost:
+            serialBuffer->insert("\n<Samples lost: decoding fell behind, so what came just before may be garbled>\n");
+            break;
+        default:
+            break;
+        }
+    });
+    uint32_t const dropped = records.takeDropped();
+    if (dropped)
+        serialBuffer->insert(QString("\n<%1 events lost: console too slow>\n").arg(dropped).toStdString());
+    if (!count && !dropped)
         return;
 
-    console->setPlainText(QString::fromLocal8Bit(serialBuffer->begin(), serialBuffer->size()));
-    if(sda->m_serialAutoScroll){
-        QTextCursor c =  console->textCursor();
-        c.movePosition(QTextCursor::End);
-        console->setTextCursor(c);
-    }
-    consoleStateInvalid = false;
+    appendToConsole(console, *serialBuffer, sda->m_serialAutoScroll);
 }
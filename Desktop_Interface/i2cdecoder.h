@@ -3,10 +3,10 @@
 
 #include "isobuffer.h"
 #include "isobufferbuffer.h"
+#include "decoderrecord.h"
 
 #include <QObject>
 #include <QTimer>
-#include <mutex>
 
 namespace i2c
 {
@@ -42,8 +42,11 @@ public:
 	isoBuffer* scl;
     QPlainTextEdit* console;
     isoBufferBuffer* serialBuffer = nullptr;
-    std::mutex mutex;
     QTimer *updateTimer;
+    // From run() on the decoder worker to updateConsole() on the GUI thread
+    decoderRecordRing records;
+    // What the console has shown, for export.  GUI thread only.
+    decoderRecordLog recordLog;
 
 	// State vars
 	uint8_t currentSdaValue = 0;
@@ -51,24 +54,40 @@ public:
 	uint8_t currentSclValue = 0;
 	uint8_t previousSclValue = 0;
     uint64_t serialPtr_bit = 0;
+    // Buffer epoch serialPtr_bit refers to. See isoBuffer::clearBuffer.
+    uint32_t epoch = 0;
 	transmissionState state = transmissionState::unknown;
-    bool consoleStateInvalid;
+    uint64_t serialSample = 0; // Absolute sample of serialPtr_bit, for records
 
 	// Data Transmission
 	uint8_t currentBitIndex = 0;
     uint16_t currentBitStream;
 
 	// Member functions
-	void updateBitValues();
 	void runStateMachine();
-    void run(); 
-    int serialDistance(isoBuffer* buffer);
+    // Decodes everything up to SERIAL_DELAY behind the newest sample.
+    // Both lines are read 64 samples at a time; where neither changes the
+    // state machine has nothing to do, so it only runs at their edges.
+    // serialPtr_bit stays a multiple of 8, a whole short of the buffer.
+    // Returns the earliest sample it read, to check it wasn't written over
+    // meanwhile.
+    uint64_t run(isoBufferPosition const& position);
+    // What was last decoded may have been written over as it was read, so
+    // the next run() starts again from its position
+    void samplesLost() { lostSamples = true; }
+    bool lostSamples = false;
+    int serialDistance(uint32_t back) const;
 	edge edgeDetection(uint8_t current, uint8_t prev);
 	void decodeAddress(edge sdaEdge, edge sclEdge);
 	void decodeData(edge sdaEdge, edge sclEdge);
 	void startCondition();
 	void stopCondition();
+    void push(decoderRecord::Kind kind, uint8_t value = 0, bool read = false, bool nack = false);
+    // Realigns the buffers if need be, then restarts.  Only while the
+    // decoder worker is idle.
     void reset();
+    // Starts again from back, forgetting any transmission in progress
+    void restart(uint32_t back);
 signals:
 public slots:
     void updateConsole();
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cinttypes>
+#include <climits>
 #include <iostream>
 
 #include "isodriver.h"
@@ -29,35 +30,41 @@ constexpr auto kTopMultimeter = 2048;
 constexpr double kTriggerSensitivityMultiplier = 4;
 }
 
-#ifndef DISABLE_SPECTRUM
-isoBuffer::isoBuffer(QWidget* parent, int bufferLen, int windowLen, isoDriver* caller, unsigned char channel_value)
-#else
 isoBuffer::isoBuffer(QWidget* parent, int bufferLen, isoDriver* caller, unsigned char channel_value)
-#endif
     : QWidget(parent)
     , m_channel(channel_value)
     , m_bufferPtr(std::make_unique<short[]>(bufferLen*2))
     , m_bufferLen(bufferLen)
-#ifndef DISABLE_SPECTRUM
-    , m_window_capacity(windowLen)
-#endif
+    , m_segments((bufferLen + kBufferSegmentLength - 1) / kBufferSegmentLength)
     , m_samplesPerSecond(bufferLen/21.0/375*VALID_DATA_PER_375)
     , m_sampleRate_bit(bufferLen/21.0/375*VALID_DATA_PER_375*8)
     , m_virtualParent(caller)
 {
     m_buffer = m_bufferPtr.get();
-#ifndef DISABLE_SPECTRUM
-    m_window.reserve(m_window_capacity);
-    m_window_iter = m_window.begin();
-#endif
+    for (int level = 0; level < kEnvelopeLevels; level++)
+        m_envelope[level].resize(m_bufferLen >> (kEnvelopeLevelShift * (level + 1)));
 }
 
 void isoBuffer::insertIntoBuffer(short item)
 {
+    // Entering a new segment, so stamp it with the current epoch and gain,
+    // keeping the old stamp for the part not yet written over
+    if ((m_back & (kBufferSegmentLength - 1)) == 0)
+    {
+        BufferSegment& segment = m_segments[m_back / kBufferSegmentLength];
+        segment = {m_epoch, m_gainLog, segment.epoch, segment.gainLog};
+    }
+
     m_buffer[m_back] = item;
     m_buffer[m_back+m_bufferLen] = item;
     m_back++;
     m_insertedCount++;
+    m_sampleCount++;
+
+    if ((m_back & ((1u << kEnvelopeLevelShift) - 1)) == 0)
+    {
+        summariseBlocks(m_back);
+    }
 
     if (m_insertedCount > m_bufferLen)
     {
@@ -69,71 +76,144 @@ void isoBuffer::insertIntoBuffer(short item)
         m_back = 0;
     }
 
-#ifndef DISABLE_SPECTRUM
-    /* Fill-in time domain window */
-    if (m_window.size() < m_window_capacity) {
-        m_window.push_back(item);
-    } else {
-        *m_window_iter++ = item;
-        if (m_window_iter == m_window.end()) {
-            m_window_iter = m_window.begin();
-        }
-    }
+    checkTriggered();
+}
+
+short isoBuffer::bufferAt(uint32_t idx) const
+{
+    if (idx > m_insertedCount)
+        qFatal("isoBuffer::bufferAt: invalid query, idx = %" PRIu32 ", m_insertedCount = %" PRIu32, idx, m_insertedCount);
 
-    /* Fill-in freqResp buffer */
-    if(m_freqRespActive)
+    uint32_t slot = (m_back-1) + m_bufferLen - idx;
+    return adjustedSample(m_buffer[slot], slot % m_bufferLen);
+}
+
+// What a raw value stored at slot (or a min/max of a block starting there) reads as now
+short isoBuffer::adjustedSample(short sample, uint32_t slot) const
+{
+    BufferSegment const& segment = m_segments[slot / kBufferSegmentLength];
+    // From m_back on, the segment being filled is still the previous lap
+    bool const tail = (m_back & (kBufferSegmentLength - 1)) != 0
+                      && slot >= m_back && (slot ^ m_back) < kBufferSegmentLength;
+    if ((tail ? segment.tailEpoch : segment.epoch) != m_epoch)
+        return 0;
+
+    // Apply any gain changes made since this segment was written
+    int shift = m_gainLog - (tail ? segment.tailGainLog : segment.gainLog);
+    if (shift > 0)
+        return sample >> shift;
+    else if (shift < 0)
+        return sample << -shift;
+    return sample;
+}
+
+// Called when end (one past the newest sample) lands on a block boundary.
+// Each level is built from the 16 blocks below it, so this costs about one
+// comparison per sample on average.
+void isoBuffer::summariseBlocks(uint32_t end)
+{
+    for (int level = 0; level < kEnvelopeLevels; level++)
     {
-        if (freqResp_count >= freqResp_samples)
+        uint32_t const shift = kEnvelopeLevelShift * (level + 1);
+        if (end & ((1u << shift) - 1))
+            return;
+
+        uint32_t const start = end - (1u << shift);
+        SampleRange range = {SHRT_MAX, SHRT_MIN};
+        if (level == 0)
         {
-            /* Shift freqResp buffer once by removing first element and adding an element to the end */
-            freqResp_buffer.pop_front();
-            freqResp_buffer.push_back(item);
-            freqResp_count = freqResp_samples;
+            for (uint32_t i = start; i < end; i++)
+            {
+                range.min = std::min(range.min, m_buffer[i]);
+                range.max = std::max(range.max, m_buffer[i]);
+            }
         }
         else
         {
-            freqResp_buffer.push_back(item);
+            uint32_t const childShift = shift - kEnvelopeLevelShift;
+            for (uint32_t i = start >> childShift; i < end >> childShift; i++)
+            {
+                range.min = std::min(range.min, m_envelope[level-1][i].min);
+                range.max = std::max(range.max, m_envelope[level-1][i].max);
+            }
         }
-        /* Update number of freqResp samples */
-        freqResp_count++;
+        m_envelope[level][start >> shift] = range;
     }
-#endif
-
-    checkTriggered();
 }
 
-short isoBuffer::bufferAt(uint32_t idx) const
+// Min and max of slots [first, last), which must not wrap.  Takes the
+// largest summarised block that fits at each step and reads single samples
+// only at the ragged ends.  The block holding m_back is half new data and
+// half old, and its summary is of neither, so that one is read sample by sample.
+void isoBuffer::envelopeOfSlots(uint32_t first, uint32_t last, SampleRange& range) const
 {
-    if (idx > m_insertedCount)
-        qFatal("isoBuffer::bufferAt: invalid query, idx = %" PRIu32 ", m_insertedCount = %" PRIu32, idx, m_insertedCount);
+    uint32_t i = first;
+    while (i < last)
+    {
+        int level = kEnvelopeLevels - 1;
+        for (; level >= 0; level--)
+        {
+            uint32_t const size = 1u << (kEnvelopeLevelShift * (level + 1));
+            bool const straddlesBack = i < m_back && m_back < i + size;
+            if ((i & (size - 1)) == 0 && i + size <= last && !straddlesBack)
+                break;
+        }
+
+        if (level < 0)
+        {
+            short const sample = adjustedSample(m_buffer[i], i);
+            range.min = std::min(range.min, sample);
+            range.max = std::max(range.max, sample);
+            i++;
+            continue;
+        }
 
-    return m_buffer[(m_back-1) + m_bufferLen - idx];
+        // Gain shifts are monotonic, so a block's adjusted min and max are still its min and max
+        uint32_t const shift = kEnvelopeLevelShift * (level + 1);
+        SampleRange const& block = m_envelope[level][i >> shift];
+        range.min = std::min(range.min, adjustedSample(block.min, i));
+        range.max = std::max(range.max, adjustedSample(block.max, i));
+        i += 1u << shift;
+    }
 }
 
 template<typename T, typename Function>
 void isoBuffer::writeBuffer(T* data, int len, int TOP, Function transform)
 {
+    // Announce what is about to be written over before writing over it
+    m_writeCount.store(m_sampleCount + len, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
     for (int i = 0; i < len; ++i)
     {
         insertIntoBuffer(transform(data[i]));
     }
 
     // Output to CSV
+    std::lock_guard<std::mutex> lock(m_fileIOMutex);
     if (m_fileIOEnabled)
     {
-        bool isUsingAC = m_channel == 1
-                         ? m_virtualParent->AC_CH1
-                         : m_virtualParent->AC_CH2;
+        bool isUsingAC = m_virtualParent->acCoupled(m_channel);
+        conversionTable const& conversion = m_virtualParent->sampleConversion(m_channel, TOP);
+        double const acOffset = isUsingAC ? m_virtualParent->currentVmean : 0;
 
         for (int i = 0; i < len && m_fileIOEnabled; i++)
         {
-            double convertedSample = sampleConvert(data[i], TOP, isUsingAC);
+            double convertedSample = conversion.toVolts(data[i]) - acOffset;
 
             maybeOutputSampleToFile(convertedSample);
         }
     }
 }
 
+bool isoBuffer::overwritten(uint64_t sample) const
+{
+    // Pairs with the fence in writeBuffer: if anything read before this
+    // was a sample being written over, the count covering it shows here.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_writeCount.load(std::memory_order_relaxed) >= sample + m_bufferLen;
+}
+
 void isoBuffer::writeBuffer_char(char* data, int len)
 {
     writeBuffer(data, len, 128, [](char item) -> short {return item;});
@@ -144,7 +224,7 @@ void isoBuffer::writeBuffer_short(short* data, int len)
     writeBuffer(data, len, 2048, [](short item) -> short {return item >> 4;});
 }
 
-std::vector<short> isoBuffer::readBuffer(double sampleWindow, int numSamples, bool singleBit, double delayOffset)
+void isoBuffer::readBuffer(std::vector<short>& readData, double sampleWindow, int numSamples, bool singleBit, double delayOffset, int64_t* sum) const
 {
     /*
      * The expected behavior is to run backwards over the buffer with a stride
@@ -160,10 +240,12 @@ std::vector<short> isoBuffer::readBuffer(double sampleWindow, int numSamples, bo
     const double timeBetweenSamples = sampleWindow * m_samplesPerSecond / numSamples;
     const int delaySamples = delayOffset * m_samplesPerSecond;
 
-    auto readData = std::vector<short>(numSamples, short(0));
+    // assign() keeps whatever capacity the caller's vector already has
+    readData.assign(numSamples, short(0));
 
     double itr = delaySamples, itr_lb, itr_ub;
     short data_lb, data_ub;
+    int64_t total = 0;
     for (int i = 0; i < numSamples && itr < m_insertedCount; i++)
     {
         assert(int(itr) >= 0);
@@ -178,65 +260,144 @@ std::vector<short> isoBuffer::readBuffer(double sampleWindow, int numSamples, bo
             int subIdx = 8*(-itr-floor(-itr));
             readData[i] = data_lb & (1 << subIdx);
         }
+        total += readData[i];
 
         itr += timeBetweenSamples;
     }
+    if (sum)
+        *sum = total;
+}
 
-    return readData;
+// Peak detect counterpart of readBuffer().  Element i is the min and max of
+// every sample from where readBuffer() takes sample i up to where it takes
+// sample i+1, so no sample is skipped however long the window is.
+void isoBuffer::readEnvelope(std::vector<short>& minData, std::vector<short>& maxData, double sampleWindow, int numSamples, double delayOffset) const
+{
+    const double samplesPerBucket = sampleWindow * m_samplesPerSecond / numSamples;
+    const int delaySamples = delayOffset * m_samplesPerSecond;
+
+    minData.assign(numSamples, short(0));
+    maxData.assign(numSamples, short(0));
+
+    for (int i = 0; i < numSamples; i++)
+    {
+        // Buckets run backwards in time from the newest sample, at idx 0
+        uint32_t begin = uint32_t(delaySamples + i * samplesPerBucket);
+        uint32_t end = std::max(uint32_t(delaySamples + (i + 1) * samplesPerBucket), begin + 1);
+        end = std::min(end, m_insertedCount);
+        if (begin >= end)
+            break;
+
+        // The bucket runs forward from the slot of its oldest sample
+        uint32_t const count = end - begin;
+        uint32_t const first = (m_back + m_bufferLen - end) % m_bufferLen;
+
+        SampleRange range = {SHRT_MAX, SHRT_MIN};
+        if (first + count <= m_bufferLen)
+        {
+            envelopeOfSlots(first, first + count, range);
+        }
+        else
+        {
+            envelopeOfSlots(first, m_bufferLen, range);
+            envelopeOfSlots(0, first + count - m_bufferLen, range);
+        }
+        minData[i] = range.min;
+        maxData[i] = range.max;
+    }
 }
 
-#ifndef DISABLE_SPECTRUM
-std::vector<short> isoBuffer::readWindow()
+// Every raw sample in the window, newest first, with no interpolation.
+// Windows longer than maxSamples are read with a stride to keep within it.
+// Returns how many samples the whole window holds at that stride; readData
+// stops short of that where the buffer doesn't go back far enough.
+uint32_t isoBuffer::readRaw(std::vector<short>& readData, double sampleWindow, double delayOffset, uint32_t maxSamples) const
 {
-    std::vector<short> readData(m_window.size());
-    std::copy(m_window.begin(), m_window_iter, std::copy(m_window_iter, m_window.end(), readData.begin()));
-    return readData;
+    const uint32_t delaySamples = delayOffset * m_samplesPerSecond;
+    const uint32_t windowSamples = sampleWindow * m_samplesPerSecond;
+    if (windowSamples == 0 || maxSamples == 0)
+    {
+        readData.clear();
+        return 0;
+    }
+
+    const uint32_t stride = (windowSamples + maxSamples - 1) / maxSamples;
+    const uint32_t windowLength = windowSamples / stride;
+    const uint32_t available = delaySamples < m_insertedCount ? (m_insertedCount - delaySamples + stride - 1) / stride : 0;
+
+    readData.resize(std::min(windowLength, available));
+    for (uint32_t i = 0; i < readData.size(); i++)
+        readData[i] = bufferAt(delaySamples + i * stride);
+    return windowLength;
 }
-#endif
 
-void isoBuffer::clearBuffer()
+// The newest numSamples samples, oldest first, as bufferAt() reads them.
+// Returns how many there were, which is fewer if the buffer hasn't filled yet.
+uint32_t isoBuffer::readLatest(short* readData, uint32_t numSamples, int64_t* sum) const
 {
-    for (uint32_t i = 0; i < m_bufferLen; i++)
+    uint32_t const count = std::min(numSamples, m_insertedCount);
+    // The buffer is stored twice over, so this never runs off the end
+    uint32_t slot = m_back + m_bufferLen - count;
+    int64_t total = 0;
+    for (uint32_t i = 0; i < count; i++, slot++)
     {
-        m_buffer[i] = 0;
-        m_buffer[i + m_bufferLen] = 0;
+        readData[i] = adjustedSample(m_buffer[slot], slot < m_bufferLen ? slot : slot - m_bufferLen);
+        total += readData[i];
     }
+    if (sum)
+        *sum = total;
+    return count;
+}
+
+void isoBuffer::clearBuffer()
+{
+    // Every segment written so far now belongs to a stale epoch and
+    // reads as zero, so there is no need to touch the samples themselves.
+    m_epoch++;
 
     m_back = 0;
     m_insertedCount = 0;
-
-#ifndef DISABLE_SPECTRUM
-    m_window.clear();
-    m_window_iter = m_window.begin();
-#endif
 }
 
 void isoBuffer::gainBuffer(int gain_log)
 {
     qDebug() << "Buffer shifted by" << gain_log;
-    for (uint32_t i = 0; i < m_bufferLen; i++)
-    {
+    m_gainLog += gain_log;
+
+    // Complete segments pick up the new gain when they are read. The one
+    // currently being filled is about to receive samples at the new gain,
+    // so shift what it already holds and restamp it; the previous lap's
+    // samples past m_back keep their own stamp.
+    uint32_t segmentStart = m_back & ~(kBufferSegmentLength - 1);
+    if (segmentStart == m_back)
+        return;
+
+    auto applyGain = [gain_log](short& sample) {
         if (gain_log < 0)
-        {
-            m_buffer[i] <<= -gain_log;
-            m_buffer[i+m_bufferLen] <<= -gain_log;
-        }
+            sample <<= -gain_log;
         else
+            sample >>= gain_log;
+    };
+
+    for (uint32_t i = segmentStart; i < m_back; i++)
+    {
+        applyGain(m_buffer[i]);
+        applyGain(m_buffer[i+m_bufferLen]);
+    }
+
+    // Along with the peak detect blocks completed so far in this segment
+    for (int level = 0; level < kEnvelopeLevels; level++)
+    {
+        uint32_t const shift = kEnvelopeLevelShift * (level + 1);
+        for (uint32_t i = segmentStart >> shift; i < m_back >> shift; i++)
         {
-            m_buffer[i] >>= gain_log;
-            m_buffer[i+m_bufferLen] >>= gain_log;
+            applyGain(m_envelope[level][i].min);
+            applyGain(m_envelope[level][i].max);
         }
     }
+    m_segments[segmentStart / kBufferSegmentLength].gainLog = m_gainLog;
 }
 
-#ifndef DISABLE_SPECTRUM
-void isoBuffer::enableFreqResp(bool enable, double freqValue)
-{
-    m_freqRespActive = enable;
-    freqResp_samples = uint32_t(m_samplesPerSecond/freqValue);
-}
-#endif
-
 void isoBuffer::outputSampleToFile(double averageSample)
 {
     char numStr[32];
@@ -289,6 +450,7 @@ void isoBuffer::maybeOutputSampleToFile(double convertedSample)
 
 void isoBuffer::enableFileIO(QFile* file, int samplesToAverage, qulonglong max_file_size)
 {
+    std::lock_guard<std::mutex> lock(m_fileIOMutex);
 
     // Open the file
     file->open(QIODevice::WriteOnly);
@@ -315,6 +477,7 @@ void isoBuffer::enableFileIO(QFile* file, int samplesToAverage, qulonglong max_f
 
 void isoBuffer::disableFileIO()
 {
+    std::lock_guard<std::mutex> lock(m_fileIOMutex);
     m_fileIOEnabled = false;
     m_currentColumn = 0;
     m_currentFile->close();
@@ -324,13 +487,7 @@ void isoBuffer::disableFileIO()
 
 double isoBuffer::sampleConvert(short sample, int TOP, bool AC) const
 {
-    double scope_gain = (double)(m_virtualParent->driver->scopeGain);
-
-    double voltageLevel = (sample * (vcc/2)) / (m_frontendGain*scope_gain*TOP);
-    if (m_virtualParent->driver->deviceMode != 7) voltageLevel += m_voltage_ref;
-#ifdef INVERT_MM
-    if (m_virtualParent->driver->deviceMode == 7) voltageLevel *= -1;
-#endif
+    double voltageLevel = m_virtualParent->sampleConversion(m_channel, TOP).toVolts(sample);
 
     if (AC)
     {
@@ -343,8 +500,6 @@ double isoBuffer::sampleConvert(short sample, int TOP, bool AC) const
 
 short isoBuffer::inverseSampleConvert(double voltageLevel, int TOP, bool AC) const
 {
-    double scope_gain = m_virtualParent->driver->scopeGain;
-
     if (AC)
     {
         // This is old (1 frame in past) value and might not be good for signals with
@@ -352,14 +507,7 @@ short isoBuffer::inverseSampleConvert(double voltageLevel, int TOP, bool AC) con
         voltageLevel += m_virtualParent->currentVmean;
     }
 
-#ifdef INVERT_MM
-    if (m_virtualParent->driver->deviceMode == 7) voltageLevel *= -1;
-#endif
-    if (m_virtualParent->driver->deviceMode != 7) voltageLevel -= m_voltage_ref;
-
-    // voltageLevel = (sample * (vcc/2)) / (frontendGain*scope_gain*TOP);
-    short sample = (voltageLevel * (m_frontendGain*scope_gain*TOP))/(vcc/2);
-    return sample;
+    return m_virtualParent->sampleConversion(m_channel, TOP).toSample(voltageLevel);
 }
 
 // For capacitance measurement.
@@ -405,22 +553,33 @@ int isoBuffer::cap_x2fromLast(double seconds, int x1, double vtop)
     return capSample(-x1, kSamplesSeekingCap, seconds, vtop, fX1X2Comp);
 }
 
-void isoBuffer::serialManage(double baudRate, UartParity parity, bool hexDisplay)
+uartStyleDecoder* isoBuffer::serialManage(double baudRate, UartParity parity, bool hexDisplay)
 {
-    if (m_decoder == NULL)
+    // Called from isoDriver's processing thread while the decoder worker is
+    // idle, and returns the decoder for it to run.  The decoder drives a
+    // console, so it is created (and its timer run) on the GUI thread;
+    // decoding starts on the first frame after it has been handed back.
+    uartStyleDecoder* decoder = m_decoder.load(std::memory_order_acquire);
+    if (decoder == nullptr)
     {
-        m_decoder = new uartStyleDecoder(baudRate, this);
+        if (!m_decoderRequested.exchange(true))
+        {
+            QMetaObject::invokeMethod(this, [this, baudRate]{
+                m_decoder.store(new uartStyleDecoder(baudRate, this), std::memory_order_release);
+            }, Qt::QueuedConnection);
+        }
+        return nullptr;
     }
     if (!m_isDecoding)
     {
-        m_decoder->m_updateTimer.start(CONSOLE_UPDATE_TIMER_PERIOD);
+        QMetaObject::invokeMethod(&decoder->m_updateTimer, "start", Qt::QueuedConnection, Q_ARG(int, CONSOLE_UPDATE_TIMER_PERIOD));
         m_isDecoding = true;
     }
 
-    m_decoder->m_baudRate = baudRate;
-    m_decoder->setParityMode(parity);
-    m_decoder->setHexDisplay(hexDisplay);
-    m_decoder->serialDecode();
+    decoder->m_baudRate = baudRate;
+    decoder->setParityMode(parity);
+    decoder->setHexDisplay(hexDisplay);
+    return decoder;
 }
 
 void isoBuffer::setTriggerType(TriggerType newType)
@@ -2,8 +2,9 @@
 #define ISOBUFFER_H
 
 // TODO: Move headers used only in implementation to isobuffer.cpp
-#include <list>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <QWidget>
@@ -43,17 +44,53 @@ enum class TriggerSeekState : uint8_t
 
 constexpr uint32_t CONSOLE_UPDATE_TIMER_PERIOD = ISO_PACKETS_PER_CTX * 4;
 
+// The buffer is split into fixed-size segments, each tagged with the epoch
+// and gain it was written under. Clearing the buffer only bumps the epoch,
+// and a gain change only rewrites the segment currently being filled; all
+// older segments have the difference applied when they are read.
+// The segment being filled still holds the previous lap past m_back, so
+// it keeps that lap's tag as well.
+constexpr uint32_t kBufferSegmentLength = 4096;
+static_assert((kBufferSegmentLength & (kBufferSegmentLength - 1)) == 0, "kBufferSegmentLength must be a power of two");
+
+struct BufferSegment
+{
+    uint32_t epoch = 0;
+    int gainLog = 0;
+    uint32_t tailEpoch = 0;
+    int tailGainLog = 0;
+};
+
+// Peak detect keeps the min and max of every complete block of 16, 256 and
+// 4096 samples as they are written, so the extremes of any stretch of the
+// buffer take a few dozen steps to find however long the stretch is.
+// Blocks never cross a segment, so a block's epoch and gain are its segment's.
+constexpr int kEnvelopeLevels = 3;
+constexpr uint32_t kEnvelopeLevelShift = 4; // Each level's blocks are 16 times longer than the last
+static_assert((1u << (kEnvelopeLevelShift * kEnvelopeLevels)) <= kBufferSegmentLength, "Envelope blocks must not cross a segment");
+
+struct SampleRange
+{
+    short min;
+    short max;
+};
+
+// Where a buffer's writer had got to, for the decoders, which follow it
+// from another thread
+struct isoBufferPosition
+{
+    uint32_t back = 0;
+    uint32_t epoch = 0;
+    uint64_t sampleCount = 0;
+};
+
 // TODO: Make private what should be private
 // TODO: Change integer types to cstdint types
 class isoBuffer : public QWidget
 {
 	Q_OBJECT
 public:
-#ifndef DISABLE_SPECTRUM
-	isoBuffer(QWidget* parent = 0, int bufferLen = 0, int windowLen = 0, isoDriver* caller = 0, unsigned char channel_value = 0);
-#else
 	isoBuffer(QWidget* parent = 0, int bufferLen = 0, isoDriver* caller = 0, unsigned char channel_value = 0);
-#endif
 	~isoBuffer() = default;
 
 //	Basic buffer operations
@@ -62,10 +99,6 @@ public:
 	void clearBuffer();
 	void gainBuffer(int gain_log);
 
-#ifndef DISABLE_SPECTRUM
-    void enableFreqResp(bool enable, double freqValue);
-#endif
-
 // Advanced buffer operations
 private:
     template<typename T, typename Function>
@@ -74,10 +107,12 @@ public:
 	void writeBuffer_char(char* data, int len);
 	void writeBuffer_short(short* data, int len);
 
-    std::vector<short> readBuffer(double sampleWindow, int numSamples, bool singleBit, double delayOffset);
-#ifndef DISABLE_SPECTRUM
-    std::vector<short> readWindow();
-#endif
+    // The readers that fill a trace can also total what they read, which
+    // AC coupling needs before it converts anything
+    void readBuffer(std::vector<short>& readData, double sampleWindow, int numSamples, bool singleBit, double delayOffset, int64_t* sum = nullptr) const;
+    void readEnvelope(std::vector<short>& minData, std::vector<short>& maxData, double sampleWindow, int numSamples, double delayOffset) const;
+    uint32_t readRaw(std::vector<short>& readData, double sampleWindow, double delayOffset, uint32_t maxSamples) const;
+    uint32_t readLatest(short* readData, uint32_t numSamples, int64_t* sum = nullptr) const;
 //	file I/O
 private:
 	void outputSampleToFile(double averageSample);
@@ -94,7 +129,12 @@ public:
 	int cap_x0fromLast(double seconds, double vbot);
 	int cap_x1fromLast(double seconds, int x0, double vbot);
 	int cap_x2fromLast(double seconds, int x1, double vtop);
-	void serialManage(double baudRate, UartParity parity, bool hexDisplay);
+	uartStyleDecoder* serialManage(double baudRate, UartParity parity, bool hexDisplay);
+	isoBufferPosition position() const { return {m_back, m_epoch, m_sampleCount}; }
+	// Whether sample, counted like m_sampleCount, may have been written over
+	// by now.  Safe from the decoder worker, which reads the buffer while
+	// it is being written.
+	bool overwritten(uint64_t sample) const;
     void setTriggerType(TriggerType newType);
     void setTriggerLevel(double voltageLevel, uint16_t top, bool acCoupled);
     double getDelayedTriggerPoint(double delay);
@@ -112,28 +152,29 @@ public:
 
 //	Internal Storage
     std::unique_ptr<short[]> m_bufferPtr;
+    // NOTE: Raw contents are only meaningful within the current epoch and
+    // do not have later gain changes applied. Use bufferAt() for samples.
     short* m_buffer;
 	uint32_t m_back = 0;
 	uint32_t m_insertedCount = 0;
+	uint64_t m_sampleCount = 0; // Every sample ever written, for readers that follow the stream
+	// m_sampleCount as it will be once the write in progress is done, set
+	// before any of it is stored.  See overwritten().
+	std::atomic<uint64_t> m_writeCount{0};
 	uint32_t m_bufferLen;
-
-#ifndef DISABLE_SPECTRUM
+	uint32_t m_epoch = 0;
 private:
-    // Time domain samples for spectrum view
-    std::vector<short> m_window;
-    std::vector<short>::size_type m_window_capacity;
-    std::vector<short>::iterator m_window_iter;
+	std::vector<BufferSegment> m_segments;
+	int m_gainLog = 0;
+	std::vector<SampleRange> m_envelope[kEnvelopeLevels];
 
-    bool m_freqRespActive = false;
+	short adjustedSample(short sample, uint32_t slot) const;
+	void summariseBlocks(uint32_t end);
+	void envelopeOfSlots(uint32_t first, uint32_t last, SampleRange& range) const;
 public:
-    std::list<short> freqResp_buffer;
-    uint32_t freqResp_count = 0;
-    uint32_t freqResp_samples = 0;
-#endif
 
 // Conversion And Sampling
-	double m_voltage_ref = 1.65;
-	double m_frontendGain = (R4 / (R3 + R4));
+	// Calibration lives in isoDriver::sampleConversion(), by m_channel
 	int m_samplesPerSecond;
 	int m_sampleRate_bit;
     TriggerType m_triggerType = TriggerType::Disabled;
@@ -142,10 +183,14 @@ public:
     short m_triggerSensitivity = 0;
     std::vector<uint32_t> m_triggerPositionList = {};
 //	UARTS decoding
-	uartStyleDecoder* m_decoder = NULL;
-	bool m_isDecoding = true;
+	std::atomic<uartStyleDecoder*> m_decoder{nullptr};
+	std::atomic_bool m_isDecoding{true};
 private:
+	std::atomic_bool m_decoderRequested{false};
 //	File I/O
+	// The DAQ is switched on and off from the GUI thread while samples
+	// are written from isoDriver's processing thread.
+	std::mutex m_fileIOMutex;
 	bool m_fileIOEnabled = false;
 	QFile* m_currentFile;
 	int m_fileIO_sampleCountPerWrite;
@@ -1,5 +1,6 @@
 #include "isobuffer_file.h"
 #include "math.h"
+#include <string.h>
 #include <QDebug>
 
 isoBuffer_file::isoBuffer_file(QWidget *parent, int bufferlen, double sampleRate_Hz) : QWidget(parent)
@@ -41,8 +42,13 @@ float *isoBuffer_file::readBuffer(double sampleWindow, int numSamples, bool sing
     qDebug() << "front" << front;
 */
     int idx;
-    if(readData!=NULL) free(readData);
-    readData = (float *) calloc(numSamples, sizeof(float));
+    //Only reallocate if the window got bigger
+    if(numSamples > readDataCapacity){
+        free(readData);
+        readData = (float *) calloc(numSamples, sizeof(float));
+        readDataCapacity = numSamples;
+    }
+    else memset(readData, 0, numSamples * sizeof(float));
 
 
     if(singleBit){
@@ -17,6 +17,7 @@ public:
     double samplesPerSecond;
     int bufferEnd, back = 0;
     float *buffer, *readData = NULL;
+    int readDataCapacity = 0;
 signals:
 
 public slots:
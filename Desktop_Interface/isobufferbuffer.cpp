@@ -1,6 +1,13 @@
 #include "isobufferbuffer.h"
 
 #include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+constexpr char kHexDigits[] = "0123456789abcdef";
+}
 
 /* isoBufferBuffer is implemented as two consecutive, duplicate,
  * ring buffers. the effect of this is that we are able to hand
@@ -41,25 +48,51 @@ void isoBufferBuffer::insert(char c)
 	// Loop the buffer index if necessary and update size accordingly
 	m_top = (m_top + 1) % m_capacity;
 	m_size = std::min(m_size + 1, m_capacity);
+	m_unread = std::min(m_unread + 1, m_capacity);
 }
 
 void isoBufferBuffer::insert(char const * s)
 {
-	while (*s != '\0')
-		insert(*s++);
+	insert(s, strlen(s));
+}
+
+// Adds a whole run of characters with at most four memcpy calls,
+// instead of doing a modulo and two stores per character.
+void isoBufferBuffer::insert(char const * s, uint32_t length)
+{
+	// Anything older than the last m_capacity characters would be
+	// overwritten anyway, so don't bother copying it.
+	if (length > m_capacity)
+	{
+		s += length - m_capacity;
+		length = m_capacity;
+	}
+
+	char* dataPtr = m_data.get();
+
+	// Copy up to the end of the ring, then wrap around to the start
+	uint32_t const head = std::min(length, m_capacity - m_top);
+	uint32_t const tail = length - head;
+
+	memcpy(dataPtr + m_top, s, head);
+	memcpy(dataPtr + m_top + m_capacity, s, head);
+	memcpy(dataPtr, s + head, tail);
+	memcpy(dataPtr + m_capacity, s + head, tail);
+
+	m_top = (m_top + length) % m_capacity;
+	m_size = std::min(m_size + length, m_capacity);
+	m_unread = std::min(m_unread + length, m_capacity);
 }
 
 void isoBufferBuffer::insert(std::string const & s)
 {
-	for (char c : s)
-		insert(c);
+	insert(s.data(), s.size());
 }
 
 void isoBufferBuffer::insert_hex(uint8_t x)
 {
-	char str[5];
-	snprintf(str, sizeof str, "0x%02hhx", x);
-	insert((char const *)str);
+	char const str[4] = {'0', 'x', kHexDigits[x >> 4], kHexDigits[x & 0x0f]};
+	insert(str, sizeof str);
 }
 
 char const* isoBufferBuffer::query(uint32_t count) const
@@ -77,6 +110,17 @@ void isoBufferBuffer::clear()
 {
 	m_top = 0;
 	m_size = 0;
+	m_unread = 0;
+}
+
+uint32_t isoBufferBuffer::unread() const
+{
+	return m_unread;
+}
+
+void isoBufferBuffer::markRead()
+{
+	m_unread = 0;
 }
 
 char const * isoBufferBuffer::begin() const
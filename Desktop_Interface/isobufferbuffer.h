@@ -29,6 +29,7 @@ public:
 
 	void insert(char c);
 	void insert(char const * s);
+	void insert(char const * s, uint32_t length);
 	void insert(std::string const & s);
 	void insert_hex(uint8_t x);
 
@@ -38,6 +39,12 @@ public:
 
 	void clear();
 
+	// Number of characters inserted since the last call to markRead(),
+	// capped at capacity(). Lets consumers such as the serial consoles
+	// render only what changed instead of the whole buffer.
+	uint32_t unread() const;
+	void markRead();
+
 	char const * begin() const;
 	char const * end() const;
 
@@ -48,6 +55,7 @@ private:
 	uint32_t m_capacity;
 	uint32_t m_size = 0;
 	uint32_t m_top = 0;
+	uint32_t m_unread = 0;
 };
 
 #endif // ISOBUFFERBUFFER_H
@@ -1,24 +1,30 @@
-#ifndef DISABLE_SPECTRUM
-#include <Eigen/Dense>  // First so that our #defines won't conflict
-#endif
-
 #include "isodriver.h"
 #include "isobuffer.h"
 #include "isobuffer_file.h"
 #include <math.h>
 #include "daqloadprompt.h"
+#include "allocationcounter.h"
+#include "samplekernels.h"
+#include "framegraph.h"
+#include "decoderworker.h"
 #include <iostream>
 
 #ifndef DISABLE_SPECTRUM
 #include "asyncdft.h"
-#include "spline.h"
+#include "crosscorrelator.h"
+#include "spectrogram.h"
 
 #define PI 3.141592653589793  // Predefined value for pi
-#define PI_2 2*PI
-#define PI_4 4*PI
-#define PI_6 6*PI
-#define PI_8 8*PI
-static constexpr int kSpectrumCounterMax = 4;
+// Raw samples binned per channel per frame for persistence.  Enough for
+// every sample of a window up to about 170 ms; longer ones are strided.
+static constexpr uint32_t kPersistenceMaxSamples = 1 << 16;
+
+// Like dst = src, but reuses dst's storage rather than sharing src's.
+static void copyInto(QVector<double>& dst, QVector<double> const& src)
+{
+    dst.resize(src.size());
+    std::copy(src.begin(), src.end(), dst.begin());
+}
 
 #define HORICURSORENABLED ((!spectrum & !freqResp & !eyeDiagram & horiCursorEnabled0) | (spectrum & horiCursorEnabled1) | (freqResp & horiCursorEnabled2) | (eyeDiagram & horiCursorEnabled3))
 #define VERTCURSORENABLED ((!spectrum & !freqResp & !eyeDiagram & vertCursorEnabled0) | (spectrum & vertCursorEnabled1) | (freqResp & vertCursorEnabled2) | (eyeDiagram & vertCursorEnabled3))
@@ -32,20 +38,18 @@ isoDriver::isoDriver(QWidget *parent) : QLabel(parent)
     this->hide();
 
 #ifndef DISABLE_SPECTRUM
+    // The spectrogram plans with FFTW's thread count set to one for the
+    // moment, so it goes before AsyncDFT starts planning in the background
+    m_spectrogram = new spectrogram();
     m_asyncDFT = new AsyncDFT();
-    m_windowFactors.fill(1.0, m_asyncDFT->n_samples);
-    m_windowFactorsSum = m_asyncDFT->n_samples;
+    m_crossCorrelator = new crossCorrelator();
+#endif
 
-    internalBuffer375_CH1 = new isoBuffer(this, MAX_WINDOW_SIZE*ADC_SPS/20*21, m_asyncDFT->n_samples, this, 1);
-    internalBuffer375_CH2 = new isoBuffer(this, MAX_WINDOW_SIZE*ADC_SPS/20*21, m_asyncDFT->n_samples, this, 2);
-    internalBuffer750 = new isoBuffer(this, MAX_WINDOW_SIZE*ADC_SPS/10*21, m_asyncDFT->n_samples, this, 1);
-#else
     internalBuffer375_CH1 = new isoBuffer(this, MAX_WINDOW_SIZE*ADC_SPS/20*21, this, 1);
     internalBuffer375_CH2 = new isoBuffer(this, MAX_WINDOW_SIZE*ADC_SPS/20*21, this, 2);
     internalBuffer750 = new isoBuffer(this, MAX_WINDOW_SIZE*ADC_SPS/10*21, this, 1);
-#endif
 
-    isoTemp = (char *) malloc(TIMER_PERIOD*ADC_SPF + 8); //8-byte header contains (unsigned long) length
+    m_decoderWorker = new decoderWorker();
 
     v0 = new siprint("V", 0);
     v1 = new siprint("V", 0);
@@ -70,6 +74,58 @@ isoDriver::isoDriver(QWidget *parent) : QLabel(parent)
     slowTimer->setTimerType(Qt::PreciseTimer);
     slowTimer->start(MULTIMETER_PERIOD);
     connect(slowTimer, SIGNAL(timeout()), this, SLOT(slowTimerTick()));
+
+    connect(this, &isoDriver::frameReady, this, &isoDriver::renderFrame, Qt::QueuedConnection);
+
+    m_processingThread = new QThread();
+    m_processingWorker = new processingWorker(this);
+    m_processingWorker->moveToThread(m_processingThread);
+    connect(m_processingThread, &QThread::finished, m_processingWorker, &QObject::deleteLater);
+    m_processingThread->start();
+}
+
+isoDriver::~isoDriver()
+{
+    m_processingThread->quit();
+    m_processingThread->wait();
+    delete m_processingThread;
+    // Before the buffers it reads go
+    delete m_decoderWorker;
+#ifndef DISABLE_SPECTRUM
+    // Waits for any transform still running
+    delete m_asyncDFT;
+    delete m_crossCorrelator;
+    delete m_spectrogram;
+#endif
+}
+
+// Anything that reads or writes the isoBuffers has to run on the processing
+// thread.  Calls from the GUI thread are queued behind the frames already
+// waiting there, so they take effect in the order they were made.
+template<typename Function>
+void isoDriver::runOnProcessingThread(Function function)
+{
+    if (QThread::currentThread() == m_processingThread)
+        function();
+    else
+        QMetaObject::invokeMethod(m_processingWorker, function, Qt::QueuedConnection);
+}
+
+// As above, but the GUI thread waits for it.  Only for the odd call that
+// needs an answer straight away, such as calibration.  The processing
+// thread never waits on the GUI thread, so this can't deadlock.
+template<typename Function>
+void isoDriver::runOnProcessingThreadAndWait(Function function)
+{
+    if (QThread::currentThread() == m_processingThread)
+        function();
+    else
+        QMetaObject::invokeMethod(m_processingWorker, function, Qt::BlockingQueuedConnection);
+}
+
+void processingWorker::processFrames()
+{
+    m_driver->processPendingFrames();
 }
 
 void isoDriver::setDriver(genericUsbDriver *newDriver){
@@ -89,25 +145,181 @@ void isoDriver::timerTick(void){
         firstFrame = false;
     }
 
-    isoTemp = driver->isoRead(&length);
-    //qDebug() << length << "read in!!";
-    total_read += length;
+    unsigned int frameLength;
+    char *frameData = driver->isoRead(&frameLength);
+    //qDebug() << frameLength << "read in!!";
+    total_read += frameLength;
 
     if(fileModeEnabled){
         qDebug() << "File mode is active.  Abort live refresh";
         return;
     }
 
-    if (length==0){
+    if (frameLength==0){
         //Zero length packet means something's gone wrong.  Probably a disconnect.
         qDebug() << "Zero length iso packet!";
         //driver->killMe();
         return;
     }
 
+    queueFrame(frameData, frameLength, false);
+}
+
+// GUI thread.  The driver reuses its buffer on the next isoRead(), so the
+// frame is copied into a queue slot together with the view it should be
+// drawn with.  If the processing thread has fallen a whole queue behind,
+// the frame is dropped rather than stalling the GUI.
+void isoDriver::queueFrame(char const* data, unsigned int frameLength, bool fileMode)
+{
+    queuedFrame* frame = m_frameQueue.writeSlot();
+    if (frame == nullptr)
+    {
+        // Reported at most once a second, so a backlog doesn't also flood the log
+        m_droppedFrames++;
+        if (!m_droppedFramesReported.isValid() || m_droppedFramesReported.elapsed() >= 1000)
+        {
+            qDebug() << "Processing thread is behind, dropped" << m_droppedFrames << "frames";
+            m_droppedFramesReported.start();
+        }
+        return;
+    }
+
+    frame->data.assign(data, data + frameLength);
+    frame->length = frameLength;
+    frame->fileMode = fileMode;
+    frame->view.window = display->window;
+    frame->view.delay = display->delay;
+    frame->view.topRange = display->topRange;
+    frame->view.botRange = display->botRange;
+    frame->view.leftRange = display->leftRange;
+    frame->view.rightRange = display->rightRange;
+#ifndef DISABLE_SPECTRUM
+    // The lock-in has to mix at what the generator really plays
+    double const freqRespFrequency = freqValue_CH1 ? freqValue_CH1->value() : 0;
+    frame->view.freqRespWaveLength = freqRespGenerator ? int(freqRespGenerator->getData().samples.size()) : 0;
+    frame->view.freqRespFrequency = (frame->view.freqRespWaveLength > 0 && freqRespFrequency > 0)
+        ? functionGen::timerSetting(frame->view.freqRespWaveLength, freqRespFrequency).frequency()
+        : freqRespFrequency;
+    frame->view.waterfall = m_waterfallMap != nullptr;
+    frame->view.crossCorrelation = m_crossCorrelationShown;
+    frame->view.jitter = m_jitterShown;
+    frame->view.spectrum = spectrum;
+    frame->view.freqResp = freqResp;
+    frame->view.eyeDiagram = eyeDiagram;
+    frame->view.freqRespType = m_freqRespType;
+#endif
+    frame->view.deviceMode = driver->deviceMode;
+    frame->view.scopeGain = driver->scopeGain;
+    frame->view.paused_CH1 = paused_CH1;
+    frame->view.paused_CH2 = paused_CH2;
+    frame->view.paused_multimeter = paused_multimeter;
+    frame->view.AC_CH1 = AC_CH1;
+    frame->view.AC_CH2 = AC_CH2;
+    frame->view.attenuation_CH1 = m_attenuation_CH1;
+    frame->view.attenuation_CH2 = m_attenuation_CH2;
+    frame->view.offset_CH1 = m_offset_CH1;
+    frame->view.offset_CH2 = m_offset_CH2;
+    frame->view.digitalOffset_CH1 = m_digitalOffset_CH1;
+    frame->view.digitalOffset_CH2 = m_digitalOffset_CH2;
+    frame->view.ch1_ref = ch1_ref;
+    frame->view.ch2_ref = ch2_ref;
+    frame->view.frontendGain_CH1 = frontendGain_CH1;
+    frame->view.frontendGain_CH2 = frontendGain_CH2;
+    frame->view.XYmode = XYmode;
+    frame->view.peakDetect = peakDetect;
+    frame->view.triggerEnabled = triggerEnabled;
+    frame->view.singleShotEnabled = singleShotEnabled;
+    frame->view.triggerMode = triggerMode;
+    frame->view.serialDecodeEnabled_CH1 = serialDecodeEnabled_CH1;
+    frame->view.serialDecodeEnabled_CH2 = serialDecodeEnabled_CH2;
+    frame->view.serialType = serialType;
+    frame->view.baudRate_CH1 = baudRate_CH1;
+    frame->view.baudRate_CH2 = baudRate_CH2;
+    frame->view.parity_CH1 = parity_CH1;
+    frame->view.parity_CH2 = parity_CH2;
+    frame->view.hexDisplay_CH1 = hexDisplay_CH1;
+    frame->view.hexDisplay_CH2 = hexDisplay_CH2;
+    frame->view.multimeterType = multimeterType;
+    frame->view.seriesResistance = seriesResistance;
+    frame->view.multimeterRsource = multimeterRsource;
+    frame->view.autoMultimeterV = autoMultimeterV;
+    frame->view.autoMultimeterI = autoMultimeterI;
+    frame->view.autoMultimeterR = autoMultimeterR;
+    frame->view.autoMultimeterC = autoMultimeterC;
+    frame->view.forceMillivolts = forceMillivolts;
+    frame->view.forceMilliamps = forceMilliamps;
+    frame->view.forceKiloOhms = forceKiloOhms;
+    frame->view.forceUFarads = forceUFarads;
+    frame->view.forceVolts = forceVolts;
+    frame->view.forceAmps = forceAmps;
+    frame->view.forceOhms = forceOhms;
+    frame->view.forceNFarads = forceNFarads;
+    frame->view.zoomCount = m_zoomAxes.size();
+    for (int i = 0; i < frame->view.zoomCount; ++i)
+        frame->view.zooms[i] = m_zoomAxes[i].window;
+    frameBudget budget = m_autoFrameRate ? m_governor.budget() : frameGovernor::fixedBudget(TIMER_PERIOD);
+    frame->view.displayStride = budget.displayStride;
+    frame->view.graphSamples = budget.graphSamples;
+    frame->view.spectrumCadence = budget.spectrumCadence;
+    frame->view.decoderStride = budget.decoderStride;
+    frame->view.framePeriod = ISO_PACKETS_PER_CTX / 1000.0;
+    if (fileMode)
+    {
+        // The file timer already runs at the chosen frame rate
+        frame->view.displayStride = 1;
+        frame->view.framePeriod = TIMER_PERIOD / 1000.0;
+    }
+    m_frameQueue.push();
+
+    if (!m_processingScheduled.exchange(true))
+        QMetaObject::invokeMethod(m_processingWorker, "processFrames", Qt::QueuedConnection);
+}
+
+// Processing thread
+void isoDriver::processPendingFrames()
+{
+    // Cleared before draining, so anything queued from here on schedules another pass.
+    m_processingScheduled = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    while (queuedFrame* frame = m_frameQueue.readSlot())
+    {
+        processFrame(*frame);
+        m_frameQueue.pop();
+    }
+    m_processingNs += timer.nsecsElapsed();
+}
+
+void isoDriver::processFrame(queuedFrame& frame)
+{
+    if (m_framesProcessed <= kArenaWarmupFrames)
+        m_framesProcessed++;
+
+    m_view = frame.view;
+    isoTemp = frame.data.data();
+    length = frame.length;
+
+    if (frame.fileMode)
+    {
+        // The buffer is handed over from loadFileBuffer() after the file timer has started
+        if (internalBufferFile != NULL)
+            frameActionGeneric(-2,0);
+        return;
+    }
+
+    // The decoders keep their own place in the buffers, so running them
+    // every few frames just means decoding more at once.  They run on
+    // m_decoderWorker; while it is still busy they wait for a later frame.
+    if (m_decoderCounter < m_view.decoderStride)
+        m_decoderCounter++;
+    bool const decode = m_decoderCounter >= m_view.decoderStride && m_decoderWorker->idle();
+    if (decode)
+        m_decoderCounter = 0;
+
     // TODO: Do we need to invalidate state when the device is reconnected?
     bool invalidateTwoWireState = true;
-    switch(driver->deviceMode){
+    switch(m_view.deviceMode){
         case 0:
             if (deviceMode_prev != 0 && deviceMode_prev != 1 && deviceMode_prev != 2)
                 clearBuffers(true, false, false);
@@ -123,8 +335,9 @@ void isoDriver::timerTick(void){
 
             internalBuffer375_CH2->m_channel = 1;
             frameActionGeneric(1,2);
-            if(serialDecodeEnabled_CH1 && serialType == 0){
-                internalBuffer375_CH2->serialManage(baudRate_CH1, parity_CH1, hexDisplay_CH1);
+            if(decode && m_view.serialDecodeEnabled_CH1 && m_view.serialType == 0){
+                if (uartStyleDecoder* decoder = internalBuffer375_CH2->serialManage(m_view.baudRate_CH1, m_view.parity_CH1, m_view.hexDisplay_CH1))
+                    m_decoderWorker->addUart(decoder, internalBuffer375_CH2->position());
             }
             break;
         case 2:
@@ -140,8 +353,9 @@ void isoDriver::timerTick(void){
                 clearBuffers(true, false, false);
 
             frameActionGeneric(2,0);
-            if(serialDecodeEnabled_CH1 && serialType == 0){
-                internalBuffer375_CH1->serialManage(baudRate_CH1, parity_CH1, hexDisplay_CH1);
+            if(decode && m_view.serialDecodeEnabled_CH1 && m_view.serialType == 0){
+                if (uartStyleDecoder* decoder = internalBuffer375_CH1->serialManage(m_view.baudRate_CH1, m_view.parity_CH1, m_view.hexDisplay_CH1))
+                    m_decoderWorker->addUart(decoder, internalBuffer375_CH1->position());
             }
             break;
         case 4:
@@ -152,27 +366,24 @@ void isoDriver::timerTick(void){
 
             internalBuffer375_CH2->m_channel = 2;
             frameActionGeneric(2,2);
-            if(serialDecodeEnabled_CH1 && serialType == 0){
-                internalBuffer375_CH1->serialManage(baudRate_CH1, parity_CH1, hexDisplay_CH1);
+            if(decode && m_view.serialDecodeEnabled_CH1 && m_view.serialType == 0){
+                if (uartStyleDecoder* decoder = internalBuffer375_CH1->serialManage(m_view.baudRate_CH1, m_view.parity_CH1, m_view.hexDisplay_CH1))
+                    m_decoderWorker->addUart(decoder, internalBuffer375_CH1->position());
             }
-            if(serialDecodeEnabled_CH2 && serialType == 0){
-                internalBuffer375_CH2->serialManage(baudRate_CH2, parity_CH2, hexDisplay_CH2);
+            if(decode && m_view.serialDecodeEnabled_CH2 && m_view.serialType == 0){
+                if (uartStyleDecoder* decoder = internalBuffer375_CH2->serialManage(m_view.baudRate_CH2, m_view.parity_CH2, m_view.hexDisplay_CH2))
+                    m_decoderWorker->addUart(decoder, internalBuffer375_CH2->position());
             }
-            if (serialDecodeEnabled_CH1 && serialType == 1)
+            if (m_view.serialDecodeEnabled_CH1 && m_view.serialType == 1 && twoWire)
             {
-                if (twoWireStateInvalid)
-                    twoWire->reset();
-                try
-                {
-                    twoWire->run();
-                }
-                catch(...)
+                if (decode)
                 {
-                    qDebug() << "Resetting I2C";
-                    twoWire->reset();
+                    if (twoWireStateInvalid)
+                        twoWire->reset();
+                    m_decoderWorker->addTwoWire(twoWire, internalBuffer375_CH1->position());
+                    twoWireStateInvalid = false;
                 }
                 invalidateTwoWireState = false;
-                twoWireStateInvalid = false;
             }
             break;
         case 5:
@@ -188,110 +399,128 @@ void isoDriver::timerTick(void){
             multimeterAction();
             break;
         default:
-            qFatal("Error in isoDriver::timerTick.  Invalid device mode.");
+            qFatal("Error in isoDriver::processFrame.  Invalid device mode.");
     }
     if (invalidateTwoWireState)
         twoWireStateInvalid = true;
+    if (decode)
+        m_decoderWorker->start();
 
-    deviceMode_prev = driver->deviceMode;
-    //free(isoTemp);
+    deviceMode_prev = m_view.deviceMode;
 }
 
-QVector<double> isoDriver::analogConvert(std::vector<short> &in, int TOP, bool AC, int channel)
+void isoDriver::publishFrame()
 {
-    double scope_gain = (double)(driver->scopeGain);
-    double accumulated = 0;
-    double accumulated_square = 0;
-    currentVmax = -20;
-    currentVmin = 20;
+    // Every frame carries the trigger frequency, whatever it draws
+    RenderFrame& frame = m_renderFrames.back();
+    frame.triggerFrequency = -1;
+    if (m_view.triggerEnabled)
+    {
+        if (m_view.triggerMode >= 2)
+            frame.triggerFrequency = internalBuffer375_CH2->getTriggerFrequencyHz();
+        else
+            frame.triggerFrequency = (m_view.deviceMode == 6) ? internalBuffer750->getTriggerFrequencyHz() : internalBuffer375_CH1->getTriggerFrequencyHz();
+    }
+
+    m_renderFrames.publish();
+    // The GUI always draws the newest frame, so one pending wake-up is enough.
+    if (!m_renderScheduled.exchange(true))
+        emit frameReady();
+}
 
-    double ref = (channel == 1 ? ch1_ref : ch2_ref);
-    double frontendGain = (channel == 1 ? frontendGain_CH1 : frontendGain_CH2);
+void isoDriver::conversionFactors(int channel, int TOP, double& voltsPerCount, double& offset) const
+{
+    double scope_gain = (double)(m_view.scopeGain);
+    double frontendGain = (channel == 2 ? m_view.frontendGain_CH2 : m_view.frontendGain_CH1);
 
-    QVector<double> out(in.size());
-    for (int i = 0; i < out.size(); ++i) {
-        out[i] = (in[i] * (vcc/2)) / (frontendGain*scope_gain*TOP);
-        if (driver->deviceMode != 7) out[i] += ref;
-        #ifdef INVERT_MM
-            if (driver->deviceMode == 7) out[i] *= -1;
-        #endif
-
-        accumulated += out[i];
-        accumulated_square += out[i] * out[i];
-        if (out[i] > currentVmax) currentVmax = out[i];
-        if (out[i] < currentVmin) currentVmin = out[i];
-    }
-    currentVmean = accumulated / out.size();
-    currentVRMS = sqrt(accumulated_square / out.size());
-    if (AC) {
-        //Previous measurments are wrong, edit and redo.
-        accumulated = 0;
-        accumulated_square = 0;
-        currentVmax = -20;
-        currentVmin = 20;
-
-        for (int i = 0; i < out.size(); ++i) {
-            out[i] -= currentVmean;
-
-            accumulated += out[i];
-            accumulated_square += out[i] * out[i];
-            if (out[i] > currentVmax) currentVmax = out[i];
-            if (out[i] < currentVmin) currentVmin = out[i];
-        }
-        currentVmean = accumulated / out.size();
-        currentVRMS = sqrt(accumulated_square / out.size());
-    }
-    return out;
+    voltsPerCount = (vcc/2) / (frontendGain*scope_gain*TOP);
+    offset = (m_view.deviceMode != 7) ? (channel == 2 ? m_view.ch2_ref : m_view.ch1_ref) : 0;
+    #ifdef INVERT_MM
+        if (m_view.deviceMode == 7) voltsPerCount *= -1;
+    #endif
 }
 
-QVector<double> isoDriver::digitalConvert(std::vector<short> &in)
+conversionTable const& isoDriver::sampleConversion(int channel, int TOP)
 {
-    QVector<double> out(in.size());
-    double top = display->topRange - (display->topRange - display->botRange) / 10;
-    double bot = display->botRange + (display->topRange - display->botRange) / 10;
-    for (int i = 0; i < out.size(); ++i) {
-        out[i] = in[i] ? top : bot;
+    double voltsPerCount, offset;
+    conversionFactors(channel, TOP, voltsPerCount, offset);
+
+    conversionTable& table = m_conversionTables[channel == 2][TOP > 128];
+    table.update(TOP, voltsPerCount, offset);
+    return table;
+}
+
+// Raw samples to volts, then attenuation, offset and window, in one pass of
+// convertSamples().  The statistics describe the trace before attenuation
+// and offset, as they always have; since the conversion is affine they are
+// derived from the raw-sample statistics the kernel gathers on the way.
+// For AC coupling, acSum is the total of in, which the buffer read added
+// up as it went; the mean is folded into the bias before converting.
+// A multiply-add beats a table lookup in SIMD, so this uses the factors of
+// sampleConversion() rather than its table.
+void isoDriver::analogConvert(std::vector<short> const& in, QVector<double>& out, int TOP, int64_t const* acSum, int channel, double attenuation, double offset)
+{
+    out.resize(in.size());
+    if (in.empty()) {
+        currentVmax = currentVmin = currentVmean = currentVRMS = 0;
+        return;
     }
-    return out;
+
+    // volts = raw * voltsPerCount + bias
+    conversionTable const& conversion = sampleConversion(channel, TOP);
+    double const voltsPerCount = conversion.voltsPerCount();
+    double bias = conversion.offset();
+    double const n = static_cast<double>(in.size());
+    if (acSum)
+        bias = -voltsPerCount * (*acSum / n); // Whatever the calibration, the mean comes out to 0
+
+    m_lastConvertScale = voltsPerCount / attenuation;
+    m_lastConvertBias = bias / attenuation + offset;
+    sampleStats raw = convertSamples(in.data(), out.data(), out.size(),
+                                     m_lastConvertScale, m_lastConvertBias, nullptr);
+
+    double const rawMean = raw.sum / n;
+    double const a = voltsPerCount * raw.min + bias;
+    double const b = voltsPerCount * raw.max + bias;
+    currentVmax = std::max(a, b);
+    currentVmin = std::min(a, b);
+    currentVmean = voltsPerCount * rawMean + bias;
+    // E[v^2] = k^2 E[r^2] + 2kb E[r] + b^2
+    double meanSquare = voltsPerCount * voltsPerCount * (raw.sumSquares / n) + 2 * voltsPerCount * bias * rawMean + bias * bias;
+    currentVRMS = sqrt(std::max(meanSquare, 0.0));
+}
+
+// Peak detect min or max to volts, exactly as the trace they go with was
+// converted by the analogConvert() call just before.
+void isoDriver::envelopeConvert(std::vector<short> const& in, QVector<double>& out)
+{
+    out.resize(in.size());
+    convertSamples(in.data(), out.data(), out.size(), m_lastConvertScale, m_lastConvertBias, nullptr);
 }
 
-QVector<double> isoDriver::fileStreamConvert(float *in)
+void isoDriver::digitalLevels(double& top, double& bot) const
 {
-    QVector<double> out(GRAPH_SAMPLES);
+    top = m_view.topRange - (m_view.topRange - m_view.botRange) / 10;
+    bot = m_view.botRange + (m_view.topRange - m_view.botRange) / 10;
+}
+
+void isoDriver::digitalConvert(std::vector<short> const& in, QVector<double>& out)
+{
+    out.resize(in.size());
+    double top, bot;
+    digitalLevels(top, bot);
     for (int i = 0; i < out.size(); ++i) {
-        out[i] = in[i];
+        out[i] = in[i] ? top : bot;
     }
-    return out;
 }
 
-#ifndef DISABLE_SPECTRUM
-// Evaluate the windowing factor for a given window function, number of samples and at a given index
-double isoDriver::windowing_factor(int type, int N, int n)
+void isoDriver::fileStreamConvert(float *in, QVector<double>& out)
 {
-    double factor = 1.0;
-    switch (type)
-    {
-    case 0: // Rectangular window
-        factor = 1.0;
-        break;
-    case 1: // Hann window or raised cosine
-        factor = 0.5 - 0.5*std::cos(PI_2*n/(N-1));
-        break;
-    case 2: // Hamming window
-        factor = 0.54 - 0.46*std::cos(PI_2*n/(N-1));
-        break;
-    case 3: // Blackman window
-        factor = 0.42 - 0.5*std::cos(PI_2*n/N) + 0.08*std::cos(PI_4*n/N);
-        break;
-    case 4: // Flat top window
-        factor = 0.21557895 - 0.41663158*std::cos(PI_2*n/N) + 0.277263158*std::cos(PI_4*n/N) - 0.083578947*std::cos(PI_6*n/N) + 0.006947368*std::cos(PI_8*n/N);
-        break;
-    default:
-        factor = 1.0;
+    out.resize(m_view.graphSamples);
+    for (int i = 0; i < out.size(); ++i) {
+        out[i] = in[i];
     }
-    return factor;
 }
-#endif
 
 void isoDriver::startTimer(){
     /*if (isoTimer!=NULL){
@@ -306,12 +535,14 @@ void isoDriver::startTimer(){
 }
 
 void isoDriver::clearBuffers(bool ch3751, bool ch3752, bool ch750){
-    if(ch3751)
-        internalBuffer375_CH1->clearBuffer();
-    if(ch3752)
-        internalBuffer375_CH2->clearBuffer();
-    if(ch750)
-        internalBuffer750->clearBuffer();
+    runOnProcessingThread([this, ch3751, ch3752, ch750]{
+        if(ch3751)
+            internalBuffer375_CH1->clearBuffer();
+        if(ch3752)
+            internalBuffer375_CH2->clearBuffer();
+        if(ch750)
+            internalBuffer750->clearBuffer();
+    });
 }
 
 void isoDriver::setVisible_CH2(bool visible){
@@ -342,6 +573,7 @@ void isoDriver::refreshInteractiveGraph()
 void isoDriver::setVoltageRange(QWheelEvent* event)
 {
     if (doNotTouchGraph && !fileModeEnabled && (!driver || driver->connected)) return;
+    if (zoomWheel(event)) return;
 #ifndef DISABLE_SPECTRUM
     if (freqResp || spectrum) {
         display->setRespAndSpecRanges(event, axes, this);
@@ -571,9 +803,12 @@ void isoDriver::gainBuffers(double multiplier){
 
 void isoDriver::gainTick(void){
     qDebug() << "Multiplying by " << multi;
-    if (driver->deviceMode <5) internalBuffer375_CH1->gainBuffer(log2(multi));
-    if ((driver->deviceMode == 1) | (driver->deviceMode == 2) | (driver->deviceMode == 4)) internalBuffer375_CH2->gainBuffer(log2(multi));
-    if ((driver->deviceMode == 6) | (driver->deviceMode == 7)) internalBuffer750->gainBuffer(log2(multi));
+    int gain_log = log2(multi);
+    runOnProcessingThread([this, gain_log, deviceMode = driver->deviceMode]{
+        if (deviceMode <5) internalBuffer375_CH1->gainBuffer(gain_log);
+        if ((deviceMode == 1) | (deviceMode == 2) | (deviceMode == 4)) internalBuffer375_CH2->gainBuffer(gain_log);
+        if ((deviceMode == 6) | (deviceMode == 7)) internalBuffer750->gainBuffer(gain_log);
+    });
 }
 
 void isoDriver::setAutoGain(bool enabled){
@@ -780,9 +1015,12 @@ void isoDriver::setTriggerEnabled(bool enabled)
 
 void isoDriver::setTriggerLevel(double level)
 {
-    internalBuffer375_CH1->setTriggerLevel(level, (driver->deviceMode == 7 ? 2048 : 128), AC_CH1);
-    internalBuffer375_CH2->setTriggerLevel(level, 128, AC_CH2);
-    internalBuffer750->setTriggerLevel(level, 128, AC_CH1);
+    uint16_t top_CH1 = (driver->deviceMode == 7 ? 2048 : 128);
+    runOnProcessingThread([this, level, top_CH1, ac_CH1 = AC_CH1, ac_CH2 = AC_CH2]{
+        internalBuffer375_CH1->setTriggerLevel(level, top_CH1, ac_CH1);
+        internalBuffer375_CH2->setTriggerLevel(level, 128, ac_CH2);
+        internalBuffer750->setTriggerLevel(level, 128, ac_CH1);
+    });
     triggerStateChanged();
 }
 
@@ -801,31 +1039,28 @@ void isoDriver::setTriggerMode(int newMode)
 //0 for off, 1 for ana, 2 for dig, -1 for ana750, -2 for file
 void isoDriver::frameActionGeneric(char CH1_mode, char CH2_mode)
 {
-#ifndef DISABLE_SPECTRUM
-    internalBuffer375_CH1->enableFreqResp(freqResp, freqValue_CH1->value());
-    internalBuffer375_CH2->enableFreqResp(freqResp, freqValue_CH1->value());
-#endif
+    allocationCheck check("isoDriver::frameActionGeneric", m_framesProcessed > kArenaWarmupFrames);
 
     //qDebug() << "made it to frameActionGeneric";
-    if(!paused_CH1 && CH1_mode == - 1){
+    if(!m_view.paused_CH1 && CH1_mode == - 1){
         for (unsigned int i=0;i<(length/ADC_SPF);i++){
             internalBuffer750->writeBuffer_char(&isoTemp[ADC_SPF*i], VALID_DATA_PER_750);
         }
     }
 
-    if(!paused_CH1 && CH1_mode > 0){
+    if(!m_view.paused_CH1 && CH1_mode > 0){
         for (unsigned int i=0;i<(length/ADC_SPF);i++){
             internalBuffer375_CH1->writeBuffer_char(&isoTemp[ADC_SPF*i], VALID_DATA_PER_375);
         }
     }
 
-    if(!paused_CH2 && CH2_mode > 0){
+    if(!m_view.paused_CH2 && CH2_mode > 0){
         for (unsigned int i=0;i<(length/ADC_SPF);i++){
             internalBuffer375_CH2->writeBuffer_char(&isoTemp[ADC_SPF*i+ADC_SPF/2], VALID_DATA_PER_375);  //+375 to get the second half of the packet
         }
     }
 
-    if(!paused_CH1)
+    if(!m_view.paused_CH1)
     {
         int offset = -2; //No trigger!
 
@@ -846,459 +1081,764 @@ void isoDriver::frameActionGeneric(char CH1_mode, char CH2_mode)
     auto internalBuffer_CH2 = internalBuffer375_CH2;
 
     double triggerDelay = 0;
-    if (triggerEnabled)
+    if (m_view.triggerEnabled)
     {
-        triggerDelay = (triggerMode < 2) ? internalBuffer_CH1->getDelayedTriggerPoint(display->window) - display->window
-                                         : internalBuffer_CH2->getDelayedTriggerPoint(display->window) - display->window;
+        triggerDelay = (m_view.triggerMode < 2) ? internalBuffer_CH1->getDelayedTriggerPoint(m_view.window) - m_view.window
+                                         : internalBuffer_CH2->getDelayedTriggerPoint(m_view.window) - m_view.window;
 
         if (triggerDelay < 0)
             triggerDelay = 0;
     }
 
-    if(singleShotEnabled && (triggerDelay != 0))
+    if(m_view.singleShotEnabled && (triggerDelay != 0))
+    {
+        allocationExempt exempt;
         singleShotTriggered(1);
+    }
 
-    std::vector<short> readData_CH1;
-    std::vector<short> readData_CH2;
-    float *readDataFile;
+#ifndef DISABLE_SPECTRUM
+    if (m_view.freqResp && !m_view.paused_CH1)
+        freqRespAction(internalBuffer_CH1, internalBuffer_CH2);
+    // Every sample goes through clock recovery, whether it is drawn or not
+    bool const recoveringClock = m_view.jitter && !m_view.freqResp && (CH1_mode == 1 || CH1_mode == -1);
+    if (!recoveringClock)
+        m_clockRecovery.reset();
+    else if (!m_view.paused_CH1)
+        m_clockRecovery.update(internalBuffer_CH1);
+#endif
+
+    // The samples are in.  Everything from here on is display, which the
+    // frame governor may only do every few frames.
+    m_displayCounter = (m_displayCounter + 1) % m_view.displayStride;
+    if (m_displayCounter != 0)
+        return;
+
+    std::vector<short>& readData_CH1 = m_arena.raw_CH1;
+    std::vector<short>& readData_CH2 = m_arena.raw_CH2;
+    int64_t rawSum_CH1 = 0;
+    int64_t rawSum_CH2 = 0;
+    float *readDataFile = nullptr;
+    bool envelope = false;
+    bool persist = false;
 
 #ifndef DISABLE_SPECTRUM
-    if (spectrum || eyeDiagram) {
-        // The spectrum and eyeDiagram are computationally expensive to calculate, so we don't want to do it on every frame
-        m_spectrumCounter = (m_spectrumCounter + 1) % kSpectrumCounterMax;
+    if (m_view.spectrum) {
+        spectrumAction(internalBuffer_CH1, internalBuffer_CH2, CH1_mode, CH2_mode);
+        return;
+    } else if (m_view.eyeDiagram) {
+        // The eye diagram is computationally expensive to calculate, so we don't want to do it on every frame
+        m_spectrumCounter = (m_spectrumCounter + 1) % m_view.spectrumCadence;
         if (m_spectrumCounter != 0)
             return;
 
-        readData_CH1 = internalBuffer_CH1->readWindow();
-        readData_CH2 = internalBuffer_CH2->readWindow();
-    } else if (freqResp) {
-        double freqResp_window = 1/freqValue_CH1->value();
-        readData_CH1 = internalBuffer_CH1->readBuffer(freqResp_window, internalBuffer_CH1->freqResp_samples, CH1_mode == 2, triggerDelay);
-        readData_CH2 = internalBuffer_CH2->readBuffer(freqResp_window, internalBuffer_CH2->freqResp_samples, CH2_mode == 2, triggerDelay);
+        readData_CH1.resize(AsyncDFT::n_samples);
+        readData_CH1.resize(internalBuffer_CH1->readLatest(readData_CH1.data(), AsyncDFT::n_samples, &rawSum_CH1));
+        readData_CH2.resize(AsyncDFT::n_samples);
+        readData_CH2.resize(internalBuffer_CH2->readLatest(readData_CH2.data(), AsyncDFT::n_samples, &rawSum_CH2));
+    } else if (m_view.freqResp) {
+        // No trace; the lock-in reads the buffers itself
+        readData_CH1.clear();
+        readData_CH2.clear();
     } else
 #endif
     {
         if (CH1_mode == -2)
-            readDataFile = internalBufferFile->readBuffer(display->window, GRAPH_SAMPLES, false, display->delay);
+            readDataFile = internalBufferFile->readBuffer(m_view.window, m_view.graphSamples, false, m_view.delay);
         else if (CH1_mode)
-            readData_CH1 = internalBuffer_CH1->readBuffer(display->window, GRAPH_SAMPLES, CH1_mode == 2, display->delay + triggerDelay);
+            internalBuffer_CH1->readBuffer(readData_CH1, m_view.window, m_view.graphSamples, CH1_mode == 2, m_view.delay + triggerDelay, &rawSum_CH1);
         if (CH2_mode)
-            readData_CH2 = internalBuffer_CH2->readBuffer(display->window, GRAPH_SAMPLES, CH2_mode == 2, display->delay + triggerDelay);
+            internalBuffer_CH2->readBuffer(readData_CH2, m_view.window, m_view.graphSamples, CH2_mode == 2, m_view.delay + triggerDelay, &rawSum_CH2);
+
+        envelope = m_view.peakDetect && !m_view.XYmode;
+        if (envelope) {
+            if (CH1_mode == -1 || CH1_mode == 1)
+                internalBuffer_CH1->readEnvelope(m_arena.rawMin_CH1, m_arena.rawMax_CH1, m_view.window, m_view.graphSamples, m_view.delay + triggerDelay);
+            if (CH2_mode == 1)
+                internalBuffer_CH2->readEnvelope(m_arena.rawMin_CH2, m_arena.rawMax_CH2, m_view.window, m_view.graphSamples, m_view.delay + triggerDelay);
+        }
+
+        persist = m_persistenceSeconds != 0 && !m_view.XYmode;
+        if (persist) {
+            float decay = std::isinf(m_persistenceSeconds) ? 1.f : std::exp(-m_view.framePeriod * m_view.displayStride / m_persistenceSeconds);
+            m_persistence.beginFrame(m_view.window, m_view.delay, m_view.botRange, m_view.topRange, decay);
+        }
     }
 
-    QVector<double> CH1, CH2;
-#ifndef DISABLE_SPECTRUM
-    double CH1_avg = 0;
-    double samplesPerSymbol = 0;
-    int numSymbols = 0;
-#endif
+    QVector<double>& CH1 = m_arena.volts_CH1;
+    QVector<double>& CH2 = m_arena.volts_CH2;
+    QVector<double>& CH1_min = m_arena.voltsMin_CH1;
+    QVector<double>& CH1_max = m_arena.voltsMax_CH1;
+    QVector<double>& CH2_min = m_arena.voltsMin_CH2;
+    QVector<double>& CH2_max = m_arena.voltsMax_CH2;
+    // Whatever the previous frame left here must not leak into an unused channel
+    CH1.clear();
+    CH2.clear();
+    CH1_min.clear();
+    CH1_max.clear();
+    CH2_min.clear();
+    CH2_max.clear();
+
+    // Zoom views draw the same channels the same way, from their own windows
+    ZoomChannel zoomChannels[2];
+    zoomChannels[0].buffer = internalBuffer_CH1;
+    zoomChannels[0].mode = CH1_mode;
+    zoomChannels[1].buffer = internalBuffer_CH2;
+    zoomChannels[1].mode = CH2_mode;
 
     if (CH1_mode == -1 || CH1_mode == 1) {
-        CH1 = analogConvert(readData_CH1, 128, AC_CH1, 1);
+        analogConvert(readData_CH1, CH1, 128, m_view.AC_CH1 ? &rawSum_CH1 : nullptr, 1, m_view.attenuation_CH1, m_view.offset_CH1);
+        zoomChannels[0].scale = m_lastConvertScale;
+        zoomChannels[0].bias = m_lastConvertBias;
+        if (envelope) {
+            envelopeConvert(m_arena.rawMin_CH1, CH1_min);
+            envelopeConvert(m_arena.rawMax_CH1, CH1_max);
+        }
+        if (persist) {
+            uint32_t windowLength = internalBuffer_CH1->readRaw(m_arena.persistenceRaw, m_view.window, m_view.delay + triggerDelay, kPersistenceMaxSamples);
+            m_persistence.addSamples(m_arena.persistenceRaw, windowLength, m_lastConvertScale, m_lastConvertBias);
+        }
 #ifndef DISABLE_SPECTRUM
-        if (spectrum) {
-            for (int i = 0; i < CH1.size(); ++i) {
-                CH1[i] /= m_attenuation_CH1;
-                CH1[i] += m_offset_CH1;
-                CH1[i] *= m_windowFactors[i];
-            }
-        } else
-#endif
+        if (m_view.eyeDiagram)
         {
-            for (int i = 0; i < CH1.size(); ++i) {
-                CH1[i] /= m_attenuation_CH1;
-                CH1[i] += m_offset_CH1;
-            }
-
-#ifndef DISABLE_SPECTRUM
-            if(eyeDiagram)
-            {
-                // Analog to digital conversion
-                double HYSTERESIS = 0.5;
-                CH1_avg = std::accumulate(CH1.begin(), CH1.end(), 0.0) / CH1.size();
-                QVector<int> CH1_bin(CH1.size());
-                CH1_bin[0] = 0;
-                for (int i = 1; i < CH1.size(); ++i)
-                {
-                    if(CH1_bin[i-1] == 0 && CH1[i] > CH1_avg+HYSTERESIS)
-                        CH1_bin[i] = 1;
-                    else if(CH1_bin[i-1] == 1 && CH1[i] < CH1_avg-HYSTERESIS)
-                        CH1_bin[i] = 0;
-                    else
-                        CH1_bin[i] = CH1_bin[i-1];
-                }
-
-                // Calculate edges
-                QVector<double> CH1_edge(CH1_bin.size());
-                for (int i = 1; i < CH1_bin.size(); ++i)
-                    CH1_edge[i] = std::abs(CH1_bin[i] - CH1_bin[i-1]);
-
-                // Find the index of the peak frequency
-                // Calculate power (frequency) spectrum
-                setWindowingType(1);	// Hann window
-                QVector<double> yf = m_asyncDFT->getPowerSpectrum_dBmV(CH1_edge, m_windowFactorsSum);
-                // Create an index vector excluding the DC component
-                QVector<int> indices(yf.size()-10);
-                std::iota(indices.begin(), indices.end(), 10);
-                // Sort the index vector based on the values in the power spectrum
-                std::sort(indices.begin(), indices.end(),
-                    [&yf](int i, int j) {
-                        return yf[i] < yf[j];
-                    });
-                // Calculate the mininum from the biggest five indices
-                QVector<int> biggestFiveIndices = indices.mid(indices.size() - 5, 5);
-                int peak_idx = *std::min_element(biggestFiveIndices.begin(), biggestFiveIndices.end());
-
-                // Create a cubic spline interpolation function
-                std::vector<double> xf_partial(11);
-                std::vector<double> yf_partial(11);
-                for (int i = 0; i < 11; ++i) {
-                    xf_partial[i] = peak_idx-5+i;
-                    yf_partial[i] = std::abs(yf[xf_partial[i]]);
-                }
-                tk::spline cs(xf_partial, yf_partial);
-
-                // Generate a fine grid of x values to evaluate the cubic spline
-                QVector<double> x_fine(201);
-                QVector<double> y_fine(201);
-                double step = (xf_partial[10] - xf_partial[0]) / 200;
-                for (int i = 0; i < 201; ++i) {
-                    x_fine[i] = xf_partial[0] + i * step;
-                    y_fine[i] = cs(x_fine[i]);
-                }
-
-                // calculate normalized fundamental frequency
-                double *max_it = std::max_element(y_fine.begin(), y_fine.end());
-                peak_idx = std::distance(y_fine.begin(), max_it);
-                double fundamental_frequency_normalized = x_fine[peak_idx]/CH1.size();
-
-                // Calculate samples per symbol and number of symbols
-                samplesPerSymbol = 1 / (2*fundamental_frequency_normalized);
-                numSymbols = std::round(CH1.size()/samplesPerSymbol);
-                samplesPerSymbol = std::round(samplesPerSymbol);
-            }
-#endif
+            // The clock estimate needs a full DFT window
+            if (CH1.size() < m_asyncDFT->n_samples)
+                return;
+            m_eye.update(CH1, internalBuffer_CH1->m_samplesPerSecond, *m_asyncDFT);
         }
+#endif
 
         xmin = (currentVmin < xmin) ? currentVmin : xmin;
         xmax = (currentVmax > xmax) ? currentVmax : xmax;
         broadcastStats(0);
     } else if (CH1_mode == 2) {
-        CH1 = digitalConvert(readData_CH1);
+        digitalConvert(readData_CH1, CH1);
         for (int i = 0; i < CH1.size(); ++i)
-            CH1[i] += m_digitalOffset_CH1;
+            CH1[i] += m_view.digitalOffset_CH1;
+        digitalLevels(zoomChannels[0].high, zoomChannels[0].low);
+        zoomChannels[0].high += m_view.digitalOffset_CH1;
+        zoomChannels[0].low += m_view.digitalOffset_CH1;
     } else if (CH1_mode == -2) {
-        CH1 = fileStreamConvert(readDataFile);
+        fileStreamConvert(readDataFile, CH1);
     }
 
     if (CH2_mode == 1) {
-        CH2 = analogConvert(readData_CH2, 128, AC_CH2, 2);
-#ifndef DISABLE_SPECTRUM
-        if (spectrum) {
-            for (int i = 0; i < CH2.size(); ++i) {
-                CH2[i] /= m_attenuation_CH2;
-                CH2[i] += m_offset_CH2;
-                CH2[i] *= m_windowFactors[i];
-            }
-        } else
-#endif
-        {
-            for (int i = 0; i < CH2.size(); ++i) {
-                CH2[i] /= m_attenuation_CH2;
-                CH2[i] += m_offset_CH2;
-            }
+        analogConvert(readData_CH2, CH2, 128, m_view.AC_CH2 ? &rawSum_CH2 : nullptr, 2, m_view.attenuation_CH2, m_view.offset_CH2);
+        zoomChannels[1].scale = m_lastConvertScale;
+        zoomChannels[1].bias = m_lastConvertBias;
+        if (envelope) {
+            envelopeConvert(m_arena.rawMin_CH2, CH2_min);
+            envelopeConvert(m_arena.rawMax_CH2, CH2_max);
+        }
+        if (persist) {
+            uint32_t windowLength = internalBuffer_CH2->readRaw(m_arena.persistenceRaw, m_view.window, m_view.delay + triggerDelay, kPersistenceMaxSamples);
+            m_persistence.addSamples(m_arena.persistenceRaw, windowLength, m_lastConvertScale, m_lastConvertBias);
         }
 
         ymin = (currentVmin < ymin) ? currentVmin : ymin;
         ymax = (currentVmax > ymax) ? currentVmax : ymax;
         broadcastStats(1);
     } else if (CH2_mode == 2) {
-        CH2 = digitalConvert(readData_CH2);
+        digitalConvert(readData_CH2, CH2);
         for (int i = 0; i < CH2.size(); ++i)
-            CH2[i] += m_digitalOffset_CH2;
+            CH2[i] += m_view.digitalOffset_CH2;
+        digitalLevels(zoomChannels[1].high, zoomChannels[1].low);
+        zoomChannels[1].high += m_view.digitalOffset_CH2;
+        zoomChannels[1].low += m_view.digitalOffset_CH2;
     }
 
 
-    QVector<double> x(GRAPH_SAMPLES);
+    QVector<double>& x = m_arena.x;
+    x.resize(m_view.graphSamples);
     for (int i = 0; i < x.size(); ++i) {
-        x[i] = -(display->window*i)/((double)(GRAPH_SAMPLES-1)) - display->delay;
+        x[i] = -(m_view.window*i)/((double)(m_view.graphSamples-1)) - m_view.delay;
         if (x[i]>0) {
-            CH1[i] = 0;
-            CH2[i] = 0;
+            if (i < CH1.size()) CH1[i] = 0;
+            if (i < CH2.size()) CH2[i] = 0;
+            if (i < CH1_min.size()) CH1_min[i] = CH1_max[i] = 0;
+            if (i < CH2_min.size()) CH2_min[i] = CH2_max[i] = 0;
         }
     }
 
-    updateCursors();
-
-    if (XYmode) {
-        QCPCurve* curve = reinterpret_cast<QCPCurve*>(axes->plottable(0));
-        curve->setData(CH1, CH2);
-        axes->xAxis->setLabel("CH1 (V)");
-        axes->yAxis->setLabel("CH2 (V)");
-        axes->xAxis->setRange(xmin, xmax);
-        axes->yAxis->setRange(ymin, ymax);
+    RenderFrame& frame = m_renderFrames.back();
+#ifndef DISABLE_SPECTRUM
+    // Eye diagram and frequency response frames come through here too
+    bool const correlating = m_view.crossCorrelation && !m_view.freqResp && !m_view.eyeDiagram && CH1_mode == 1 && CH2_mode == 1;
+    if (correlating)
+        crossCorrelationAction(internalBuffer_CH1, internalBuffer_CH2);
+    frame.crossCorrelation = correlating ? m_crossFigures : crossCorrelationFigures();
+    frame.jitter = recoveringClock ? m_clockRecovery.figures() : jitterFigures();
+#endif
+    frame.hasCh2 = CH2_mode != 0;
+    std::swap(frame.ch1Min, CH1_min);
+    std::swap(frame.ch1Max, CH1_max);
+    std::swap(frame.ch2Min, CH2_min);
+    std::swap(frame.ch2Max, CH2_max);
+    frame.freqRespFit = RenderFrame::FitStatus::None;
+    frame.zoomCount = 0;
+
+    frame.xStart = -m_view.delay;
+    frame.xStep = -m_view.window/((double)(m_view.graphSamples-1));
+
+    if (m_view.XYmode) {
+        frame.type = RenderFrame::Type::XY;
+        // The frame's old buffers come back to the arena for the next pass
+        std::swap(frame.x, x);
+        std::swap(frame.ch1, CH1);
+        std::swap(frame.ch2, CH2);
+        frame.xLabel = "CH1 (V)";
+        frame.yLabel = "CH2 (V)";
+        frame.xLower = xmin;
+        frame.xUpper = xmax;
+        frame.yLower = ymin;
+        frame.yUpper = ymax;
 
 #ifndef DISABLE_SPECTRUM
-    } else if (spectrum) {
-        /*Getting array of frequencies for display purposes*/
-        auto f = m_asyncDFT->getFrequencyWindow(internalBuffer_CH1->m_samplesPerSecond);
-
-        /*Creating DFT amplitudes*/
-        auto amplitude = m_asyncDFT->getPowerSpectrum_dBmV(CH1, m_windowFactorsSum);
-        axes->graph(0)->setData(f, amplitude);
-        if (CH2_mode) {
-            auto amplitude = m_asyncDFT->getPowerSpectrum_dBmV(CH2, m_windowFactorsSum);
-            axes->graph(1)->setData(f, amplitude);
+    } else if (m_view.freqResp) {
+        if (m_freqRespDemod.lastBlock() == lockInDemodulator::BlockFit::Bad)
+            frame.freqRespFit = RenderFrame::FitStatus::Bad;
+        else if (m_freqRespDemod.lastBlock() == lockInDemodulator::BlockFit::Good)
+            frame.freqRespFit = RenderFrame::FitStatus::Good;
+
+        frame.type = RenderFrame::Type::FreqResp;
+        frame.xLabel = "Frequency (Hz)";
+        // Deep copies, so the frame never shares storage with the sweep results
+        copyInto(frame.x, m_bodeSweep.frequencies());
+        if (m_view.freqRespType == 0) {
+            // Plot gain response
+            copyInto(frame.ch1, m_bodeSweep.gains());
+            frame.yLabel = "Gain (dB)";
+        } else {
+            // Plot phase response
+            copyInto(frame.ch1, m_bodeSweep.phases());
+            frame.yLabel = "Phase (degree)";
         }
+        frame.xLower = m_view.leftRange;
+        frame.xUpper = m_view.rightRange;
+        frame.yLower = m_view.botRange;
+        frame.yUpper = m_view.topRange;
+    } else if (m_view.eyeDiagram){
+        frame.type = RenderFrame::Type::EyeDiagram;
+        float const* counts = m_eye.counts();
+        frame.persistence.assign(counts, counts + eyeHistogram::kRows * eyeHistogram::kColumns);
+        frame.persistenceColumns = eyeHistogram::kColumns;
+        frame.persistenceRows = eyeHistogram::kRows;
+        frame.persistenceMax = m_eye.maxCount();
+        frame.persistenceKeyLower = -m_eye.symbolPeriod();
+        frame.persistenceKeyUpper = m_eye.symbolPeriod();
+        frame.persistenceValueLower = m_eye.vBottom();
+        frame.persistenceValueUpper = m_eye.vTop();
+        frame.ch1.clear();
+        frame.ch2.clear();
+
+        frame.xLabel = "Time (sec)";
+        frame.yLabel = "Voltage (V)";
+        frame.xLower = -m_eye.symbolPeriod();
+        frame.xUpper = m_eye.symbolPeriod();
+        frame.yLower = m_eye.vBottom();
+        frame.yUpper = m_eye.vTop();
+#endif
 
-        axes->xAxis->setLabel("Frequency (Hz)");
-        axes->yAxis->setLabel("Relative Power (dBmV)");
-        axes->xAxis->setRange(display->leftRange, display->rightRange);
-        axes->yAxis->setRange(display->botRange, display->topRange);
+    } else {
+        frame.type = RenderFrame::Type::Scope;
+        std::swap(frame.x, x);
+        std::swap(frame.ch1, CH1);
+        std::swap(frame.ch2, CH2);
+        frame.xLabel = "Time (sec)";
+        frame.yLabel = "Voltage (V)";
+        frame.xLower = -m_view.window - m_view.delay;
+        frame.xUpper = -m_view.delay;
+        frame.yLower = m_view.topRange;
+        frame.yUpper = m_view.botRange;
+
+        // The file buffer has its own reader, so zoom views are live only
+        if (CH1_mode != -2)
+            m_zoomViews.render(frame, m_view.zooms, m_view.zoomCount, zoomChannels, m_view.graphSamples, triggerDelay, envelope);
+
+        if (persist) {
+            float const* counts = m_persistence.counts();
+            frame.persistence.assign(counts, counts + persistenceHistogram::kRows * persistenceHistogram::kColumns);
+            frame.persistenceColumns = persistenceHistogram::kColumns;
+            frame.persistenceRows = persistenceHistogram::kRows;
+            frame.persistenceMax = m_persistence.maxCount();
+            frame.persistenceKeyLower = -m_persistence.window() - m_persistence.delay();
+            frame.persistenceKeyUpper = -m_persistence.delay();
+            frame.persistenceValueLower = m_persistence.vBottom();
+            frame.persistenceValueUpper = m_persistence.vTop();
+        } else {
+            frame.persistence.clear();
+        }
+    }
 
-    } else if (freqResp) {
-        if (!paused_CH1) {
-            // Using least squares, fit a sinusoid to measured samples
-            int nof_elements = CH1.size();
-            double delta = 2 * PI / (nof_elements - 1);
-            double amp1, amp2, gain, gain_avg_db, phase1, phase2, phase_diff, phase_avg, norm_rms1, norm_rms2;
-            static double gain_sum = 0, phase_sum = 0;
-            static int freqResp_cnt = 0, err_cnt = 0;
-            Eigen::MatrixXf A(nof_elements, 3);
-            Eigen::VectorXf b1(nof_elements), b2(nof_elements), x1(3), x2(3), r1(nof_elements), r2(nof_elements);
-            for (int i = 0; i < nof_elements; i++) {
-                A(i, 0) = 1;
-                A(i, 1) = std::sin(i*delta);
-                A(i, 2) = std::cos(i*delta);
-                b1(i) = CH1[i];
-                b2(i) = CH2[i];
-            }
+    publishFrame();
+}
 
-            // Solve the least squares solution Ax=b (using QR decomposition)
-            x1 = A.colPivHouseholderQr().solve(b1);
-            x2 = A.colPivHouseholderQr().solve(b2);
-
-            // Calculate amplitude and phase
-            amp1 = hypot(x1(1), x1(2));
-            amp2 = hypot(x2(1), x2(2));
-            phase1 = atan2(-x1(2), x1(1)) * 180.0 / PI;
-            phase2 = atan2(-x2(2), x2(1)) * 180.0 / PI;
-
-            // Calculate normalized fitting risidual
-            r1 = A * x1 - b1;
-            r2 = A * x2 - b2;
-            norm_rms1 = sqrt((r1/amp1).cwiseAbs2().mean());
-            norm_rms2 = sqrt((r2/amp2).cwiseAbs2().mean());
-            // std::cout << "rms1 = " << norm_rms1 << " rms2 = " << norm_rms2 << "\n";
-
-            // If there is too much error in the least square fitting, discard current trace
-            if (norm_rms1 > 0.1 || norm_rms2 > 2) {
-                err_cnt++;
-                freqRespStatusMark->setText("☒");
-                freqRespStatusMark->setColor(Qt::red);
-            } else {
-                freqRespStatusMark->setText("☑");
-                freqRespStatusMark->setColor(Qt::green);
-
-                // Calculate gain, and phase difference
-                gain = amp2 / amp1;
-                phase_diff = phase2 - phase1;
-                phase_diff = phase_diff > 180 ? phase_diff - 360 : (phase_diff < -180 ? phase_diff + 360 : phase_diff);
-
-                // Calculate average gain (dB) and average phase
-                if (freqResp_cnt < 10) {
-                    gain_sum += gain;
-                    phase_sum += phase_diff;
-                } else {
-                    gain_avg_db = 20 * log10(gain_sum/freqResp_cnt);
-                    phase_avg = phase_sum/freqResp_cnt;
-                    // std::cout << "gain_dB = " << gain_avg_db << " phase = " << phase_avg << "\n";
-
-                    // Search first occurrence
-                    int index = m_freqRespFreq.indexOf(freqValue_CH1->value());
-                    if (index != -1) {
-                        // Update if record exists
-                        m_freqRespGain[index] = gain_avg_db;
-                        m_freqRespPhase[index] = phase_avg;
-                    } else {
-                        // Append if record does not exist
-                        m_freqRespFreq.append(freqValue_CH1->value());
-                        m_freqRespGain.append(gain_avg_db);
-                        m_freqRespPhase.append(phase_avg);
-                    }
-                }
-                freqResp_cnt ++;
-            }
+#ifndef DISABLE_SPECTRUM
+// The spectrum is transformed on m_asyncDFT's workers, straight from the
+// newest samples in the buffers.  Each frame starts the next transform if
+// the last one has finished, and is only drawn when a new one is ready.
+void isoDriver::spectrumAction(isoBuffer *internalBuffer_CH1, isoBuffer *internalBuffer_CH2, char CH1_mode, char CH2_mode)
+{
+    bool const analog_CH1 = CH1_mode == -1 || CH1_mode == 1;
+    if (!analog_CH1)
+        return;
 
-            // Prepare for next cycle
-            if (freqResp_cnt > 10 || err_cnt > 10) {
-                // Reset frequency response vectors, when a user updates min/max/step parameters
-                if (m_freqRespFlag) {
-                    m_freqRespFreq.clear();
-                    m_freqRespGain.clear();
-                    m_freqRespPhase.clear();
-                    m_freqRespFlag = false;
-                }
+    RenderFrame& frame = m_renderFrames.back();
+    int const spectrumSize = m_asyncDFT->takeSpectra(frame.ch1, frame.ch2, &frame.distortion);
+
+    int const channels = CH2_mode == 1 ? 2 : 1;
+    isoBuffer const* buffers[2] = {internalBuffer_CH1, internalBuffer_CH2};
+    bool const AC[2] = {m_view.AC_CH1, m_view.AC_CH2};
+    double const attenuation[2] = {m_view.attenuation_CH1, m_view.attenuation_CH2};
+    double const offset[2] = {m_view.offset_CH1, m_view.offset_CH2};
+
+    // Same volts as analogConvert() would give
+    AsyncDFT::ChannelScale scales[2];
+    for (int i = 0; i < channels; ++i) {
+        conversionTable const& conversion = sampleConversion(i + 1, 128);
+        scales[i].scale = conversion.voltsPerCount() / attenuation[i];
+        scales[i].bias = (AC[i] ? 0 : conversion.offset() / attenuation[i]) + offset[i];
+        scales[i].ac = AC[i];
+    }
+
+    // Everything since the last call goes into the waterfall, however many frames were skipped
+    if (m_view.waterfall)
+        m_spectrogram->update(internalBuffer_CH1, scales[0].scale, scales[0].bias);
+
+    if (m_asyncDFT->idle()) {
+        // Long averages may want more than the buffers hold; they get as many transforms as fit
+        uint32_t needed = m_asyncDFT->samplesNeeded();
+        for (int i = 0; i < channels; ++i)
+            needed = std::min(needed, buffers[i]->m_bufferLen);
+        bool filled = true;
+        for (int i = 0; i < channels; ++i)
+            filled &= buffers[i]->readLatest(m_asyncDFT->input(i, needed), needed) == needed;
+        // Until the buffers hold a whole request there is nothing to show
+        if (filled)
+            m_asyncDFT->start(channels, needed, scales);
+    }
+
+    if (!spectrumSize)
+        return;
 
-                // Select new frequency
-                double freqValue = freqValue_CH1->value() + m_freqRespStep;
-                if (freqValue > m_freqRespMax || freqValue < m_freqRespMin || m_freqRespFreq.size() == 0)
-                    freqValue = m_freqRespMin;
-                freqValue_CH1->setValue(freqValue);
-
-                // Reset iterators
-                gain_sum = 0;
-                phase_sum = 0;
-                freqResp_cnt = 0;
-                err_cnt = 0;
-            }
-        }
+    if (m_view.waterfall) {
+        m_spectrogram->copyHistory(frame.waterfall, m_view.botRange);
+        frame.waterfallNyquist = internalBuffer_CH1->m_samplesPerSecond / 2.0;
+    } else {
+        frame.waterfall.clear();
+    }
+
+    frame.type = RenderFrame::Type::Spectrum;
+    frame.hasCh2 = !frame.ch2.isEmpty();
+    frame.ch1Min.clear();
+    frame.ch1Max.clear();
+    frame.ch2Min.clear();
+    frame.ch2Max.clear();
+    frame.zoomCount = 0;
+    frame.freqRespFit = RenderFrame::FitStatus::None;
+
+    /*Frequencies for display purposes*/
+    frame.xStart = 0;
+    frame.xStep = (double)internalBuffer_CH1->m_samplesPerSecond / spectrumSize;
+    for (distortionFigures& figures : frame.distortion)
+        figures.frequency *= frame.xStep;
+    frame.xLabel = "Frequency (Hz)";
+    frame.yLabel = "Relative Power (dBmV)";
+    frame.xLower = m_view.leftRange;
+    frame.xUpper = m_view.rightRange;
+    frame.yLower = m_view.botRange;
+    frame.yUpper = m_view.topRange;
+    publishFrame();
+}
+
+// CH2 against CH1 over the newest window's worth of both, up to
+// crossCorrelator::kMaxSamples, on m_crossCorrelator's worker.  Each frame
+// takes the last figures and starts again if there is anything new, so a
+// paused capture is only measured once.
+void isoDriver::crossCorrelationAction(isoBuffer *internalBuffer_CH1, isoBuffer *internalBuffer_CH2)
+{
+    if (!m_crossCorrelator->idle())
+        return;
+    m_crossCorrelator->takeFigures(m_crossFigures);
 
-        axes->xAxis->setLabel("Frequency (Hz)");
-        if (m_freqRespType == 0) {
-            // Plot gain response
-            axes->graph(0)->setData(m_freqRespFreq, m_freqRespGain);
-            axes->yAxis->setLabel("Gain (dB)");
-        } else {
-            // Plot phase response
-            axes->graph(0)->setData(m_freqRespFreq, m_freqRespPhase);
-            axes->yAxis->setLabel("Phase (degree)");
-        }
-        axes->xAxis->setRange(display->leftRange, display->rightRange);
-        axes->yAxis->setRange(display->botRange, display->topRange);
-        axes->graph(1)->clearData();
-    } else if (eyeDiagram){
-
-        int numOutputSamples = numSymbols*samplesPerSymbol;
-
-        // Resample at integer samplesPerSymbol
-        QVector<double> CH1_resampled(numOutputSamples);
-        double inputSize = static_cast<double>(CH1.size());
-        double outputSize = static_cast<double>(numOutputSamples);
-        for (int i = 0; i < numOutputSamples; ++i) {
-            double idx = (i + 0.5) * (inputSize-1) / outputSize;
-            int lb_idx = static_cast<size_t>(idx);
-            int ub_idx = lb_idx + 1;
-            double fraction = idx - lb_idx;
-
-            // Interpolate between data points
-            CH1_resampled[i] = CH1[lb_idx] * (1.0 - fraction) + CH1[ub_idx] * fraction;
-        }
+    int const windowSamples = int(m_view.window * internalBuffer_CH1->m_samplesPerSecond);
+    int const count = std::max(int(crossCorrelator::kMinSamples), std::min(windowSamples, int(crossCorrelator::kMaxSamples)));
+    if (internalBuffer_CH1->m_sampleCount == m_crossCorrelatedAt && count == m_crossCorrelatedCount)
+        return;
 
-        // Analog to digital conversion
-        QVector<double> CH1_bin(CH1_resampled.size());
-        for (int i = 0; i < CH1_resampled.size(); ++i)
-            CH1_bin[i] = (CH1_resampled[i] > CH1_avg) ? 1 : 0;
+    // Until the buffers hold a whole window there is nothing to measure
+    bool filled = internalBuffer_CH1->readLatest(m_crossCorrelator->input(0, count), count) == uint32_t(count);
+    filled &= internalBuffer_CH2->readLatest(m_crossCorrelator->input(1, count), count) == uint32_t(count);
+    if (!filled)
+        return;
+    m_crossCorrelatedAt = internalBuffer_CH1->m_sampleCount;
+    m_crossCorrelatedCount = count;
+    m_crossCorrelator->start(count, internalBuffer_CH1->m_samplesPerSecond);
+}
 
-        // Calculate edges
-        QVector<double> CH1_edge(CH1_bin.size());
-        for (int i = 1; i < CH1_bin.size(); ++i)
-            CH1_edge[i] = std::abs(CH1_bin[i] - CH1_bin[i-1]);
+// Frequency response, every frame whatever the display is doing.  The
+// lock-in measures the point the generator is at; once it is done, the
+// sweep picks the next one and the GUI thread is asked to retune the
+// generator, which shows up here as a new m_view.freqRespFrequency.
+void isoDriver::freqRespAction(isoBuffer *internalBuffer_CH1, isoBuffer *internalBuffer_CH2)
+{
+    if (m_view.freqRespWaveLength != m_bodeSweep.plan().waveLength) {
+        // Another waveform plays each frequency slightly differently
+        allocationExempt exempt;
+        bodeSweep::Plan plan = m_bodeSweep.plan();
+        plan.waveLength = m_view.freqRespWaveLength;
+        m_bodeSweep.setPlan(plan);
+    }
 
-        // Clock Recovery using digital PLL
-        uint16_t NCO_BIAS  = (1l << 16) / samplesPerSymbol;
-        uint16_t PHASE_TARGET = 300 * (1l << 16) / 360;
+    if (m_view.freqRespFrequency != m_freqRespDemod.frequency())
+        m_freqRespDemod.reset(m_view.freqRespFrequency);
 
-        uint16_t nco_phase = 0;
-        int32_t nco_word = 0;
+    m_freqRespDemod.update(internalBuffer_CH1, internalBuffer_CH2,
+                           sampleConversion(1, 128).voltsPerCount() / m_view.attenuation_CH1,
+                           sampleConversion(2, 128).voltsPerCount() / m_view.attenuation_CH2);
+    if (!m_freqRespDemod.finished())
+        return;
 
-        constexpr int16_t Kp = 6; // bit shift division
-        constexpr int16_t Ki = 9; // bit shift division
-        int32_t integrator = 0;
+    // A new point on the sweep may grow the result vectors
+    allocationExempt exempt;
+    bool const converged = m_freqRespDemod.converged();
+    double const next = m_bodeSweep.finishPoint(m_view.freqRespFrequency, converged,
+                                                converged ? m_freqRespDemod.gain_dB() : 0,
+                                                converged ? m_freqRespDemod.phaseDegrees() : 0);
 
-        int32_t error = 0;
-        QVector<int> error_abs;
-        int32_t moving_avg_size = 5 * samplesPerSymbol;
-        QVector<double> error_avg_list;
+    // Measure again from scratch, here or at the next frequency
+    m_freqRespDemod.reset(m_view.freqRespFrequency);
+    if (next != m_view.freqRespFrequency)
+        emit freqRespFrequencyRequested(next);
+}
+#endif
 
-        // digital PLL Clock Recovery Loop
-        for (int i = 1; i < CH1_edge.size(); ++i)
-        {
-            // Edge detection
-            if (CH1_edge[i])
-            {
-                error = (int32_t)PHASE_TARGET - nco_phase;
-                integrator += error;
-                nco_word = (error >> Kp) + (integrator >> Ki);
-            }
-            error_abs.append(std::abs(error));
-            nco_phase += (nco_word + NCO_BIAS);
+void isoDriver::multimeterAction(){
+    allocationCheck check("isoDriver::multimeterAction", m_framesProcessed > kArenaWarmupFrames);
 
-            // Store the average phase error
-            if(i > moving_avg_size)
-            {
-                double error_avg = std::accumulate(error_abs.end()-moving_avg_size, error_abs.end(), 0.0) / moving_avg_size;
-                error_avg_list.append(error_avg);
-            }
+    isoTemp_short = (short *)isoTemp;
+    if(!m_view.paused_multimeter){
+        for (unsigned int i=0;i<(length/ADC_SPF);i++){
+            internalBuffer375_CH1->writeBuffer_short(&isoTemp_short[ADC_SPF/2*i], ADC_SPF/2-1);  //Offset because the first 8 bytes of the array contain the length (no samples!!)!
         }
+    }
 
-        // After PLL is locked (small average error), it can loose lock due to noise or other disturbances.
-        // Hence, we need to find a segment where the average error is below a given threshold
-        // for a given number of samples.
-        int N = 10000;
-        double error_threshold = 100.0;
-        int counter = 0;
-        for (int i = 0; i < error_avg_list.size(); ++i)
-        {
-            if (error_avg_list[i] < error_threshold) {
-                counter += 1;
-                if (counter == N)
-                {
-                    double *max_it = std::max_element(CH1_edge.begin()+i-N, CH1_edge.end());
-                    int idx = std::distance(CH1_edge.begin(), max_it) + int(samplesPerSymbol/2);
-                    CH1_resampled = CH1_resampled.mid(idx, N);
-                    break;
-                }
-            } else {
-                counter = 0;  // Reset counter if value is not less than threshold
-            }
+    double triggerDelay = 0;
+    if (m_view.triggerEnabled)
+    {
+        triggerDelay = internalBuffer375_CH1->getDelayedTriggerPoint(m_view.window) - m_view.window;
+
+        if (triggerDelay < 0)
+            triggerDelay = 0;
+    }
+
+    if(m_view.singleShotEnabled && (triggerDelay != 0))
+    {
+        allocationExempt exempt;
+        singleShotTriggered(1);
+    }
+
+    m_displayCounter = (m_displayCounter + 1) % m_view.displayStride;
+    if (m_displayCounter != 0)
+        return;
+
+    std::vector<short>& readData_CH1 = m_arena.raw_CH1;
+    QVector<double>& CH1 = m_arena.volts_CH1;
+    internalBuffer375_CH1->readBuffer(readData_CH1, m_view.window, m_view.graphSamples, false, m_view.delay + triggerDelay);
+    analogConvert(readData_CH1, CH1, 2048, nullptr, 1);  //No AC coupling!
+
+    QVector<double>& x = m_arena.x;
+    x.resize(CH1.size());
+    for (int i = 0; i < x.size(); ++i) {
+        x[i] = -(m_view.window*i)/((double)(m_view.graphSamples-1)) - m_view.delay;
+        if (x[i]>0) {
+            CH1[i] = 0;
         }
+    }
 
-        // Plot the overlaid segments
-        int nof_symbols = std::min(int(CH1_resampled.size()/samplesPerSymbol), 96);
-        for (int i = 0; i <= nof_symbols-2; ++i) {
-           QVector<double> x(2 * samplesPerSymbol);
-           QVector<double> y(2 * samplesPerSymbol);
-           for (int j = 0; j < 2 * samplesPerSymbol; ++j) {
-               x[j] = (j - samplesPerSymbol)/internalBuffer_CH1->m_samplesPerSecond;
-               y[j] = CH1_resampled[i*samplesPerSymbol + j];
-            }
-            axes->graph(6+i)->setData(x, y);
+    RenderFrame& frame = m_renderFrames.back();
+    frame.type = RenderFrame::Type::Multimeter;
+    frame.xStart = -m_view.delay;
+    frame.xStep = -m_view.window/((double)(m_view.graphSamples-1));
+    std::swap(frame.x, x);
+    std::swap(frame.ch1, CH1);
+    frame.hasCh2 = false;
+    frame.xLabel = "Time (sec)";
+    frame.yLabel = "Voltage (V)";
+    frame.xLower = -m_view.window - m_view.delay;
+    frame.xUpper = -m_view.delay;
+    frame.yLower = m_view.topRange;
+    frame.yUpper = m_view.botRange;
+    frame.freqRespFit = RenderFrame::FitStatus::None;
+    frame.zoomCount = 0;
+    publishFrame();
+
+    multimeterStats();
+}
+
+// Trace data stays in the RenderFrame and is drawn from there.  The front
+// frame isn't touched by the processing thread until the next
+// m_renderFrames.update(), after which renderFrame() re-points (or clears)
+// every trace graph before anything can be replotted.
+static void plotTrace(QCPGraph* graph, QVector<double> const& y, double xStart, double xStep)
+{
+#if QCP_VER == 1
+    static_cast<frameGraph*>(graph)->setFrameData(y.constData(), y.size(), xStart, xStep);
+#else
+    QVector<double> x(y.size());
+    for (int i = 0; i < x.size(); ++i)
+        x[i] = xStart + i*xStep;
+    graph->setData(x, y);
+#endif
+}
+
+// Peak detect band in place of a trace just given to plotTrace().
+// QCP2 builds draw the plain trace instead.
+static void plotEnvelope(QCPGraph* graph, QVector<double> const& lower, QVector<double> const& upper)
+{
+#if QCP_VER == 1
+    static_cast<frameGraph*>(graph)->setFrameEnvelope(lower.constData(), upper.constData());
+#else
+    Q_UNUSED(graph)
+    Q_UNUSED(lower)
+    Q_UNUSED(upper)
+#endif
+}
+
+static void plotTrace(QCPGraph* graph, QVector<double> const& x, QVector<double> const& y)
+{
+#if QCP_VER == 1
+    static_cast<frameGraph*>(graph)->setFrameData(x.constData(), y.constData(), std::min(x.size(), y.size()));
+#else
+    graph->setData(x, y);
+#endif
+}
+
+#ifndef DISABLE_SPECTRUM
+// The distortion label over the spectrum, a few lines per channel
+static QString distortionText(RenderFrame const& frame)
+{
+    QString text;
+    for (int i = 0; i < (frame.hasCh2 ? 2 : 1); ++i) {
+        distortionFigures const& figures = frame.distortion[i];
+        if (i > 0)
+            text += "\n";
+        if (!figures.valid) {
+            text += QString::asprintf("CH%d: no clear fundamental", i + 1);
+            continue;
         }
+        text += QString::asprintf("CH%d: %.2f Hz, %.4f V RMS\n"
+                                  "THD   %6.1f dB  THD+N %6.1f dB\n"
+                                  "SNR   %6.1f dB  SINAD %6.1f dB\n"
+                                  "ENOB  %6.2f bits",
+                                  i + 1, figures.frequency, figures.amplitude,
+                                  figures.thd, figures.thdPlusNoise,
+                                  figures.snr, figures.sinad, figures.enob);
+    }
+    return text;
+}
 
-        // plot the eye diagram
-        axes->xAxis->setLabel("Time (samples)");
-        axes->yAxis->setLabel("Voltage (V)");
-        axes->xAxis->setRange(-samplesPerSymbol/internalBuffer_CH1->m_samplesPerSecond, samplesPerSymbol/internalBuffer_CH1->m_samplesPerSecond);
-        axes->yAxis->setRange(std::round(*std::min_element(CH1_resampled.begin(), CH1_resampled.end()))-1, std::round(*std::max_element(CH1_resampled.begin(), CH1_resampled.end()))+1);
+// The cross-correlation label over the scope
+static QString crossCorrelationText(crossCorrelationFigures const& figures)
+{
+    if (!figures.samples)
+        return "CH2 vs CH1: waiting for both channels in analog mode";
+    if (!figures.valid)
+        return "CH2 vs CH1: no signal on one channel";
+    siprint delay("s", figures.delay);
+    siprint frequency("Hz", figures.frequency);
+    return QString::asprintf("CH2 vs CH1 over %d samples\n"
+                             "Delay  %s  (r = %.3f)\n"
+                             "Phase  %+.1f deg at %s\n"
+                             "Coherence  %.3f",
+                             figures.samples, delay.printVal(), figures.correlation,
+                             figures.phase, frequency.printVal(), figures.coherence);
+}
+
+// The jitter label over the scope
+static QString jitterText(jitterFigures const& figures)
+{
+    if (figures.unitInterval <= 0)
+        return "CH1 jitter: looking for edges";
+    siprint unitInterval("s", figures.unitInterval);
+    if (!figures.locked || !figures.edges)
+        return QString::asprintf("CH1 jitter: locking on, UI %s", unitInterval.printVal());
+    siprint rms("s", figures.rms);
+    siprint peakToPeak("s", figures.peakToPeak);
+    return QString::asprintf("CH1 jitter over %d edges\n"
+                             "UI  %s\n"
+                             "RMS  %s (%.3f UI)\n"
+                             "Pk-pk  %s (%.3f UI)",
+                             figures.edges, unitInterval.printVal(),
+                             rms.printVal(), figures.rms / figures.unitInterval,
+                             peakToPeak.printVal(), figures.peakToPeak / figures.unitInterval);
+}
+#endif
+
+// GUI thread.  Draws the newest frame published by the processing thread.
+void isoDriver::renderFrame()
+{
+    m_renderScheduled = false;
+    if (!m_renderFrames.update())
+        return;
 
+    QElapsedTimer timer;
+    timer.start();
+
+    RenderFrame const& frame = m_renderFrames.front();
+    m_triggerFrequency = frame.triggerFrequency;
+
+    updateCursors();
+
+#ifndef DISABLE_SPECTRUM
+    bool const distortionVisible = m_distortionShown && frame.type == RenderFrame::Type::Spectrum;
+    if (distortionVisible)
+        distortionLabel->setText(distortionText(frame));
+    distortionLabel->setVisible(distortionVisible);
+    bool const crossCorrelationVisible = m_crossCorrelationShown && (frame.type == RenderFrame::Type::Scope || frame.type == RenderFrame::Type::XY);
+    if (crossCorrelationVisible)
+        crossCorrelationLabel->setText(crossCorrelationText(frame.crossCorrelation));
+    crossCorrelationLabel->setVisible(crossCorrelationVisible);
+    bool const jitterVisible = m_jitterShown && (frame.type == RenderFrame::Type::Scope || frame.type == RenderFrame::Type::XY
+                                                 || frame.type == RenderFrame::Type::EyeDiagram);
+    if (jitterVisible)
+        jitterLabel->setText(jitterText(frame.jitter));
+    jitterLabel->setVisible(jitterVisible);
+#endif
+
+    switch (frame.type)
+    {
+    case RenderFrame::Type::XY:
+    {
+        QCPCurve* curve = reinterpret_cast<QCPCurve*>(axes->plottable(0));
+        curve->setData(frame.ch1, frame.ch2);
         axes->graph(0)->clearData();
         axes->graph(1)->clearData();
+        break;
+    }
+    case RenderFrame::Type::Scope:
+    case RenderFrame::Type::Spectrum:
+    case RenderFrame::Type::Multimeter:
+        plotTrace(axes->graph(0), frame.ch1, frame.xStart, frame.xStep);
+        if (frame.hasCh2)
+            plotTrace(axes->graph(1), frame.ch2, frame.xStart, frame.xStep);
+        else
+            axes->graph(1)->clearData();
+
+        if (frame.type == RenderFrame::Type::Scope) {
+            if (!frame.ch1Min.isEmpty() && frame.ch1Min.size() == frame.ch1.size())
+                plotEnvelope(axes->graph(0), frame.ch1Min, frame.ch1Max);
+            if (frame.hasCh2 && !frame.ch2Min.isEmpty() && frame.ch2Min.size() == frame.ch2.size())
+                plotEnvelope(axes->graph(1), frame.ch2Min, frame.ch2Max);
+        }
+        break;
+#ifndef DISABLE_SPECTRUM
+    case RenderFrame::Type::FreqResp:
+        plotTrace(axes->graph(0), frame.x, frame.ch1);
+        axes->graph(1)->clearData();
+        if (frame.freqRespFit == RenderFrame::FitStatus::Bad) {
+            freqRespStatusMark->setText("☒");
+            freqRespStatusMark->setColor(Qt::red);
+        } else if (frame.freqRespFit == RenderFrame::FitStatus::Good) {
+            freqRespStatusMark->setText("☑");
+            freqRespStatusMark->setColor(Qt::green);
+        }
+        break;
+    case RenderFrame::Type::EyeDiagram:
+        // Drawn as a density map, below
+        axes->graph(0)->clearData();
+        axes->graph(1)->clearData();
+        break;
+#else
+    default:
+        break;
 #endif
+    }
 
-    } else {
-        axes->graph(0)->setData(x,CH1);
-        if (CH2_mode) axes->graph(1)->setData(x,CH2);
-        axes->xAxis->setLabel("Time (sec)");
-        axes->yAxis->setLabel("Voltage (V)");
-        axes->xAxis->setRange(-display->window - display->delay, -display->delay);
-        axes->yAxis->setRange(display->topRange, display->botRange);
+    for (int i = 0; i < int(m_zoomAxes.size()); ++i) {
+        zoomAxes& zoom = m_zoomAxes[i];
+        bool const shown = i < frame.zoomCount;
+        zoom.marker->setVisible(shown);
+        if (!shown) {
+            zoom.ch1->clearData();
+            zoom.ch2->clearData();
+            continue;
+        }
 
-        for (int i = 0; i <= 94; ++i)
-            axes->graph(6+i)->clearData();
+        RenderFrame::ZoomTrace const& trace = frame.zooms[i];
+        plotTrace(zoom.ch1, trace.ch1, trace.xStart, trace.xStep);
+        if (!trace.ch1Min.isEmpty() && trace.ch1Min.size() == trace.ch1.size())
+            plotEnvelope(zoom.ch1, trace.ch1Min, trace.ch1Max);
+        if (frame.hasCh2) {
+            plotTrace(zoom.ch2, trace.ch2, trace.xStart, trace.xStep);
+            if (!trace.ch2Min.isEmpty() && trace.ch2Min.size() == trace.ch2.size())
+                plotEnvelope(zoom.ch2, trace.ch2Min, trace.ch2Max);
+        } else {
+            zoom.ch2->clearData();
+        }
+        zoom.rect->axis(QCPAxis::atBottom)->setRange(trace.xLower, trace.xUpper);
+        zoom.rect->axis(QCPAxis::atLeft)->setRange(frame.yLower, frame.yUpper);
+        zoom.marker->topLeft->setCoords(trace.xLower, 0);
+        zoom.marker->bottomRight->setCoords(trace.xUpper, 1);
+    }
+
+    bool const showPersistence = (frame.type == RenderFrame::Type::Scope || frame.type == RenderFrame::Type::EyeDiagram)
+                                 && !frame.persistence.empty();
+    if (persistenceMap) {
+        persistenceMap->setVisible(showPersistence);
+        if (showPersistence) {
+            int const columns = frame.persistenceColumns;
+            int const rows = frame.persistenceRows;
+            QCPColorMapData* data = persistenceMap->data();
+            data->setSize(columns, rows);
+            data->setRange(QCPRange(frame.persistenceKeyLower, frame.persistenceKeyUpper),
+                           QCPRange(frame.persistenceValueLower, frame.persistenceValueUpper));
+            float const* counts = frame.persistence.data();
+            for (int row = 0; row < rows; ++row)
+                for (int column = 0; column < columns; ++column)
+                    data->setCell(column, row, *counts++);
+            persistenceMap->setDataRange(QCPRange(0, std::max(frame.persistenceMax, 1.f)));
+        }
     }
 
-    if(snapshotEnabled_CH1){
 #ifndef DISABLE_SPECTRUM
-        if (!spectrum && !freqResp)
+    bool const showWaterfall = frame.type == RenderFrame::Type::Spectrum && !frame.waterfall.empty();
+    if (m_waterfallMap) {
+        m_waterfallMap->setVisible(showWaterfall);
+        if (showWaterfall) {
+            // Oldest row at the bottom, newest at time 0 along the top
+            int const columns = spectrogram::kBins;
+            int const rows = spectrogram::kRows;
+            QCPColorMapData* data = m_waterfallMap->data();
+            data->setSize(columns, rows);
+            data->setRange(QCPRange(0, frame.waterfallNyquist),
+                           QCPRange(-double(rows) / spectrogram::kRowsPerSecond, 0));
+            float const* levels = frame.waterfall.data();
+            for (int row = 0; row < rows; ++row)
+                for (int column = 0; column < columns; ++column)
+                    data->setCell(column, row, *levels++);
+            // Coloured over the spectrum's own vertical range
+            m_waterfallMap->setDataRange(QCPRange(frame.yLower, frame.yUpper));
+            m_waterfallRect->axis(QCPAxis::atBottom)->setRange(frame.xLower, frame.xUpper);
+        }
+    }
 #endif
+
+    axes->xAxis->setLabel(frame.xLabel);
+    axes->yAxis->setLabel(frame.yLabel);
+    axes->xAxis->setRange(frame.xLower, frame.xUpper);
+    axes->yAxis->setRange(frame.yLower, frame.yUpper);
+
+    bool timeDomain = frame.type == RenderFrame::Type::Scope || frame.type == RenderFrame::Type::XY;
+
+    if(snapshotEnabled_CH1){
+        if (timeDomain)
         {
             snapshotFile_CH1->open(QIODevice::WriteOnly);
             snapshotFile_CH1->write("t, v\n");
 
             char tempchar[32];
-            for(int i=0; i<GRAPH_SAMPLES; i++){
-                snprintf(tempchar, sizeof tempchar, "%f, %f\n", x.at(i), CH1.at(i));
+            for(int i=0; i<frame.x.size(); i++){
+                snprintf(tempchar, sizeof tempchar, "%f, %f\n", frame.x.at(i), frame.ch1.at(i));
                 snapshotFile_CH1->write(tempchar);
             }
             snapshotFile_CH1->close();
@@ -1308,18 +1848,14 @@ void isoDriver::frameActionGeneric(char CH1_mode, char CH2_mode)
     }
 
     if(snapshotEnabled_CH2){
-#ifndef DISABLE_SPECTRUM
-        if (!spectrum && !freqResp && CH2_mode)
-#else
-        if (CH2_mode)
-#endif
+        if (timeDomain && frame.hasCh2)
         {
             snapshotFile_CH2->open(QIODevice::WriteOnly);
             snapshotFile_CH2->write("t, v\n");
 
             char tempchar[32];
-            for(int i=0; i<GRAPH_SAMPLES; i++){
-                snprintf(tempchar, sizeof tempchar, "%f, %f\n", x.at(i), CH2.at(i));
+            for(int i=0; i<frame.x.size(); i++){
+                snprintf(tempchar, sizeof tempchar, "%f, %f\n", frame.x.at(i), frame.ch2.at(i));
                 snapshotFile_CH2->write(tempchar);
             }
             snapshotFile_CH2->close();
@@ -1329,47 +1865,125 @@ void isoDriver::frameActionGeneric(char CH1_mode, char CH2_mode)
     }
 
     axes->replot();
+
+    qint64 processingNs = m_processingNs.exchange(0);
+    if (m_autoFrameRate)
+        m_governor.frameDone(processingNs, timer.nsecsElapsed());
 }
 
-void isoDriver::multimeterAction(){
-    isoTemp_short = (short *)isoTemp;
-    if(!paused_multimeter){
-        for (unsigned int i=0;i<(length/ADC_SPF);i++){
-            internalBuffer375_CH1->writeBuffer_short(&isoTemp_short[ADC_SPF/2*i], ADC_SPF/2-1);  //Offset because the first 8 bytes of the array contain the length (no samples!!)!
-        }
-    }
+void isoDriver::setAutoFrameRate(bool enabled)
+{
+    m_autoFrameRate = enabled;
+    m_governor.reset();
+}
 
-    double triggerDelay = 0;
-    if (triggerEnabled)
-    {
-        triggerDelay = internalBuffer375_CH1->getDelayedTriggerPoint(display->window) - display->window;
+void isoDriver::addZoomView()
+{
+    if (!canAddZoomView())
+        return;
 
-        if (triggerDelay < 0)
-            triggerDelay = 0;
+    zoomAxes zoom;
+    zoom.rect = new QCPAxisRect(axes);
+    axes->plotLayout()->addElement(axes->plotLayout()->rowCount(), 0, zoom.rect);
+    QCPAxis *xAxis = zoom.rect->axis(QCPAxis::atBottom);
+    QCPAxis *yAxis = zoom.rect->axis(QCPAxis::atLeft);
+    // Styled like the main axes
+    QCPAxis *mainAxis[2] = {axes->xAxis, axes->yAxis};
+    QCPAxis *zoomAxis[2] = {xAxis, yAxis};
+    for (int i = 0; i < 2; ++i) {
+        zoomAxis[i]->setBasePen(mainAxis[i]->basePen());
+        zoomAxis[i]->setTickPen(mainAxis[i]->tickPen());
+        zoomAxis[i]->setSubTickPen(mainAxis[i]->subTickPen());
+        zoomAxis[i]->setTickLabelColor(mainAxis[i]->tickLabelColor());
+        zoomAxis[i]->setLabelColor(mainAxis[i]->labelColor());
+        zoomAxis[i]->grid()->setPen(mainAxis[i]->grid()->pen());
     }
 
-    if(singleShotEnabled && (triggerDelay != 0))
-        singleShotTriggered(1);
+#if QCP_VER == 1
+    zoom.ch1 = new frameGraph(xAxis, yAxis);
+    zoom.ch2 = new frameGraph(xAxis, yAxis);
+    axes->addPlottable(zoom.ch1);
+    axes->addPlottable(zoom.ch2);
+#else
+    zoom.ch1 = axes->addGraph(xAxis, yAxis);
+    zoom.ch2 = axes->addGraph(xAxis, yAxis);
+#endif
+    zoom.ch1->setPen(axes->graph(0)->pen());
+    zoom.ch2->setPen(axes->graph(1)->pen());
 
-    auto readData_CH1 = internalBuffer375_CH1->readBuffer(display->window, GRAPH_SAMPLES, false, display->delay + triggerDelay);
-    auto CH1 = analogConvert(readData_CH1, 2048, 0, 1);  //No AC coupling!
+    zoom.marker = new QCPItemRect(axes);
+#if QCP_VER == 1
+    axes->addItem(zoom.marker);
+#endif
+    zoom.marker->topLeft->setTypeY(QCPItemPosition::ptAxisRectRatio);
+    zoom.marker->bottomRight->setTypeY(QCPItemPosition::ptAxisRectRatio);
+    zoom.marker->setPen(QPen(QColor(255, 255, 255, 128), 1, Qt::DashLine));
+    zoom.marker->setBrush(QBrush(QColor(255, 255, 255, 24)));
+    zoom.marker->setVisible(false);
+
+    zoom.window.window = display->window / 10;
+    zoom.window.delay = display->delay + display->window * 0.45;
+    m_zoomAxes.push_back(zoom);
+    axes->replot();
+}
 
-    QVector<double> x(CH1.size());
-    for (int i = 0; i < x.size(); ++i) {
-        x[i] = -(display->window*i)/((double)(GRAPH_SAMPLES-1)) - display->delay;
-        if (x[i]>0) {
-            CH1[i] = 0;
-        }
-    }
-    axes->graph(0)->setData(x,CH1);
+void isoDriver::removeZoomViews()
+{
+    // The graphs and the marker go first, as they hang off the rect's axes
+    for (zoomAxes& zoom : m_zoomAxes) {
+        axes->removePlottable(zoom.ch1);
+        axes->removePlottable(zoom.ch2);
+        axes->removeItem(zoom.marker);
+        axes->plotLayout()->remove(zoom.rect);
+    }
+    m_zoomAxes.clear();
+    axes->plotLayout()->simplify();
+    axes->replot();
+}
 
-    updateCursors();
+// Wheel over a zoom view: zoom its window about the pointer like the main
+// plot does, or with Shift held pan it a quarter of a window per step.
+bool isoDriver::zoomWheel(QWheelEvent *event)
+{
+    for (zoomAxes& zoom : m_zoomAxes) {
+        if (!zoom.rect->rect().contains(event->pos()))
+            continue;
+
+        double steps = event->delta() / 120.0;
+        ZoomWindow& w = zoom.window;
+        if (event->modifiers() == Qt::ShiftModifier) {
+            w.delay += steps * w.window / 4;
+        } else {
+            QCPAxis *xAxis = zoom.rect->axis(QCPAxis::atBottom);
+            QCPRange range = xAxis->range();
+            double offset = (xAxis->pixelToCoord(event->x()) - range.lower) / range.size();
+            offset = qBound(0.0, offset, 1.0);
+
+            double scale = steps * w.window / 2.0;
+            double lower = w.delay + scale * (1.0 - offset);
+            double upper = w.delay + w.window - scale * offset;
+            if (upper > MAX_WINDOW_SIZE)
+                upper = MAX_WINDOW_SIZE;
+            if (upper - lower > 1.e-9) {
+                w.window = upper - lower;
+                w.delay = lower;
+            }
+        }
+        w.delay = qBound(0.0, w.delay, MAX_WINDOW_SIZE - w.window);
 
-    axes->xAxis->setRange(-display->window - display->delay, -display->delay);
-    axes->yAxis->setRange(display->topRange, display->botRange);
+        zoom.rect->axis(QCPAxis::atBottom)->setRange(-w.window - w.delay, -w.delay);
+        axes->replot();
+        return true;
+    }
+    return false;
+}
 
-    axes->replot();
-    multimeterStats();
+void isoDriver::setPersistence(double seconds)
+{
+    runOnProcessingThread([this, seconds]{
+        m_persistenceSeconds = seconds;
+        m_persistence.clear();
+    });
 }
 
 void isoDriver::setAC_CH1(bool enabled){
@@ -1406,63 +2020,64 @@ void isoDriver::multimeterStats(){
     //qDebug() << "Entering isoDriver::multimeterStats()";
     if (!multimeterShow) return;
 
+    allocationExempt exempt;
     QTimer::singleShot(MULTIMETER_PERIOD, this, SLOT(enableMM()));
 
     multimeterShow = false;
     bool mvMax, mvMin, mvMean, mvRMS, maMax, maMin, maMean, maRMS, kOhms, uFarads;  //We'll let the compiler work out this one.
 
-    if(autoMultimeterV){
+    if(m_view.autoMultimeterV){
         mvMax = abs(currentVmax) < 1.;
         mvMin = abs(currentVmin) < 1.;
         mvMean = abs(currentVmean) < 1.;
         mvRMS = abs(currentVRMS) < 1.;
     }
-    if(autoMultimeterI){
-        maMax = abs(currentVmax / seriesResistance) < 1.;
-        maMin = abs(currentVmin / seriesResistance) < 1.;
-        maMean = abs(currentVmean / seriesResistance) < 1.;
-        maRMS = abs(currentVRMS / seriesResistance) < 1.;
+    if(m_view.autoMultimeterI){
+        maMax = abs(currentVmax / m_view.seriesResistance) < 1.;
+        maMin = abs(currentVmin / m_view.seriesResistance) < 1.;
+        maMean = abs(currentVmean / m_view.seriesResistance) < 1.;
+        maRMS = abs(currentVRMS / m_view.seriesResistance) < 1.;
     }
 
-    if(forceMillivolts){
+    if(m_view.forceMillivolts){
         mvMax = true;
         mvMin = true;
         mvMean = true;
         mvRMS = true;
     }
-    if(forceMilliamps){
+    if(m_view.forceMilliamps){
         maMax = true;
         maMin = true;
         maMean = true;
         maRMS = true;
     }
-    if(forceKiloOhms){
+    if(m_view.forceKiloOhms){
         kOhms = true;
     }
-    if(forceUFarads){
+    if(m_view.forceUFarads){
         uFarads = true;
     }
 
-    if(forceVolts){
+    if(m_view.forceVolts){
         mvMax = false;
         mvMin = false;
         mvMean = false;
         mvRMS = false;
     }
-    if(forceAmps){
+    if(m_view.forceAmps){
         maMax = false;
         maMin = false;
         maMean = false;
         maRMS = false;
     }
-    if(forceOhms){
+    if(m_view.forceOhms){
         kOhms = false;
     }
-    if(forceNFarads){
+    if(m_view.forceNFarads){
         uFarads = false;
     }
 
-    if(multimeterType == V){
+    if(m_view.multimeterType == V){
         if(mvMax){
             currentVmax *= 1000;
             sendMultimeterLabel1("Max (mV)");
@@ -1490,7 +2105,7 @@ void isoDriver::multimeterStats(){
         return;
     }
 
-    if(multimeterType == I){
+    if(m_view.multimeterType == I){
         if(maMax){
             currentVmax *= 1000;
             sendMultimeterLabel1("Max (mA)");
@@ -1512,24 +2127,24 @@ void isoDriver::multimeterStats(){
         }else sendMultimeterLabel4("RMS (A)");
 
 
-        multimeterMax(currentVmax / seriesResistance);
-        multimeterMin(currentVmin / seriesResistance);
-        multimeterMean(currentVmean / seriesResistance);
-        multimeterRMS(currentVRMS / seriesResistance);
+        multimeterMax(currentVmax / m_view.seriesResistance);
+        multimeterMin(currentVmin / m_view.seriesResistance);
+        multimeterMean(currentVmean / m_view.seriesResistance);
+        multimeterRMS(currentVRMS / m_view.seriesResistance);
         return;
     }
 
-    if(multimeterType == R){
+    if(m_view.multimeterType == R){
         if(estimated_resistance!=estimated_resistance){
             estimated_resistance = 0; //Reset resistance if it's NaN
         }
         double Vm = meanVoltageLast((double)MULTIMETER_PERIOD/(double)1000, 1, 2048);
-        double rtest_para_r = 1/(1/seriesResistance + 1/estimated_resistance);
-        double perturbation = ch2_ref * (rtest_para_r / (R3 + R4 + rtest_para_r));
+        double rtest_para_r = 1/(1/m_view.seriesResistance + 1/estimated_resistance);
+        double perturbation = m_view.ch2_ref * (rtest_para_r / (R3 + R4 + rtest_para_r));
         Vm = Vm - perturbation;
-        double Vin = (multimeterRsource * 2) + 3;
+        double Vin = (m_view.multimeterRsource * 2) + 3;
         double Vrat = (Vin-Vm)/Vin;
-        double Rp = 1/(1/seriesResistance + 1/(R3+R4));
+        double Rp = 1/(1/m_view.seriesResistance + 1/(R3+R4));
         estimated_resistance = ((1-Vrat)/Vrat) * Rp; //Perturbation term on V2 ignored.  V1 = Vin.  V2 = Vin(Rp/(R+Rp)) + Vn(Rtest||R / (R34 + (Rtest||R34));
         //qDebug() << "Vm = " << Vm;
         //qDebug() << "Vin = " << Vin;
@@ -1541,7 +2156,7 @@ void isoDriver::multimeterStats(){
         multimeterMin(0);
         multimeterMean(0);
 
-        if(autoMultimeterR){
+        if(m_view.autoMultimeterR){
             kOhms = (estimated_resistance) > 1000;
         }
 
@@ -1551,7 +2166,7 @@ void isoDriver::multimeterStats(){
         }else sendMultimeterLabel4("Resistance (Ω)");
         multimeterRMS(estimated_resistance);
     }
-    if(multimeterType == C){
+    if(m_view.multimeterType == C){
         double cap_vbot = 0.8;
         double cap_vtop = 2.5;
 
@@ -1576,10 +2191,10 @@ void isoDriver::multimeterStats(){
         qDebug() << "dt = " << cap_x2-cap_x1;
 
         double dt = (double)(cap_x2-cap_x1)/internalBuffer375_CH1->m_samplesPerSecond;
-        double Cm = -dt/(seriesResistance * log((vcc-cap_vtop)/(vcc-cap_vbot)));
+        double Cm = -dt/(m_view.seriesResistance * log((vcc-cap_vtop)/(vcc-cap_vbot)));
         qDebug() << "Cm = " << Cm;
 
-        if(autoMultimeterC){
+        if(m_view.autoMultimeterC){
             uFarads = (Cm) > 1e-6;
         }
 
@@ -1663,10 +2278,13 @@ void isoDriver::setXYmode(bool enabled){
 
     if(enabled)  // Hide graphs - we only want the X-Y plot to appear
     {
-        xmin = 20;
-        xmax = -20;
-        ymin = 20;
-        ymax = -20;
+        // The processing thread grows these as it draws
+        runOnProcessingThread([this]{
+            xmin = 20;
+            xmax = -20;
+            ymin = 20;
+            ymax = -20;
+        });
 
         for (int i=0; i < graphCount; i++)
         {
@@ -1691,10 +2309,16 @@ void isoDriver::setXYmode(bool enabled){
 }
 
 void isoDriver::triggerGroupStateChange(bool enabled){
-    if(enabled) sendTriggerValue((currentVmax-currentVmin)*0.85 + currentVmin);
+    // The stats belong to the processing thread; the signal is queued back
+    if(enabled) runOnProcessingThread([this]{
+        allocationExempt exempt;
+        sendTriggerValue((currentVmax-currentVmin)*0.85 + currentVmin);
+    });
 }
 
 void isoDriver::broadcastStats(bool CH2){
+    // Queued signals copy their arguments onto the heap
+    allocationExempt exempt;
     if (CH2 && update_CH2)
     {
         update_CH2 = false;
@@ -1721,20 +2345,8 @@ void isoDriver::slowTimerTick(){
 
     if (triggerEnabled)
     {
-        double triggerFrequency;
-        switch(triggerMode)
-        {
-        case 0:
-        case 1:
-            triggerFrequency = (driver->deviceMode == 6) ? internalBuffer750->getTriggerFrequencyHz() : internalBuffer375_CH1->getTriggerFrequencyHz();
-            break;
-
-        case 2:
-        case 3:
-            triggerFrequency = internalBuffer375_CH2->getTriggerFrequencyHz();
-            break;
-        }
-
+        // As of the last frame drawn
+        double const triggerFrequency = m_triggerFrequency;
         if (triggerFrequency > 0.)
         {
             frequencyLabelVisible = true;
@@ -1793,25 +2405,31 @@ void isoDriver::takeSnapshot(QString *fileName, unsigned char channel){
 }
 
 double isoDriver::meanVoltageLast(double seconds, unsigned char channel, int TOP){
-    isoBuffer *currentBuffer;
-    switch (channel){
-    case 1:
-        currentBuffer = internalBuffer375_CH1;
-        break;
-    case 2:
-        currentBuffer = internalBuffer375_CH2;
-        break;
-    case 3:
-        currentBuffer = internalBuffer750;
-        break;
-    }
+    // Calibration calls this from the GUI thread, and has to wait for it
+    double mean = 0;
+    runOnProcessingThreadAndWait([this, seconds, channel, TOP, &mean]{
+        isoBuffer *currentBuffer;
+        switch (channel){
+        case 1:
+            currentBuffer = internalBuffer375_CH1;
+            break;
+        case 2:
+            currentBuffer = internalBuffer375_CH2;
+            break;
+        case 3:
+            currentBuffer = internalBuffer750;
+            break;
+        }
 
-    auto tempBuffer = currentBuffer->readBuffer(seconds, 1024, 0, 0);
-    double sum = 0;
-    for (const auto &sample : tempBuffer) {
-        sum += currentBuffer->sampleConvert(sample, TOP, 0);
-    }
-    return sum / tempBuffer.size();
+        std::vector<short> tempBuffer;
+        currentBuffer->readBuffer(tempBuffer, seconds, 1024, 0, 0);
+        // The conversion is affine, so converting the mean works too
+        double voltsPerCount, offset;
+        conversionFactors(channel == 2 ? 2 : 1, TOP, voltsPerCount, offset);
+        double sum = std::accumulate(tempBuffer.begin(), tempBuffer.end(), 0.0);
+        mean = sum / tempBuffer.size() * voltsPerCount + offset;
+    });
+    return mean;
 }
 
 void isoDriver::rSourceChanged(int newSource){
@@ -1829,10 +2447,6 @@ void isoDriver::loadFileBuffer(QFile *fileToLoad){
 
     disableFileMode();
 
-    if(internalBufferFile != NULL){
-        delete internalBufferFile;
-    }
-
     //Load the file
     if (!fileToLoad->open(QIODevice::ReadOnly)) {
         qDebug() << fileToLoad->errorString();
@@ -1903,7 +2517,7 @@ void isoDriver::loadFileBuffer(QFile *fileToLoad){
     qDebug() << "minTime" << minTime;
     qDebug() << "bufferLen" << bufferLen;
     double sampleRate_Hz = defaultSampleRate/averages;
-    internalBufferFile = new isoBuffer_file(this, bufferLen, sampleRate_Hz);
+    isoBuffer_file *fileBuffer = new isoBuffer_file(this, bufferLen, sampleRate_Hz);
 
     //Go to start of data section
     fileToLoad->seek(0);//Return to start
@@ -1946,12 +2560,20 @@ void isoDriver::loadFileBuffer(QFile *fileToLoad){
             }
             sampleCount++;
         }
-        internalBufferFile->writeBuffer_float(&tempArray[min_i], temp_len);
+        fileBuffer->writeBuffer_float(&tempArray[min_i], temp_len);
         tempList.clear();
     }
 
     fileToLoad->close();
 
+    //The processing thread may still be drawing from the old buffer, so swap them over there.
+    runOnProcessingThread([this, fileBuffer]{
+        if(internalBufferFile != NULL){
+            internalBufferFile->deleteLater();
+        }
+        internalBufferFile = fileBuffer;
+    });
+
     qDebug() << "Initialising timer";
     //Initialise the file timer.
     if (fileTimer != NULL){
@@ -1978,7 +2600,7 @@ void isoDriver::daqLoad_endChanged(double newEnd){
 
 void isoDriver::fileTimerTick(){
     //qDebug() << "isoDriver::fileTimerTick()";
-    frameActionGeneric(-2,0);
+    queueFrame(nullptr, 0, true);
 }
 
 void isoDriver::enableFileMode(){
@@ -2020,10 +2642,39 @@ void isoDriver::setSerialType(unsigned char type)
 
     if(serialType == 1)
     {
-        if (twoWire)
-            delete twoWire;
-        twoWire = new i2c::i2cDecoder(internalBuffer375_CH1, internalBuffer375_CH2, internalBuffer375_CH1->m_console1);
+        // Created here so its console timer belongs to the GUI thread
+        i2c::i2cDecoder* decoder = new i2c::i2cDecoder(internalBuffer375_CH1, internalBuffer375_CH2, internalBuffer375_CH1->m_console1);
+        m_twoWireConsole = decoder;
+        runOnProcessingThread([this, decoder]{
+            // The worker may still be running the old one
+            m_decoderWorker->wait();
+            if (twoWire)
+                twoWire->deleteLater();
+            twoWire = decoder;
+            // So it starts from the buffers as they are now
+            twoWireStateInvalid = true;
+        });
+    }
+}
+
+// Everything the serial consoles have shown, one decoder after another
+void isoDriver::exportDecoded(QString fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not open" << fileName;
+        return;
+    }
+
+    decoderRecordLog::writeCsvHeader(file);
+    for (isoBuffer* buffer : {internalBuffer375_CH1, internalBuffer375_CH2})
+    {
+        if (uartStyleDecoder* decoder = buffer->m_decoder.load(std::memory_order_acquire))
+            decoder->recordLog().writeCsv(file, decoder->consoleName(), buffer->m_sampleRate_bit);
     }
+    if (m_twoWireConsole)
+        m_twoWireConsole->recordLog.writeCsv(file, "I2C", internalBuffer375_CH1->m_sampleRate_bit);
+    file.close();
 }
 
 void isoDriver::hideCH1(bool enable)
@@ -2038,47 +2689,46 @@ void isoDriver::hideCH2(bool enable)
 
 void isoDriver::triggerStateChanged()
 {
-    if (!triggerEnabled)
-    {
-        internalBuffer375_CH1->setTriggerType(TriggerType::Disabled);
-        internalBuffer375_CH2->setTriggerType(TriggerType::Disabled);
-        internalBuffer750->setTriggerType(TriggerType::Disabled);
-        return;
-    }
+    TriggerType type_CH1 = TriggerType::Disabled;
+    TriggerType type_CH2 = TriggerType::Disabled;
+    TriggerType type_750 = TriggerType::Disabled;
 
-    qDebug() << "triggerStateChanged()";
-    switch(triggerMode)
+    if (triggerEnabled)
     {
-        case 0:
-        {
-            internalBuffer375_CH1->setTriggerType(TriggerType::Rising);
-            internalBuffer375_CH2->setTriggerType(TriggerType::Disabled);
-            internalBuffer750->setTriggerType(TriggerType::Rising);
-            break;
-        }
-        case 1:
-        {
-            internalBuffer375_CH1->setTriggerType(TriggerType::Falling);
-            internalBuffer375_CH2->setTriggerType(TriggerType::Disabled);
-            internalBuffer750->setTriggerType(TriggerType::Falling);
-            break;
-        }
-        case 2:
+        qDebug() << "triggerStateChanged()";
+        switch(triggerMode)
         {
-            internalBuffer375_CH1->setTriggerType(TriggerType::Disabled);
-            internalBuffer375_CH2->setTriggerType(TriggerType::Rising);
-            internalBuffer750->setTriggerType(TriggerType::Disabled);
-            break;
+            case 0:
+            {
+                type_CH1 = TriggerType::Rising;
+                type_750 = TriggerType::Rising;
+                break;
+            }
+            case 1:
+            {
+                type_CH1 = TriggerType::Falling;
+                type_750 = TriggerType::Falling;
+                break;
+            }
+            case 2:
+            {
+                type_CH2 = TriggerType::Rising;
+                break;
 
-        }
-        case 3:
-        {
-            internalBuffer375_CH1->setTriggerType(TriggerType::Disabled);
-            internalBuffer375_CH2->setTriggerType(TriggerType::Falling);
-            internalBuffer750->setTriggerType(TriggerType::Disabled);
-            break;
+            }
+            case 3:
+            {
+                type_CH2 = TriggerType::Falling;
+                break;
+            }
         }
     }
+
+    runOnProcessingThread([this, type_CH1, type_CH2, type_750]{
+        internalBuffer375_CH1->setTriggerType(type_CH1);
+        internalBuffer375_CH2->setTriggerType(type_CH2);
+        internalBuffer750->setTriggerType(type_750);
+    });
 }
 
 void isoDriver::offsetChanged_CH1(double newOffset)
@@ -2151,27 +2801,124 @@ void isoDriver::setHexDisplay_CH2(bool enabled)
 
 void isoDriver::setWindowingType(int windowingType)
 {
-    m_windowingType = windowingType;
+    runOnProcessingThread([this, windowingType]{
+        AsyncDFT::Settings settings = m_asyncDFT->settings();
+        settings.windowType = windowingType;
+        m_asyncDFT->setSettings(settings);
+    });
+}
 
-    m_windowFactors.resize(m_asyncDFT->n_samples);
-    m_windowFactorsSum = 0;
-    for (int i = 0; i < m_windowFactors.size(); ++i) {
-        auto factor = windowing_factor(m_windowingType, m_windowFactors.size(), i);
-        m_windowFactors[i] = factor;
-        m_windowFactorsSum += factor;
+void isoDriver::setSpectrumSize(int size)
+{
+    runOnProcessingThread([this, size]{
+        AsyncDFT::Settings settings = m_asyncDFT->settings();
+        settings.size = size;
+        m_asyncDFT->setSettings(settings);
+    });
+}
+
+void isoDriver::setSpectrumAverages(int averages)
+{
+    runOnProcessingThread([this, averages]{
+        AsyncDFT::Settings settings = m_asyncDFT->settings();
+        settings.averages = averages;
+        m_asyncDFT->setSettings(settings);
+    });
+}
+
+void isoDriver::setSpectrumOverlap(double overlap)
+{
+    runOnProcessingThread([this, overlap]{
+        AsyncDFT::Settings settings = m_asyncDFT->settings();
+        settings.overlap = overlap;
+        m_asyncDFT->setSettings(settings);
+    });
+}
+
+// Adds or removes the waterfall's axis rect under the spectrum.  The
+// history starts afresh each time it is shown.
+void isoDriver::setWaterfall(bool enabled)
+{
+    if (enabled == (m_waterfallMap != nullptr))
+        return;
+
+    if (!enabled) {
+        axes->removePlottable(m_waterfallMap);
+        axes->plotLayout()->remove(m_waterfallRect);
+        axes->plotLayout()->simplify();
+        m_waterfallMap = nullptr;
+        m_waterfallRect = nullptr;
+        axes->replot();
+        return;
     }
+
+    runOnProcessingThread([this]{
+        m_spectrogram->reset();
+    });
+
+    m_waterfallRect = new QCPAxisRect(axes);
+    axes->plotLayout()->addElement(axes->plotLayout()->rowCount(), 0, m_waterfallRect);
+    QCPAxis *xAxis = m_waterfallRect->axis(QCPAxis::atBottom);
+    QCPAxis *yAxis = m_waterfallRect->axis(QCPAxis::atLeft);
+    // Styled like the main axes
+    QCPAxis *mainAxis[2] = {axes->xAxis, axes->yAxis};
+    QCPAxis *waterfallAxis[2] = {xAxis, yAxis};
+    for (int i = 0; i < 2; ++i) {
+        waterfallAxis[i]->setBasePen(mainAxis[i]->basePen());
+        waterfallAxis[i]->setTickPen(mainAxis[i]->tickPen());
+        waterfallAxis[i]->setSubTickPen(mainAxis[i]->subTickPen());
+        waterfallAxis[i]->setTickLabelColor(mainAxis[i]->tickLabelColor());
+        waterfallAxis[i]->setLabelColor(mainAxis[i]->labelColor());
+        waterfallAxis[i]->grid()->setVisible(false);
+    }
+    yAxis->setLabel("Time (s)");
+    yAxis->setRange(-double(spectrogram::kRows) / spectrogram::kRowsPerSecond, 0);
+
+    m_waterfallMap = new QCPColorMap(xAxis, yAxis);
+#if QCP_VER == 1
+    axes->addPlottable(m_waterfallMap);
+#endif
+    m_waterfallMap->setGradient(QCPColorGradient::gpThermal);
+    m_waterfallMap->setInterpolate(false);
+    m_waterfallMap->setVisible(false);
+    axes->replot();
+}
+
+// The sweep plan belongs to the processing thread; changing it starts the
+// sweep again from the bottom.
+template<typename Function>
+void isoDriver::changeFreqRespPlan(Function change)
+{
+    runOnProcessingThread([this, change]{
+        bodeSweep::Plan plan = m_bodeSweep.plan();
+        change(plan);
+        m_bodeSweep.setPlan(plan);
+    });
+}
+
+void isoDriver::setDistortionShown(bool shown)
+{
+    m_distortionShown = shown;
+}
+
+void isoDriver::setCrossCorrelationShown(bool shown)
+{
+    m_crossCorrelationShown = shown;
+}
+
+void isoDriver::setJitterShown(bool shown)
+{
+    m_jitterShown = shown;
 }
 
 void isoDriver::setMinFreqResp(double minFreqResp)
 {
-    m_freqRespMin = minFreqResp;
-    m_freqRespFlag = true;
+    changeFreqRespPlan([minFreqResp](bodeSweep::Plan& plan){ plan.min = minFreqResp; });
 }
 
 void isoDriver::setMaxFreqResp(double maxFreqResp)
 {
-    m_freqRespMax = maxFreqResp;
-    m_freqRespFlag = true;
+    changeFreqRespPlan([maxFreqResp](bodeSweep::Plan& plan){ plan.max = maxFreqResp; });
 }
 
 void isoDriver::retickXAxis()
@@ -2232,8 +2979,17 @@ void isoDriver::logSpacingEnableHor(bool horLogSpace)
 
 void isoDriver::setFreqRespStep(double freqRespStep)
 {
-    m_freqRespStep = freqRespStep;
-    m_freqRespFlag = true;
+    changeFreqRespPlan([freqRespStep](bodeSweep::Plan& plan){ plan.step = freqRespStep; });
+}
+
+void isoDriver::setFreqRespLog(bool log)
+{
+    changeFreqRespPlan([log](bodeSweep::Plan& plan){ plan.log = log; });
+}
+
+void isoDriver::setFreqRespPointsPerDecade(int pointsPerDecade)
+{
+    changeFreqRespPlan([pointsPerDecade](bodeSweep::Plan& plan){ plan.pointsPerDecade = pointsPerDecade; });
 }
 
 void isoDriver::setFreqRespType(int freqRespType)
@@ -2243,6 +2999,22 @@ void isoDriver::setFreqRespType(int freqRespType)
 
 void isoDriver::restartFreqResp()
 {
-    m_freqRespFlag = true;
+    runOnProcessingThread([this]{
+        m_bodeSweep.restart();
+    });
+}
+
+void isoDriver::exportFreqResp(QString fileName)
+{
+    runOnProcessingThread([this, fileName]{
+        m_bodeSweep.exportCsv(fileName);
+    });
+}
+
+void isoDriver::exportJitter(QString fileName)
+{
+    runOnProcessingThread([this, fileName]{
+        m_clockRecovery.exportCsv(fileName);
+    });
 }
 #endif
@@ -5,6 +5,11 @@
 #include <QLabel>
 #include <QDebug>
 #include <QVector>
+#include <QThread>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <atomic>
+#include <vector>
 #include "qcustomplot.h"
 #include "genericusbdriver.h"
 #include "desktop_settings.h"
@@ -12,8 +17,24 @@
 #include "i2cdecoder.h"
 #include "uartstyledecoder.h"
 #include "espospinbox.h"
+#include "frameexchange.h"
+#include "renderframe.h"
+#include "framearena.h"
+#include "conversiontable.h"
+#include "persistencehistogram.h"
+#include "framegovernor.h"
+#include "zoomviews.h"
+#ifndef DISABLE_SPECTRUM
+#include "bodesweep.h"
+#include "clockrecovery.h"
+#include "eyehistogram.h"
+#include "lockin.h"
+#endif
 
 class AsyncDFT;
+class crossCorrelator;
+class decoderWorker;
+class spectrogram;
 class isoBuffer;
 class isoBuffer_file;
 
@@ -27,6 +48,108 @@ class isoBuffer_file;
 // That is one of the things I plan on fixing, and in fact
 // the reason why I began the commenting!
 
+class isoDriver;
+
+// Runs isoDriver's per-frame processing on its own thread.
+// Everything that touches the isoBuffers is done here; the GUI thread
+// only receives finished RenderFrames.
+class processingWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit processingWorker(isoDriver* driver) : m_driver(driver) {}
+public slots:
+    void processFrames();
+private:
+    isoDriver* m_driver;
+};
+
+// The parts of DisplayControl, and of isoDriver's and the driver's settings,
+// that the processing thread needs.  Copied on the GUI thread when a frame
+// is queued so the two never share state, and so a frame is never built
+// from a half-applied change.
+struct ViewParams
+{
+    double window = 0;
+    double delay = 0;
+    double topRange = 0;
+    double botRange = 0;
+    double leftRange = 0;
+    double rightRange = 0;
+#ifndef DISABLE_SPECTRUM
+    double freqRespFrequency = 0;   // As the generator actually plays it
+    int freqRespWaveLength = 0;
+    bool waterfall = false;
+    bool crossCorrelation = false;
+    bool jitter = false;
+    bool spectrum = false;
+    bool freqResp = false;
+    bool eyeDiagram = false;
+    int freqRespType = 0;
+#endif
+    // Device
+    int deviceMode = 0;
+    double scopeGain = 1;
+    // Channels
+    bool paused_CH1 = false;
+    bool paused_CH2 = false;
+    bool paused_multimeter = false;
+    bool AC_CH1 = false;
+    bool AC_CH2 = false;
+    double attenuation_CH1 = 1;
+    double attenuation_CH2 = 1;
+    double offset_CH1 = 0;
+    double offset_CH2 = 0;
+    double digitalOffset_CH1 = 0;
+    double digitalOffset_CH2 = 0;
+    double ch1_ref = 1.65;
+    double ch2_ref = 1.65;
+    double frontendGain_CH1 = 1;
+    double frontendGain_CH2 = 1;
+    // Display
+    bool XYmode = false;
+    bool peakDetect = false;
+    // Trigger
+    bool triggerEnabled = false;
+    bool singleShotEnabled = false;
+    int triggerMode = 0;
+    // Serial decoding
+    bool serialDecodeEnabled_CH1 = false;
+    bool serialDecodeEnabled_CH2 = false;
+    unsigned char serialType = 0;
+    int baudRate_CH1 = 9600;
+    int baudRate_CH2 = 9600;
+    UartParity parity_CH1 = UartParity::None;
+    UartParity parity_CH2 = UartParity::None;
+    bool hexDisplay_CH1 = false;
+    bool hexDisplay_CH2 = false;
+    // Multimeter
+    int multimeterType = 0;
+    double seriesResistance = 0;
+    int multimeterRsource = 0;
+    bool autoMultimeterV = true;
+    bool autoMultimeterI = true;
+    bool autoMultimeterR = true;
+    bool autoMultimeterC = true;
+    bool forceMillivolts = false;
+    bool forceMilliamps = false;
+    bool forceKiloOhms = false;
+    bool forceUFarads = false;
+    bool forceVolts = false;
+    bool forceAmps = false;
+    bool forceOhms = false;
+    bool forceNFarads = false;
+    // From the frame governor; see frameBudget
+    int displayStride = 1;
+    int graphSamples = GRAPH_SAMPLES;
+    int spectrumCadence = 4;
+    int decoderStride = 1;
+    double framePeriod = 0; // Seconds between frames from the device (or file)
+    ZoomWindow zooms[RenderFrame::kMaxZoomViews];
+    int zoomCount = 0;
+};
+
 class DisplayControl : public QObject
 {
     Q_OBJECT
@@ -61,6 +184,7 @@ class isoDriver : public QLabel
     Q_OBJECT
 public:
     explicit isoDriver(QWidget *parent = 0);
+    ~isoDriver();
     void autoGain(void);
     //Generic Vars
     isoBuffer *internalBuffer375_CH1;
@@ -73,13 +197,22 @@ public:
     QCPItemText *freqRespStatusLabel;
     QCPItemText *freqRespStatusMark;
     QCPItemText *triggerFrequencyLabel;
+    QCPItemText *distortionLabel;
+    QCPItemText *crossCorrelationLabel;
+    QCPItemText *jitterLabel;
 #endif
+    QCPColorMap *persistenceMap = nullptr;
     genericUsbDriver *driver;
     bool doNotTouchGraph = true;
     double ch1_ref = 1.65;
     double ch2_ref = 1.65;
     double frontendGain_CH1 = (R4/(R3+R4));
     double frontendGain_CH2 = (R4/(R3+R4));
+    // Raw samples to volts with the calibration above and the current scope
+    // gain, shared by the display, DAQ, trigger and statistics.  The table is
+    // only rebuilt when one of those changes.  TOP is 128 for the 8-bit modes
+    // and 2048 for the 12-bit multimeter.  Processing thread only.
+    conversionTable const& sampleConversion(int channel, int TOP);
     UartParity parity_CH1 = UartParity::None;
     UartParity parity_CH2 = UartParity::None;
     //State Vars
@@ -98,17 +231,30 @@ public:
     //Generic Functions
     void setDriver(genericUsbDriver *newDriver);
     void setAxes(QCustomPlot *newAxes);
+    // Mean volts over the last seconds, from the processing thread
     double meanVoltageLast(double seconds, unsigned char channel, int TOP);
+    // For the processing thread, as of the frame it is on
+    bool acCoupled(int channel) const { return channel == 1 ? m_view.AC_CH1 : m_view.AC_CH2; }
     void loadFileBuffer(QFile *fileToLoad);
     void setSerialType(unsigned char type);
+    void setPersistence(double seconds);
+    void setAutoFrameRate(bool enabled);
+    // Zoom views, stacked under the main plot.  Each starts on the middle
+    // tenth of the main window; the mouse wheel over it zooms and, with
+    // Shift held, pans.
+    void addZoomView();
+    void removeZoomViews();
+    bool canAddZoomView() const { return int(m_zoomAxes.size()) < RenderFrame::kMaxZoomViews; }
     //DAQ
     bool fileModeEnabled = false;
     double daq_maxWindowSize;
+    bool peakDetect = false;
 #ifndef DISABLE_SPECTRUM
     bool spectrum = false;
     bool freqResp = false;
     bool eyeDiagram = false;
     espoSpinBox *freqValue_CH1 = NULL;
+    functionGen::SingleChannelController *freqRespGenerator = NULL;
 #endif
     bool horiCursorEnabled0 = false; // TODO: move into DisplayControl
 #ifndef DISABLE_SPECTRUM
@@ -132,7 +278,7 @@ private:
     bool placingVertAxes = false; // TODO: move into DisplayControl
     bool triggerEnabled = false;
     bool singleShotEnabled = false;
-    bool multimeterShow = true;
+    std::atomic_bool multimeterShow{true};
     bool autoMultimeterV = true;
     bool autoMultimeterI = true;
     bool autoMultimeterR = true;
@@ -148,8 +294,8 @@ private:
     bool serialDecodeEnabled_CH1 = false;
     bool serialDecodeEnabled_CH2 = false;
     bool XYmode = false;
-    bool update_CH1 = true;
-    bool update_CH2 = true;
+    std::atomic_bool update_CH1{true};
+    std::atomic_bool update_CH2{true};
     bool snapshotEnabled_CH1 = false;
     bool snapshotEnabled_CH2 = false;
     bool firstFrame = true;
@@ -158,12 +304,11 @@ private:
 
 
     //Generic Functions
-    QVector<double> analogConvert(std::vector<short> &in, int TOP, bool AC, int channel);
-    QVector<double> digitalConvert(std::vector<short> &in);
-    QVector<double> fileStreamConvert(float *in);
-#ifndef DISABLE_SPECTRUM
-    double windowing_factor(int m_windowingType, int n_samples, int index);
-#endif
+    void analogConvert(std::vector<short> const& in, QVector<double>& out, int TOP, int64_t const* acSum, int channel, double attenuation = 1, double offset = 0);
+    void digitalLevels(double& top, double& bot) const;
+    void digitalConvert(std::vector<short> const& in, QVector<double>& out);
+    void fileStreamConvert(float *in, QVector<double>& out);
+    void envelopeConvert(std::vector<short> const& in, QVector<double>& out);
     bool properlyPaused();
     void updateCursors();
     void refreshInteractiveGraph();
@@ -171,7 +316,77 @@ private:
     void multimeterAction();
     void broadcastStats(bool CH2);
     void frameActionGeneric(char CH1_mode, char CH2_mode);
+#ifndef DISABLE_SPECTRUM
+    void spectrumAction(isoBuffer *internalBuffer_CH1, isoBuffer *internalBuffer_CH2, char CH1_mode, char CH2_mode);
+    void freqRespAction(isoBuffer *internalBuffer_CH1, isoBuffer *internalBuffer_CH2);
+    void crossCorrelationAction(isoBuffer *internalBuffer_CH1, isoBuffer *internalBuffer_CH2);
+    template<typename Function>
+    void changeFreqRespPlan(Function change);
+#endif
     void triggerStateChanged();
+    //Processing thread
+    friend class processingWorker;
+    struct queuedFrame
+    {
+        std::vector<char> data;
+        unsigned int length = 0;
+        bool fileMode = false;
+        ViewParams view;
+    };
+    static constexpr size_t kFrameQueueLength = 8;
+    void queueFrame(char const* data, unsigned int frameLength, bool fileMode);
+    void processPendingFrames();
+    void processFrame(queuedFrame& frame);
+    void publishFrame();
+    template<typename Function>
+    void runOnProcessingThread(Function function);
+    template<typename Function>
+    void runOnProcessingThreadAndWait(Function function);
+    QThread *m_processingThread = nullptr;
+    processingWorker *m_processingWorker = nullptr;
+    spscQueue<queuedFrame, kFrameQueueLength> m_frameQueue;
+    tripleBuffer<RenderFrame> m_renderFrames;
+    std::atomic_bool m_processingScheduled{false};
+    std::atomic_bool m_renderScheduled{false};
+    double m_triggerFrequency = -1; // GUI thread's copy, from the last frame drawn
+    uint64_t m_droppedFrames = 0;
+    QElapsedTimer m_droppedFramesReported;
+    ViewParams m_view; // Processing thread's copy of the view for the current frame
+    frameArena m_arena;
+    void conversionFactors(int channel, int TOP, double& voltsPerCount, double& offset) const;
+    conversionTable m_conversionTables[2][2]; // [channel - 1][12-bit]
+    persistenceHistogram m_persistence;
+    double m_persistenceSeconds = 0; // Time for hits to fade to 1/e; 0 is off, infinity never fades
+    // Frame governor.  The processing thread adds up its time in m_processingNs;
+    // the GUI thread takes it when it replots and decides the next budget.
+    frameGovernor m_governor;
+    bool m_autoFrameRate = true;
+    std::atomic<qint64> m_processingNs{0};
+    int m_displayCounter = 0;
+    int m_decoderCounter = 0;
+    zoomViews m_zoomViews;
+    // GUI thread's side of the zoom views
+    struct zoomAxes
+    {
+        QCPAxisRect *rect;
+        QCPGraph *ch1;
+        QCPGraph *ch2;
+        QCPItemRect *marker; // Where the view is, on the main plot
+        ZoomWindow window;
+    };
+    std::vector<zoomAxes> m_zoomAxes;
+    bool zoomWheel(QWheelEvent *event);
+    // Scale and bias the last analogConvert() applied, AC coupling included
+    double m_lastConvertScale = 1;
+    double m_lastConvertBias = 0;
+    // Frames before this are allowed to grow the arena; see allocationcounter.h
+    static constexpr int kArenaWarmupFrames = 100;
+    int m_framesProcessed = 0;
+#ifndef DISABLE_SPECTRUM
+    bool m_distortionShown = false;
+    bool m_crossCorrelationShown = false;
+    bool m_jitterShown = false;
+#endif
     //Variables that are just pointers to other classes/vars
     QCustomPlot *axes; // TODO: move into DisplayControl
     char *isoTemp = NULL;
@@ -207,6 +422,10 @@ private:
     unsigned char serialType = 0;
     i2c::i2cDecoder* twoWire = nullptr;
     bool twoWireStateInvalid = true;
+    // The GUI thread's handle on the same decoder, for its console records
+    QPointer<i2c::i2cDecoder> m_twoWireConsole;
+    // Runs the serial and I2C decoders off the processing thread
+    decoderWorker *m_decoderWorker;
     //Generic Vars
     QTimer* isoTimer = NULL;
     QTimer *slowTimer = NULL;
@@ -220,26 +439,35 @@ private:
     double daqLoad_startTime, daqLoad_endTime;
 #ifndef DISABLE_SPECTRUM
     //Spectrum
-    int m_spectrumCounter = 0;
+    int m_spectrumCounter = 0; // Eye diagram only; the spectrum paces itself
     AsyncDFT *m_asyncDFT;
+    spectrogram *m_spectrogram;
+    QCPAxisRect *m_waterfallRect = nullptr;
+    QCPColorMap *m_waterfallMap = nullptr;
     double m_spectrumMinY = -60;
     double m_spectrumMaxY = 90;
-    int m_windowingType = 0;
-    QVector<double> m_windowFactors;
-    double m_windowFactorsSum;
+    //CH1 against CH2
+    crossCorrelator *m_crossCorrelator;
+    crossCorrelationFigures m_crossFigures;
+    uint64_t m_crossCorrelatedAt = 0;   // CH1's m_sampleCount at the last start
+    int m_crossCorrelatedCount = 0;
+    //Eye diagram
+    eyeHistogram m_eye;
+    //Jitter, on CH1
+    clockRecovery m_clockRecovery;
     //Frequency response
-    QVector<double> m_freqRespFreq;
-    QVector<double> m_freqRespGain;
-    QVector<double> m_freqRespPhase;
-    double m_freqRespMin = 100;
-    double m_freqRespMax = 32500;
-    double m_freqRespStep = 100;
+    lockInDemodulator m_freqRespDemod;
+    bodeSweep m_bodeSweep;
     int m_freqRespType = 0;
-    bool m_freqRespFlag = false;
 
 #endif
 
 signals:
+    void frameReady();
+#ifndef DISABLE_SPECTRUM
+    // From the processing thread, for the signal generator
+    void freqRespFrequencyRequested(double frequency);
+#endif
     void setGain(double newGain);
     void disableWindow(bool enabled);
     void setCursorStatsVisible(bool enabled);
@@ -274,6 +502,7 @@ signals:
 public slots:
     void setVoltageRange(QWheelEvent *event);
     void timerTick(void);
+    void renderFrame(void);
     void pauseEnable_CH1(bool enabled);
     void pauseEnable_CH2(bool enabled);
     void pauseEnable_multimeter(bool enabled);
@@ -337,13 +566,25 @@ public slots:
     void attenuationChanged_CH2(int attenuationIndex);
     void setHexDisplay_CH1(bool enabled);
     void setHexDisplay_CH2(bool enabled);
+    void exportDecoded(QString fileName);
 #ifndef DISABLE_SPECTRUM
     void setWindowingType(int windowing);
+    void setSpectrumSize(int size);
+    void setSpectrumAverages(int averages);
+    void setSpectrumOverlap(double overlap);
+    void setWaterfall(bool enabled);
+    void setDistortionShown(bool shown);
+    void setCrossCorrelationShown(bool shown);
+    void setJitterShown(bool shown);
+    void exportJitter(QString fileName);
     void setMinFreqResp(double minFreqResp);
     void setMaxFreqResp(double maxFreqResp);
     void setFreqRespStep(double stepFreqResp);
     void setFreqRespType(int typeFreqResp);
+    void setFreqRespLog(bool log);
+    void setFreqRespPointsPerDecade(int pointsPerDecade);
     void restartFreqResp();
+    void exportFreqResp(QString fileName);
 
     void logSpacingEnableHor(bool horLogSpace);
     void retickXAxis();
@@ -0,0 +1,14 @@
+#ifndef JITTER_H
+#define JITTER_H
+
+// Jitter of a recovered clock's edges over the last record
+struct jitterFigures
+{
+    bool locked = false;
+    double unitInterval = 0;    // Seconds; 0 until a rate has been acquired
+    int edges = 0;              // In the record
+    double rms = 0;             // Seconds of time interval error, mean taken out
+    double peakToPeak = 0;      // Seconds
+};
+
+#endif // JITTER_H
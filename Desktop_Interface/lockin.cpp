@@ -0,0 +1,177 @@
+#include "lockin.h"
+#include "isobuffer.h"
+#include <algorithm>
+#include <cmath>
+
+#define PI 3.141592653589793  // Predefined value for pi
+
+lockInDemodulator::lockInDemodulator()
+{
+    // So a backlog never allocates on the processing thread
+    for (std::vector<short>& raw : m_raw)
+        raw.reserve(kMaxBacklog);
+}
+
+void lockInDemodulator::reset(double frequency)
+{
+    m_frequency = frequency;
+    // The next update() picks up from the buffers as they are then
+    m_buffers[0] = m_buffers[1] = nullptr;
+    m_goodBlocks = 0;
+    m_badBlocks = 0;
+    m_ratioSum = 0;
+    m_ratioNormSum = 0;
+    m_lastBlock = BlockFit::None;
+}
+
+void lockInDemodulator::update(isoBuffer const* ch1, isoBuffer const* ch2, double scale1, double scale2)
+{
+    if (m_frequency <= 0)
+        return;
+    m_scales[0] = scale1;
+    m_scales[1] = scale2;
+
+    isoBuffer const* buffers[2] = {ch1, ch2};
+    if (ch1 != m_buffers[0] || ch2 != m_buffers[1]) {
+        m_buffers[0] = ch1;
+        m_buffers[1] = ch2;
+        m_positions[0] = ch1->m_sampleCount;
+        m_positions[1] = ch2->m_sampleCount;
+
+        // Blocks of whole periods, so the mixing products cancel
+        double const samplesPerSecond = ch1->m_samplesPerSecond;
+        double const period = samplesPerSecond / m_frequency;
+        double const periods = std::ceil(kMinBlockSamples / period);
+        m_blockLength = std::max(1, int(std::lround(periods * period)));
+        double const radiansPerSample = 2 * PI * m_frequency / samplesPerSecond;
+        m_stepRe = std::cos(radiansPerSample);
+        m_stepIm = -std::sin(radiansPerSample);
+        m_settleSamples = int64_t(kSettleSeconds * samplesPerSecond + 2 * period);
+        restartBlock();
+        return;
+    }
+
+    uint64_t arrived = std::min(ch1->m_sampleCount - m_positions[0], ch2->m_sampleCount - m_positions[1]);
+    m_positions[0] = ch1->m_sampleCount;
+    m_positions[1] = ch2->m_sampleCount;
+    if (arrived == 0)
+        return;
+    // Anything older than the backlog is lost, and a block can't span the gap
+    if (arrived > kMaxBacklog) {
+        arrived = kMaxBacklog;
+        restartBlock();
+    }
+
+    uint32_t got[2];
+    for (int channel = 0; channel < 2; ++channel) {
+        m_raw[channel].resize(arrived);
+        got[channel] = buffers[channel]->readLatest(m_raw[channel].data(), uint32_t(arrived));
+    }
+    // Fewer come back if a buffer has been cleared since; the newest still line up
+    uint32_t const count = std::min(got[0], got[1]);
+    if (count < arrived)
+        restartBlock();
+
+    uint32_t const skip = uint32_t(std::min<int64_t>(count, m_settleSamples));
+    m_settleSamples -= skip;
+    mix(m_raw[0].data() + got[0] - count + skip, m_raw[1].data() + got[1] - count + skip, int(count - skip));
+}
+
+void lockInDemodulator::mix(short const* x1, short const* x2, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        double const a = x1[i];
+        double const b = x2[i];
+        m_mixedRe[0] += a * m_phasorRe;
+        m_mixedIm[0] += a * m_phasorIm;
+        m_mixedRe[1] += b * m_phasorRe;
+        m_mixedIm[1] += b * m_phasorIm;
+        m_phasorSumRe += m_phasorRe;
+        m_phasorSumIm += m_phasorIm;
+        m_sum[0] += a;
+        m_sum[1] += b;
+        m_sumSquares[0] += a * a;
+        m_sumSquares[1] += b * b;
+
+        double const re = m_phasorRe * m_stepRe - m_phasorIm * m_stepIm;
+        m_phasorIm = m_phasorRe * m_stepIm + m_phasorIm * m_stepRe;
+        m_phasorRe = re;
+
+        if (++m_blockSamples == m_blockLength)
+            finishBlock();
+    }
+}
+
+void lockInDemodulator::finishBlock()
+{
+    double const n = m_blockSamples;
+    // Same limits on the residual, relative to the amplitude, as the least
+    // squares fit this replaced
+    double const residualLimit[2] = {0.1, 2};
+    std::complex<double> response[2];
+    bool good = true;
+    for (int channel = 0; channel < 2; ++channel) {
+        double const scale = m_scales[channel];
+        double const mean = m_sum[channel] / n;
+        // Take out the DC that leaks in where the block isn't exactly whole periods
+        response[channel] = scale * std::complex<double>(m_mixedRe[channel] - mean * m_phasorSumRe,
+                                                         m_mixedIm[channel] - mean * m_phasorSumIm);
+        double const amplitude = 2 * std::abs(response[channel]) / n;
+        // What the sinusoid doesn't account for
+        double const variance = scale * scale * std::max(m_sumSquares[channel] / n - mean * mean, 0.0);
+        double const residual = variance - amplitude * amplitude / 2;
+        double const limit = residualLimit[channel] * amplitude;
+        good &= amplitude > 0 && residual <= limit * limit;
+    }
+
+    if (good) {
+        std::complex<double> const ratio = response[1] / response[0];
+        m_ratioSum += ratio;
+        m_ratioNormSum += std::norm(ratio);
+        m_goodBlocks++;
+        m_lastBlock = BlockFit::Good;
+    } else {
+        m_badBlocks++;
+        m_lastBlock = BlockFit::Bad;
+    }
+
+    // Keep the oscillator on the unit circle
+    double const magnitude = std::hypot(m_phasorRe, m_phasorIm);
+    m_phasorRe /= magnitude;
+    m_phasorIm /= magnitude;
+    restartBlock();
+}
+
+void lockInDemodulator::restartBlock()
+{
+    m_blockSamples = 0;
+    for (int channel = 0; channel < 2; ++channel) {
+        m_mixedRe[channel] = m_mixedIm[channel] = 0;
+        m_sum[channel] = m_sumSquares[channel] = 0;
+    }
+    m_phasorSumRe = m_phasorSumIm = 0;
+}
+
+bool lockInDemodulator::converged() const
+{
+    if (m_goodBlocks >= kMaxBlocks)
+        return true;
+    if (m_goodBlocks < kMinBlocks)
+        return false;
+
+    // Standard error of the mean ratio, relative to its size
+    double const k = m_goodBlocks;
+    std::complex<double> const mean = m_ratioSum / k;
+    double const variance = std::max(m_ratioNormSum - k * std::norm(mean), 0.0) / (k - 1);
+    return std::sqrt(variance / k) <= kTolerance * std::abs(mean);
+}
+
+double lockInDemodulator::gain_dB() const
+{
+    return 20 * std::log10(std::abs(m_ratioSum / double(m_goodBlocks)));
+}
+
+double lockInDemodulator::phaseDegrees() const
+{
+    return std::arg(m_ratioSum) * 180.0 / PI;
+}
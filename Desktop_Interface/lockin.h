@@ -0,0 +1,91 @@
+#ifndef LOCKIN_H
+#define LOCKIN_H
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+class isoBuffer;
+
+// Frequency response estimator.  Follows CH1 and CH2 sample by sample,
+// mixing both with one quadrature oscillator at the generator frequency
+// and summing over blocks of whole periods: a lock-in amplifier with a
+// boxcar filter.  Each block gives both channels' amplitude and phase at
+// that frequency in one pass, and their ratio H = CH2/CH1.  H is averaged
+// over blocks until its standard error is small, so a clean point ends
+// after a few blocks and a noisy one gets more.
+class lockInDemodulator
+{
+public:
+    enum class BlockFit : uint8_t
+    {
+        None,   // No block finished yet at this frequency
+        Good,
+        Bad     // Too far from a sinusoid at the generator frequency
+    };
+
+    lockInDemodulator();
+
+    // Starts afresh at frequency.  The first stretch after a change is
+    // skipped, while the generator and the input settle.
+    void reset(double frequency);
+    double frequency() const { return m_frequency; }
+
+    // Mixes everything that has arrived since the last call.  scale turns
+    // each channel's raw samples into volts; offsets don't matter here.
+    void update(isoBuffer const* ch1, isoBuffer const* ch2, double scale1, double scale2);
+
+    BlockFit lastBlock() const { return m_lastBlock; }
+    // Either enough good blocks to trust, or too many bad ones
+    bool finished() const { return converged() || m_badBlocks > kMaxBadBlocks; }
+    bool converged() const;
+    double gain_dB() const;
+    double phaseDegrees() const;
+
+private:
+    void mix(short const* x1, short const* x2, int count);
+    void finishBlock();
+    void restartBlock();
+
+    static const int kMinBlockSamples = 2048;
+    static const int kMinBlocks = 3;
+    static const int kMaxBlocks = 40;
+    static const int kMaxBadBlocks = 10;
+    static const uint32_t kMaxBacklog = 1 << 18;
+    static constexpr double kSettleSeconds = 0.05;
+    static constexpr double kTolerance = 0.002; // Relative standard error of H, about 0.02 dB
+
+    double m_frequency = 0;
+    isoBuffer const* m_buffers[2] = {nullptr, nullptr};
+    uint64_t m_positions[2] = {0, 0};
+    int64_t m_settleSamples = 0;
+    std::vector<short> m_raw[2];
+
+    // Oscillator e^-jwn, advanced by multiplying with m_step every sample.
+    // Kept as plain doubles, as std::complex multiplication checks for
+    // infinities on every call.
+    double m_phasorRe = 1;
+    double m_phasorIm = 0;
+    double m_stepRe = 1;
+    double m_stepIm = 0;
+    int m_blockLength = kMinBlockSamples;
+    double m_scales[2] = {1, 1};
+
+    // This block so far: sums of x times the phasor, of the phasor, of x and of x^2, in raw units
+    int m_blockSamples = 0;
+    double m_mixedRe[2] = {0, 0};
+    double m_mixedIm[2] = {0, 0};
+    double m_phasorSumRe = 0;
+    double m_phasorSumIm = 0;
+    double m_sum[2] = {0, 0};
+    double m_sumSquares[2] = {0, 0};
+
+    // Good blocks at this frequency
+    int m_goodBlocks = 0;
+    int m_badBlocks = 0;
+    std::complex<double> m_ratioSum;
+    double m_ratioNormSum = 0;
+    BlockFit m_lastBlock = BlockFit::None;
+};
+
+#endif // LOCKIN_H
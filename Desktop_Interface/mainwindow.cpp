@@ -3,6 +3,10 @@
 #include "daqform.h"
 #include <QDesktopServices>
 #include "espospinbox.h"
+#include "framegraph.h"
+#ifndef DISABLE_SPECTRUM
+#include "asyncdft.h"
+#endif
 
 #if defined(PLATFORM_WINDOWS)
 #include "winusbdriver.h"
@@ -11,6 +15,7 @@
 #endif
 
 #include <algorithm>
+#include <limits>
 #include <QStandardPaths>
 
 #define DO_QUOTE(X) #X
@@ -63,6 +68,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
 #ifndef DISABLE_SPECTRUM
     ui->controller_iso->freqValue_CH1 = ui->frequencyValue_CH1;
+    ui->controller_iso->freqRespGenerator = ui->controller_fg->getChannelController(functionGen::ChannelID::CH1);
+    connect(ui->controller_iso, &isoDriver::freqRespFrequencyRequested, ui->frequencyValue_CH1, &espoSpinBox::setValue);
 #endif
 
     ui->timeBaseSlider->setMaximum(10*log10(MAX_WINDOW_SIZE));
@@ -202,11 +209,23 @@ MainWindow::MainWindow(QWidget *parent) :
     QHBoxLayout* spectrumLayout = new QHBoxLayout(spectrumLayoutWidget);
     QLabel* windowingLabel = new QLabel("Window");
     windowingComboBox = new QComboBox();
+    QLabel* fftSizeLabel = new QLabel("FFT size");
+    fftSizeComboBox = new QComboBox();
+    QLabel* averagesLabel = new QLabel("Averages");
+    averagesSpinBox = new QSpinBox();
+    QLabel* overlapLabel = new QLabel("Overlap");
+    overlapComboBox = new QComboBox();
     QLabel* logSpacingLabelSpec = new QLabel("Log Space Freq.");
 
     logHorCheckSpectrum = new QCheckBox(spectrumLayoutWidget);
+    QLabel* waterfallLabel = new QLabel("Waterfall");
+    waterfallCheckSpectrum = new QCheckBox(spectrumLayoutWidget);
+    QLabel* distortionLabel = new QLabel("Distortion");
+    QCheckBox* distortionCheckSpectrum = new QCheckBox(spectrumLayoutWidget);
 
     connect(logHorCheckSpectrum, SIGNAL(toggled(bool)), ui->controller_iso, SLOT(logSpacingEnableHor(bool)));
+    connect(waterfallCheckSpectrum, SIGNAL(toggled(bool)), ui->controller_iso, SLOT(setWaterfall(bool)));
+    connect(distortionCheckSpectrum, &QCheckBox::toggled, ui->controller_iso, &isoDriver::setDistortionShown);
 
     spectrumLayoutWidget->setLayout(spectrumLayout);
     windowingComboBox->addItem("Rectangular");
@@ -215,16 +234,44 @@ MainWindow::MainWindow(QWidget *parent) :
     windowingComboBox->addItem("Blackman");
     windowingComboBox->addItem("Flat top");
     windowingComboBox->setCurrentIndex(0);
+    for (int size = AsyncDFT::kMinSize; size <= AsyncDFT::kMaxSize; size *= 2)
+        fftSizeComboBox->addItem(size < (1 << 20) ? QString("%1k").arg(size >> 10) : QString("%1M").arg(size >> 20), size);
+    fftSizeComboBox->setCurrentIndex(fftSizeComboBox->findData(AsyncDFT::n_samples));
+    averagesSpinBox->setRange(1, 64);
+    averagesSpinBox->setValue(1);
+    overlapComboBox->addItem("0%", 0.0);
+    overlapComboBox->addItem("50%", 0.5);
+    overlapComboBox->addItem("75%", 0.75);
+    overlapComboBox->setCurrentIndex(1);
 
     spectrumLayout->addStretch();
     spectrumLayout->addWidget(windowingLabel);
     spectrumLayout->addWidget(windowingComboBox);
     spectrumLayout->addStretch();
+    spectrumLayout->addWidget(fftSizeLabel);
+    spectrumLayout->addWidget(fftSizeComboBox);
+    spectrumLayout->addStretch();
+    spectrumLayout->addWidget(averagesLabel);
+    spectrumLayout->addWidget(averagesSpinBox);
+    spectrumLayout->addWidget(overlapLabel);
+    spectrumLayout->addWidget(overlapComboBox);
+    spectrumLayout->addStretch();
     spectrumLayout->addWidget(logSpacingLabelSpec);
     spectrumLayout->addWidget(logHorCheckSpectrum);
+    spectrumLayout->addWidget(waterfallLabel);
+    spectrumLayout->addWidget(waterfallCheckSpectrum);
+    spectrumLayout->addWidget(distortionLabel);
+    spectrumLayout->addWidget(distortionCheckSpectrum);
     spectrumLayout->addStretch();
 
     connect(windowingComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), ui->controller_iso, &isoDriver::setWindowingType);
+    connect(fftSizeComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index){
+        ui->controller_iso->setSpectrumSize(fftSizeComboBox->itemData(index).toInt());
+    });
+    connect(averagesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), ui->controller_iso, &isoDriver::setSpectrumAverages);
+    connect(overlapComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index){
+        ui->controller_iso->setSpectrumOverlap(overlapComboBox->itemData(index).toDouble());
+    });
 
     ui->verticalLayout->addWidget(spectrumLayoutWidget);
     spectrumLayoutWidget->setVisible(false);
@@ -236,17 +283,22 @@ MainWindow::MainWindow(QWidget *parent) :
     freqRespMaxXSpinbox   = new espoSpinBox();
     freqRespStepSpinbox   = new espoSpinBox();
     freqRespTypeComboBox  = new QComboBox();
+    freqRespPointsSpinBox = new QSpinBox();
     freqRespRestartButton = new QPushButton("Restart");
+    freqRespExportButton  = new QPushButton("Export");
     QHBoxLayout* freqRespLayout1 = new QHBoxLayout(freqRespLayout1Widget);
     QHBoxLayout* freqRespLayout2 = new QHBoxLayout(freqRespLayout2Widget);
     QLabel* freqRespMinFreqLabel = new QLabel("Min Frequency");
     QLabel* freqRespMaxFreqLabel = new QLabel("Max Frequency");
     QLabel* freqRespStepLabel = new QLabel("Step");
+    QLabel* freqRespPointsLabel = new QLabel("Points/Decade");
     QLabel* freqRespTypeLabel = new QLabel("Response");
     QLabel* logSpacingLabelResp = new QLabel("Log Space Freq.");
 
     logHorCheckResp = new QCheckBox(freqRespLayout1Widget);
     connect(logHorCheckResp, SIGNAL(toggled(bool)), ui->controller_iso, SLOT(logSpacingEnableHor(bool)));
+    // Log spaced axis, log spaced sweep
+    connect(logHorCheckResp, &QCheckBox::toggled, ui->controller_iso, &isoDriver::setFreqRespLog);
 
     freqRespLayout1Widget->setLayout(freqRespLayout1);
     freqRespMinXSpinbox->setSuffix(QString::fromUtf8("Hz"));
@@ -274,6 +326,9 @@ MainWindow::MainWindow(QWidget *parent) :
     freqRespStepSpinbox->setRange(10, 10000);
     freqRespStepSpinbox->setValue(100);
     freqRespStepSpinbox->setSingleStep(10);
+    freqRespPointsSpinBox->setRange(1, 100);
+    freqRespPointsSpinBox->setValue(20);
+    freqRespPointsSpinBox->setEnabled(false);
     freqRespTypeComboBox->addItem("Gain");
     freqRespTypeComboBox->addItem("Phase");
     freqRespTypeComboBox->setCurrentIndex(0);
@@ -282,17 +337,30 @@ MainWindow::MainWindow(QWidget *parent) :
     freqRespLayout2->addWidget(freqRespStepLabel);
     freqRespLayout2->addWidget(freqRespStepSpinbox);
     freqRespLayout2->addStretch();
+    freqRespLayout2->addWidget(freqRespPointsLabel);
+    freqRespLayout2->addWidget(freqRespPointsSpinBox);
+    freqRespLayout2->addStretch();
     freqRespLayout2->addWidget(freqRespTypeLabel);
     freqRespLayout2->addWidget(freqRespTypeComboBox);
     freqRespLayout2->addStretch();
     freqRespLayout2->addWidget(freqRespRestartButton);
+    freqRespLayout2->addWidget(freqRespExportButton);
     freqRespLayout2->addStretch();
 
     connect(freqRespMinXSpinbox, QOverload<double>::of(&espoSpinBox::valueChanged), ui->controller_iso, &isoDriver::setMinFreqResp);
     connect(freqRespMaxXSpinbox, QOverload<double>::of(&espoSpinBox::valueChanged), ui->controller_iso, &isoDriver::setMaxFreqResp);
     connect(freqRespStepSpinbox, QOverload<double>::of(&espoSpinBox::valueChanged), ui->controller_iso, &isoDriver::setFreqRespStep);
     connect(freqRespTypeComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), ui->controller_iso, &isoDriver::setFreqRespType);
+    connect(freqRespPointsSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), ui->controller_iso, &isoDriver::setFreqRespPointsPerDecade);
     connect(freqRespRestartButton, &QPushButton::clicked, ui->controller_iso, &isoDriver::restartFreqResp);
+    connect(freqRespExportButton, &QPushButton::clicked, this, [this]{
+        QString fileName;
+        showFileDialog(&fileName);
+        if (!fileName.isEmpty())
+            ui->controller_iso->exportFreqResp(fileName);
+    });
+    connect(logHorCheckResp, &QCheckBox::toggled, freqRespStepSpinbox, &QWidget::setDisabled);
+    connect(logHorCheckResp, &QCheckBox::toggled, freqRespPointsSpinBox, &QWidget::setEnabled);
 
     connect(freqRespMinXSpinbox, QOverload<double>::of(&espoSpinBox::valueChanged), freqRespMaxXSpinbox, &espoSpinBox::setMinimum);
     connect(freqRespMaxXSpinbox, QOverload<double>::of(&espoSpinBox::valueChanged), freqRespMinXSpinbox, &espoSpinBox::setMaximum);
@@ -345,19 +413,40 @@ MainWindow::~MainWindow()
     // delete ui;
 }
 
+// Graphs that isoDriver::renderFrame() feeds frame by frame.  Under QCP1
+// they draw straight from the frame buffers (see frameGraph).
+void MainWindow::addTraceGraph()
+{
+#if QCP_VER == 1
+    ui->scopeAxes->addPlottable(new frameGraph(ui->scopeAxes->xAxis, ui->scopeAxes->yAxis));
+#else
+    ui->scopeAxes->addGraph();
+#endif
+}
+
 void MainWindow::initialisePlot()
 {
     auto xyCurve = new QCPCurve(ui->scopeAxes->xAxis, ui->scopeAxes->yAxis);
     xyCurve->setPen(QPen(Qt::yellow, 1));
     ui->scopeAxes->addPlottable(xyCurve);
-    ui->scopeAxes->addGraph(); // Oscilloscope CH1 / Logic Analyzer CH1
-    ui->scopeAxes->addGraph(); // Oscilloscope CH2 / Logic Analyzer CH1 / Logic Analyzer CH2
+    addTraceGraph(); // Oscilloscope CH1 / Logic Analyzer CH1
+    addTraceGraph(); // Oscilloscope CH2 / Logic Analyzer CH1 / Logic Analyzer CH2
     ui->scopeAxes->addGraph(); // Vertical cursor begin
     ui->scopeAxes->addGraph(); // Vertical cursor end
     ui->scopeAxes->addGraph(); // Horizontal cursor begin
     ui->scopeAxes->addGraph(); // Horizontal cursor end
-    for(int i=0; i<=94; ++i)
-        ui->scopeAxes->addGraph(); // eye diagram
+
+    // Intensity-graded persistence, underneath the grid and the traces
+    ui->scopeAxes->addLayer("persistence", ui->scopeAxes->layer("grid"), QCustomPlot::limBelow);
+    auto persistenceMap = new QCPColorMap(ui->scopeAxes->xAxis, ui->scopeAxes->yAxis);
+#if QCP_VER == 1
+    ui->scopeAxes->addPlottable(persistenceMap);
+#endif
+    persistenceMap->setLayer("persistence");
+    persistenceMap->setGradient(QCPColorGradient::gpThermal);
+    persistenceMap->setInterpolate(false);
+    persistenceMap->setVisible(false);
+    ui->controller_iso->persistenceMap = persistenceMap;
 
     defaultNumberFormat = ui->scopeAxes->xAxis->numberFormat();
 #if QCP_VER == 1
@@ -430,13 +519,55 @@ void MainWindow::initialisePlot()
     triggerFrequencyLabel->setBrush(QBrush(Qt::black));
 
 
+    auto distortionLabel = new QCPItemText(ui->scopeAxes);
+    ui->scopeAxes->addItem(distortionLabel);
+    distortionLabel->setPositionAlignment(Qt::AlignTop|Qt::AlignLeft);
+    distortionLabel->position->setType(QCPItemPosition::ptAxisRectRatio);
+    distortionLabel->position->setCoords(0.01, 0);
+    distortionLabel->setTextAlignment(Qt::AlignTop|Qt::AlignLeft);
+    distortionLabel->setText("Distortion Figures Here");
+    distortionLabel->setFont(labelFont);
+    distortionLabel->setColor(Qt::white);
+    distortionLabel->setPen(QPen(Qt::white));
+    distortionLabel->setBrush(QBrush(Qt::black));
+
+    auto crossCorrelationLabel = new QCPItemText(ui->scopeAxes);
+    ui->scopeAxes->addItem(crossCorrelationLabel);
+    crossCorrelationLabel->setPositionAlignment(Qt::AlignTop|Qt::AlignLeft);
+    crossCorrelationLabel->position->setType(QCPItemPosition::ptAxisRectRatio);
+    crossCorrelationLabel->position->setCoords(0.01, 0);
+    crossCorrelationLabel->setTextAlignment(Qt::AlignTop|Qt::AlignLeft);
+    crossCorrelationLabel->setText("Cross-correlation Figures Here");
+    crossCorrelationLabel->setFont(labelFont);
+    crossCorrelationLabel->setColor(Qt::white);
+    crossCorrelationLabel->setPen(QPen(Qt::white));
+    crossCorrelationLabel->setBrush(QBrush(Qt::black));
+
+    auto jitterLabel = new QCPItemText(ui->scopeAxes);
+    ui->scopeAxes->addItem(jitterLabel);
+    jitterLabel->setPositionAlignment(Qt::AlignTop|Qt::AlignRight);
+    jitterLabel->position->setType(QCPItemPosition::ptAxisRectRatio);
+    jitterLabel->position->setCoords(0.99, 0);
+    jitterLabel->setTextAlignment(Qt::AlignTop|Qt::AlignLeft);
+    jitterLabel->setText("Jitter Figures Here");
+    jitterLabel->setFont(labelFont);
+    jitterLabel->setColor(Qt::white);
+    jitterLabel->setPen(QPen(Qt::white));
+    jitterLabel->setBrush(QBrush(Qt::black));
+
     cursorLabel->setVisible(false);
     triggerFrequencyLabel->setVisible(false);
+    distortionLabel->setVisible(false);
+    crossCorrelationLabel->setVisible(false);
+    jitterLabel->setVisible(false);
     ui->controller_iso->cursorLabel = cursorLabel;
     ui->controller_iso->triggerFrequencyLabel = triggerFrequencyLabel;
     ui->controller_iso->fSpaceLabel = fSpaceLabel;
     ui->controller_iso->freqRespStatusLabel = freqRespStatusLabel;
     ui->controller_iso->freqRespStatusMark = freqRespStatusMark;
+    ui->controller_iso->distortionLabel = distortionLabel;
+    ui->controller_iso->crossCorrelationLabel = crossCorrelationLabel;
+    ui->controller_iso->jitterLabel = jitterLabel;
 
 
     ui->scopeAxes->yAxis->setAutoTickCount(9);
@@ -465,8 +596,6 @@ void MainWindow::initialisePlot()
     ui->scopeAxes->graph(3)->setPen(cursorDashPen);
     ui->scopeAxes->graph(4)->setPen(cursorSolidPen);
     ui->scopeAxes->graph(5)->setPen(cursorDashPen);
-    for(int i=0; i<=94; ++i)
-        ui->scopeAxes->graph(6+i)->setPen(QPen(Qt::yellow, 1));
 
     ui->scopeAxes->xAxis->setBasePen(axisPen);
     ui->scopeAxes->yAxis->setBasePen(axisPen);
@@ -562,6 +691,7 @@ void MainWindow::menuSetup(){
     rangeGroupC->addAction(ui->action_F);
 
     fpsGroup = new QActionGroup(this);
+    fpsGroup->addAction(ui->actionAutoFPS);
     fpsGroup->addAction(ui->action60FPS);
     fpsGroup->addAction(ui->action30FPS);
     fpsGroup->addAction(ui->action20FPS);
@@ -569,6 +699,13 @@ void MainWindow::menuSetup(){
     fpsGroup->addAction(ui->action10FPS);
     fpsGroup->addAction(ui->action5FPS);
 
+    persistenceGroup = new QActionGroup(this);
+    persistenceGroup->addAction(ui->actionPersistence_Off);
+    persistenceGroup->addAction(ui->actionPersistence_0_5s);
+    persistenceGroup->addAction(ui->actionPersistence_2s);
+    persistenceGroup->addAction(ui->actionPersistence_10s);
+    persistenceGroup->addAction(ui->actionPersistence_Infinite);
+
     serialProtocolGroup = new QActionGroup(this);
     serialProtocolGroup->addAction(ui->actionSerial);
     serialProtocolGroup->addAction(ui->actionI2C);
@@ -1204,6 +1341,50 @@ void MainWindow::timeBaseNeedsChanging(bool positive){
     ui->timeBaseSlider->setValue(tempVal);
 }
 
+void MainWindow::on_actionPeak_Detect_triggered(bool checked)
+{
+    ui->controller_iso->peakDetect = checked;
+}
+
+void MainWindow::on_actionAdd_Zoom_View_triggered()
+{
+    ui->controller_iso->addZoomView();
+    ui->actionAdd_Zoom_View->setEnabled(ui->controller_iso->canAddZoomView());
+    ui->actionRemove_Zoom_Views->setEnabled(true);
+}
+
+void MainWindow::on_actionRemove_Zoom_Views_triggered()
+{
+    ui->controller_iso->removeZoomViews();
+    ui->actionAdd_Zoom_View->setEnabled(true);
+    ui->actionRemove_Zoom_Views->setEnabled(false);
+}
+
+void MainWindow::on_actionPersistence_Off_toggled(bool enabled)
+{
+    if(enabled) ui->controller_iso->setPersistence(0);
+}
+
+void MainWindow::on_actionPersistence_0_5s_toggled(bool enabled)
+{
+    if(enabled) ui->controller_iso->setPersistence(0.5);
+}
+
+void MainWindow::on_actionPersistence_2s_toggled(bool enabled)
+{
+    if(enabled) ui->controller_iso->setPersistence(2);
+}
+
+void MainWindow::on_actionPersistence_10s_toggled(bool enabled)
+{
+    if(enabled) ui->controller_iso->setPersistence(10);
+}
+
+void MainWindow::on_actionPersistence_Infinite_toggled(bool enabled)
+{
+    if(enabled) ui->controller_iso->setPersistence(std::numeric_limits<double>::infinity());
+}
+
 void MainWindow::on_actionForce_Square_triggered(bool checked)
 {
     forceSquare = checked;
@@ -1302,6 +1483,10 @@ void MainWindow::on_actionAutomatically_Enable_Cursors_toggled(bool enabled)
     ui->makeCursorsNicer->setTurnedOn(enabled);
 }
 
+void MainWindow::on_actionAutoFPS_toggled(bool enabled)
+{
+    ui->controller_iso->setAutoFrameRate(enabled);
+}
 void MainWindow::on_action60FPS_toggled(bool enabled)
 {
     if(enabled){
@@ -1511,12 +1696,6 @@ void MainWindow::readSettingsFile(){
     ui->controller_iso->ch2_ref = 3.3 - calibrate_vref_ch2;
     ui->controller_iso->frontendGain_CH1 = calibrate_gain_ch1;
     ui->controller_iso->frontendGain_CH2 = calibrate_gain_ch2;
-    ui->controller_iso->internalBuffer375_CH1->m_voltage_ref = 3.3 - calibrate_vref_ch1;
-    ui->controller_iso->internalBuffer750->m_voltage_ref = 3.3 - calibrate_vref_ch1;
-    ui->controller_iso->internalBuffer375_CH2->m_voltage_ref = 3.3 - calibrate_vref_ch2;
-    ui->controller_iso->internalBuffer375_CH1->m_frontendGain = calibrate_gain_ch1;
-    ui->controller_iso->internalBuffer750->m_frontendGain = calibrate_gain_ch1;
-    ui->controller_iso->internalBuffer375_CH2->m_frontendGain = calibrate_gain_ch2;
 
     if(!dt_AlreadyAskedAboutCalibration && ((calibrate_vref_ch1 == 1.65) || (calibrate_vref_ch2 == 1.65) || (calibrate_gain_ch1 == R4/(R3+R4)) || (calibrate_gain_ch2 == R4/(R3+R4)))){
         //Prompt user to calibrate if no calibration data found.
@@ -1665,12 +1844,6 @@ void MainWindow::on_actionCalibrate_triggered()
     ui->controller_iso->ch2_ref = 1.65;
     ui->controller_iso->frontendGain_CH1 = (R4/(R3+R4));
     ui->controller_iso->frontendGain_CH2 = (R4/(R3+R4));
-    ui->controller_iso->internalBuffer375_CH1->m_voltage_ref = 1.65;
-    ui->controller_iso->internalBuffer750->m_voltage_ref = 1.65;
-    ui->controller_iso->internalBuffer375_CH2->m_voltage_ref = 1.65;
-    ui->controller_iso->internalBuffer375_CH1->m_frontendGain = R4/(R3+R4);
-    ui->controller_iso->internalBuffer750->m_frontendGain = R4/(R3+R4);
-    ui->controller_iso->internalBuffer375_CH2->m_frontendGain = R4/(R3+R4);
 
     writeSettings("CalibrateVrefCH1", 1.65);
     writeSettings("CalibrateVrefCH2", 1.65);
@@ -1710,10 +1883,6 @@ void MainWindow::calibrateStage2(){
     ui->controller_iso->ch1_ref = 3.3 - vref_CH1;
     ui->controller_iso->ch2_ref = 3.3 - vref_CH2;
 
-    ui->controller_iso->internalBuffer375_CH1->m_voltage_ref = 3.3 - vref_CH1;
-    ui->controller_iso->internalBuffer750->m_voltage_ref = 3.3 - vref_CH1;
-    ui->controller_iso->internalBuffer375_CH2->m_voltage_ref = 3.3 - vref_CH2;
-
     writeSettings("CalibrateVrefCH1", vref_CH1);
     writeSettings("CalibrateVrefCH2", vref_CH2);
 
@@ -1756,9 +1925,6 @@ void MainWindow::calibrateStage3(){
     ui->controller_iso->frontendGain_CH2 = (vref_CH2 - vMeasured_CH2)*(ui->controller_iso->frontendGain_CH2)/vref_CH2;
     qDebug() << "New gain (CH1) = " << ui->controller_iso->frontendGain_CH1;
 
-    ui->controller_iso->internalBuffer375_CH1->m_frontendGain = (vref_CH1 - vMeasured_CH1)*(ui->controller_iso->frontendGain_CH1)/vref_CH1;
-    ui->controller_iso->internalBuffer750->m_frontendGain = (vref_CH1 - vMeasured_CH1)*(ui->controller_iso->frontendGain_CH1)/vref_CH1;
-    ui->controller_iso->internalBuffer375_CH2->m_frontendGain = (vref_CH2 - vMeasured_CH2)*(ui->controller_iso->frontendGain_CH2)/vref_CH2;
     writeSettings("CalibrateGainCH1", ui->controller_iso->frontendGain_CH1);
     writeSettings("CalibrateGainCH2", ui->controller_iso->frontendGain_CH2);
     calibrationMessages = new QMessageBox();
@@ -2263,6 +2429,15 @@ void MainWindow::on_actionI2C_triggered(bool checked)
     ui->controller_iso->setSerialType(1);
 }
 
+void MainWindow::on_actionExport_Decoded_triggered()
+{
+    QString fileName;
+    showFileDialog(&fileName);
+    if (fileName.isEmpty()) return;  // User cancelled
+
+    ui->controller_iso->exportDecoded(fileName);
+}
+
 void MainWindow::on_actionShow_Range_Dialog_on_Main_Page_triggered(bool checked)
 {
     if (scopeRangeSwitch == nullptr)
@@ -2451,6 +2626,8 @@ void MainWindow::on_actionFrequency_Spectrum_triggered(bool checked)
 {
     ui->controller_iso->spectrum = checked;
     spectrumLayoutWidget->setVisible(checked);
+    // The waterfall's axes only belong under the spectrum
+    ui->controller_iso->setWaterfall(checked && waterfallCheckSpectrum->isChecked());
     if(ui->controller_iso->freqResp)
     {
         ui->scopeGroup_CH1->setCheckable(true);
@@ -2502,6 +2679,7 @@ void MainWindow::on_actionFrequency_Response_triggered(bool checked)
     {
         ui->controller_iso->spectrum = false;
         spectrumLayoutWidget->setVisible(false);
+        ui->controller_iso->setWaterfall(false);
         ui->actionFrequency_Spectrum->setChecked(false);
 
         ui->controller_iso->eyeDiagram = false;
@@ -2556,6 +2734,7 @@ void MainWindow::on_actionEye_Diagram_triggered(bool checked)
     {
         ui->controller_iso->spectrum = false;
         spectrumLayoutWidget->setVisible(false);
+        ui->controller_iso->setWaterfall(false);
         ui->actionFrequency_Spectrum->setChecked(false);
 
         ui->controller_iso->freqResp = false;
@@ -2579,6 +2758,25 @@ void MainWindow::on_actionEye_Diagram_triggered(bool checked)
         ui->cursorVertCheck->setChecked(ui->controller_iso->vertCursorEnabled0);
     }
 }
+
+void MainWindow::on_actionCH2_vs_CH1_triggered(bool checked)
+{
+    ui->controller_iso->setCrossCorrelationShown(checked);
+}
+
+void MainWindow::on_actionJitter_Analysis_triggered(bool checked)
+{
+    ui->controller_iso->setJitterShown(checked);
+}
+
+void MainWindow::on_actionExport_Jitter_triggered()
+{
+    QString fileName;
+    showFileDialog(&fileName);
+    if (fileName.isEmpty()) return;  // User cancelled
+
+    ui->controller_iso->exportJitter(fileName);
+}
 #endif
 
 std::vector<uint8_t> MainWindow::uartEncode(const QString& text, UartParity parity)
@@ -58,6 +58,7 @@ private slots:
     void on_actionGainAuto_triggered();
     void on_actionCursor_Stats_triggered(bool checked);
     void on_actionAutomatically_Enable_Cursors_toggled(bool arg1);
+    void on_actionAutoFPS_toggled(bool enabled);
     void on_action60FPS_toggled(bool enabled);
     void on_action30FPS_toggled(bool enabled);
     void on_action20FPS_toggled(bool enabled);
@@ -177,6 +178,8 @@ private slots:
 
     void on_actionI2C_triggered(bool checked);
 
+    void on_actionExport_Decoded_triggered();
+
     void on_actionShow_Range_Dialog_on_Main_Page_triggered(bool checked);
 
 	void paused(bool enabled);
@@ -216,7 +219,18 @@ private slots:
     void on_actionFrequency_Spectrum_triggered(bool checked);
     void on_actionFrequency_Response_triggered(bool checked);
     void on_actionEye_Diagram_triggered(bool checked);
+    void on_actionCH2_vs_CH1_triggered(bool checked);
+    void on_actionJitter_Analysis_triggered(bool checked);
+    void on_actionExport_Jitter_triggered();
 #endif
+    void on_actionPeak_Detect_triggered(bool checked);
+    void on_actionAdd_Zoom_View_triggered();
+    void on_actionRemove_Zoom_Views_triggered();
+    void on_actionPersistence_Off_toggled(bool enabled);
+    void on_actionPersistence_0_5s_toggled(bool enabled);
+    void on_actionPersistence_2s_toggled(bool enabled);
+    void on_actionPersistence_10s_toggled(bool enabled);
+    void on_actionPersistence_Infinite_toggled(bool enabled);
 
     void on_serialEncodingCheck_CH1_toggled(bool checked);
     void on_txuart_textChanged();
@@ -249,6 +263,7 @@ private:
 
     //Generic Functions
     void initialisePlot();
+    void addTraceGraph();
     void labelPsu();
     void menuSetup();
     void initShortcuts();
@@ -269,6 +284,7 @@ private:
     QActionGroup *uartParityGroup_CH1;
     QActionGroup *uartParityGroup_CH2;
     QActionGroup *fpsGroup;
+    QActionGroup *persistenceGroup;
     QActionGroup *connectionTypeGroup;
     QActionGroup *serialProtocolGroup;
     QShortcut *shortcut_cycleBaudRate_CH1;
@@ -300,7 +316,11 @@ private:
     // Frequency spectrum
     QWidget* spectrumLayoutWidget = nullptr;
     QComboBox* windowingComboBox = nullptr;
+    QComboBox* fftSizeComboBox = nullptr;
+    QSpinBox* averagesSpinBox = nullptr;
+    QComboBox* overlapComboBox = nullptr;
     QCheckBox *logHorCheckSpectrum = nullptr;
+    QCheckBox *waterfallCheckSpectrum = nullptr;
 
     // Frequency response
     QWidget* freqRespLayout1Widget = nullptr;
@@ -309,7 +329,9 @@ private:
     espoSpinBox* freqRespMaxXSpinbox = nullptr;
     espoSpinBox* freqRespStepSpinbox = nullptr;
     QComboBox* freqRespTypeComboBox = nullptr;
+    QSpinBox* freqRespPointsSpinBox = nullptr;
     QPushButton *freqRespRestartButton = nullptr;
+    QPushButton *freqRespExportButton = nullptr;
 
     QCheckBox *logHorCheckResp = nullptr;
 
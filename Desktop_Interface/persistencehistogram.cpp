@@ -0,0 +1,64 @@
+#include "persistencehistogram.h"
+#include "samplekernels.h"
+#include <algorithm>
+#include <cstdint>
+
+void persistenceHistogram::beginFrame(double window, double delay, double vBottom, double vTop, float decay)
+{
+    if (window != m_window || delay != m_delay || vBottom != m_vBottom || vTop != m_vTop) {
+        m_window = window;
+        m_delay = delay;
+        m_vBottom = vBottom;
+        m_vTop = vTop;
+        clear();
+        return;
+    }
+
+    if (decay < 1) {
+        for (float& count : m_counts)
+            count *= decay;
+        m_maxCount *= decay;
+    }
+}
+
+void persistenceHistogram::addSamples(std::vector<short> const& raw, int windowLength, double voltsPerCount, double offset)
+{
+    int const n = std::min<int>(raw.size(), windowLength);
+    if (n == 0 || m_vTop == m_vBottom)
+        return;
+
+    // Straight from raw samples to rows, skipping volts altogether
+    double const rowsPerVolt = kRows / (m_vTop - m_vBottom);
+    m_rows.resize(n);
+    binSamples(raw.data(), m_rows.data(), n, float(voltsPerCount * rowsPerVolt), float((offset - m_vBottom) * rowsPerVolt), kRows);
+
+    auto hit = [this](int row, int column) {
+        float& count = m_counts[row * kColumns + column];
+        count += 1;
+        if (row < kRows)
+            m_maxCount = std::max(m_maxCount, count);
+    };
+
+    // Sample 0 is the newest, and belongs in the rightmost column
+    if (windowLength >= kColumns) {
+        for (int j = 0; j < kColumns; ++j) {
+            int const column = kColumns - 1 - j;
+            int const end = std::min<int64_t>((int64_t(j) + 1) * windowLength / kColumns, n);
+            for (int k = int64_t(j) * windowLength / kColumns; k < end; ++k)
+                hit(m_rows[k], column);
+        }
+    } else {
+        // Zoomed in past one sample per column, so each sample fills a few
+        for (int k = 0; k < n; ++k) {
+            int const end = std::max((k + 1) * kColumns / windowLength, k * kColumns / windowLength + 1);
+            for (int j = k * kColumns / windowLength; j < end && j < kColumns; ++j)
+                hit(m_rows[k], kColumns - 1 - j);
+        }
+    }
+}
+
+void persistenceHistogram::clear()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0.f);
+    m_maxCount = 0;
+}
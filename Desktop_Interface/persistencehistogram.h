@@ -0,0 +1,47 @@
+#ifndef PERSISTENCEHISTOGRAM_H
+#define PERSISTENCEHISTOGRAM_H
+
+#include <vector>
+
+// Intensity-graded persistence: how often the scope traces have passed
+// through each point of the screen, by display column and voltage row.
+// Every raw sample in the window is binned, not just the points plotted,
+// and old hits fade by a fixed factor per frame.
+// Only the processing thread uses it; frames get a copy.
+class persistenceHistogram
+{
+public:
+    static constexpr int kColumns = 512;
+    static constexpr int kRows = 256;
+
+    // Called once per frame before addSamples().  Starts over if the view
+    // has moved, otherwise fades what is there by decay (1 keeps everything).
+    void beginFrame(double window, double delay, double vBottom, double vTop, float decay);
+
+    // raw is newest first, as isoBuffer::readRaw() gives it.  windowLength
+    // is how many samples the whole window would hold; raw may have fewer
+    // if the buffer hasn't filled yet.  volts = raw * voltsPerCount + offset.
+    void addSamples(std::vector<short> const& raw, int windowLength, double voltsPerCount, double offset);
+
+    void clear();
+
+    // Counts row by row, kColumns per row, oldest column first
+    float const* counts() const { return m_counts.data(); }
+    float maxCount() const { return m_maxCount; }
+    double window() const { return m_window; }
+    double delay() const { return m_delay; }
+    double vBottom() const { return m_vBottom; }
+    double vTop() const { return m_vTop; }
+
+private:
+    // One spare row past the top collects samples that are off screen
+    std::vector<float> m_counts = std::vector<float>((kRows + 1) * kColumns, 0.f);
+    std::vector<unsigned short> m_rows;
+    float m_maxCount = 0;
+    double m_window = 0;
+    double m_delay = 0;
+    double m_vBottom = 0;
+    double m_vTop = 0;
+};
+
+#endif // PERSISTENCEHISTOGRAM_H
@@ -0,0 +1,114 @@
+#ifndef RENDERFRAME_H
+#define RENDERFRAME_H
+
+#include <vector>
+#include <QVector>
+#include "distortion.h"
+#include "crosscorrelation.h"
+#include "jitter.h"
+
+// Everything the GUI thread needs to draw one frame.
+// Filled in by isoDriver on the processing thread, then handed over through
+// a tripleBuffer; the GUI thread only ever reads it.
+struct RenderFrame
+{
+    enum class Type : uint8_t
+    {
+        Scope,
+        XY,
+        Spectrum,
+        FreqResp,
+        EyeDiagram,
+        Multimeter
+    };
+
+    enum class FitStatus : uint8_t
+    {
+        None,
+        Good,
+        Bad
+    };
+
+    Type type = Type::Scope;
+
+    // Main traces, drawn as graph(0) and graph(1) (or the XY curve).
+    // Scope, Spectrum and Multimeter traces are evenly spaced, with
+    // x[i] = xStart + i*xStep; x itself is only filled in where something
+    // else (snapshots, frequency response) needs it.
+    double xStart = 0;
+    double xStep = 0;
+    QVector<double> x;
+    QVector<double> ch1;
+    QVector<double> x2;
+    QVector<double> ch2;
+    bool hasCh2 = false;
+
+    // Peak detect: the min and max of every sample behind each point of a
+    // Scope trace, drawn as a band in its place.  Empty when it is off.
+    QVector<double> ch1Min;
+    QVector<double> ch1Max;
+    QVector<double> ch2Min;
+    QVector<double> ch2Max;
+
+    // Intensity-graded persistence behind a Scope trace, as laid out by
+    // persistenceHistogram::counts(), or an EyeDiagram frame's density, as
+    // laid out by eyeHistogram::counts().  Empty when it is off.
+    std::vector<float> persistence;
+    int persistenceColumns = 0;
+    int persistenceRows = 0;
+    float persistenceMax = 0;
+    double persistenceKeyLower = 0;
+    double persistenceKeyUpper = 0;
+    double persistenceValueLower = 0;
+    double persistenceValueUpper = 0;
+
+    // Waterfall under a Spectrum frame, in dBmV, as laid out by
+    // spectrogram::copyHistory().  Empty when it is off.
+    std::vector<float> waterfall;
+    double waterfallNyquist = 0;
+
+    // Distortion figures of a Spectrum frame's channels, frequencies in Hz
+    distortionFigures distortion[2];
+
+    // CH2 against CH1 under a Scope or XY frame, the newest the correlator
+    // has finished.  samples is 0 when it isn't running.
+    crossCorrelationFigures crossCorrelation;
+
+    // CH1's recovered clock, under a Scope, XY or EyeDiagram frame.
+    // unitInterval is 0 when it isn't running.
+    jitterFigures jitter;
+
+    // Zoom views: the Scope traces again over other windows of the same
+    // capture, drawn in the axis rects under the main one.  Only the first
+    // zoomCount are filled in, and only for Scope frames.
+    static constexpr int kMaxZoomViews = 4;
+    struct ZoomTrace
+    {
+        double xStart = 0;
+        double xStep = 0;
+        double xLower = 0;
+        double xUpper = 0;
+        QVector<double> ch1;
+        QVector<double> ch2;
+        QVector<double> ch1Min;
+        QVector<double> ch1Max;
+        QVector<double> ch2Min;
+        QVector<double> ch2Max;
+    };
+    ZoomTrace zooms[kMaxZoomViews];
+    int zoomCount = 0;
+
+    char const* xLabel = "";
+    char const* yLabel = "";
+    double xLower = 0;
+    double xUpper = 0;
+    double yLower = 0;
+    double yUpper = 0;
+
+    FitStatus freqRespFit = FitStatus::None;
+
+    // Of the trigger channel, in Hz; negative if there is none to time
+    double triggerFrequency = -1;
+};
+
+#endif // RENDERFRAME_H
@@ -0,0 +1,511 @@
+#include "samplekernels.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define SAMPLEKERNELS_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define KERNEL_TARGET(isa)
+    #else
+        #define KERNEL_TARGET(isa) __attribute__((target(isa)))
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    // NEON (with double-precision lanes) is part of the AArch64 baseline.
+    // 32-bit ARM NEON has no double lanes, so those builds use the scalar kernel.
+    #define SAMPLEKERNELS_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace
+{
+
+typedef sampleStats (*convertKernel)(short const*, double*, int, double, double, double const*);
+typedef void (*binKernel)(short const*, unsigned short*, int, float, float, int);
+typedef void (*decibelsKernel)(float const*, double*, int, float);
+
+sampleStats emptyStats()
+{
+    return {std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), 0, 0};
+}
+
+// Handles [begin, count).  The vector kernels use it for their tail, and it
+// is the whole kernel where there is nothing wider.
+sampleStats convertTail(short const* in, double* out, int begin, int count, double scale, double bias, double const* window, sampleStats stats)
+{
+    for (int i = begin; i < count; ++i) {
+        double const raw = in[i];
+        double v = raw * scale + bias;
+        if (window)
+            v *= window[i];
+        out[i] = v;
+
+        stats.min = std::min(stats.min, raw);
+        stats.max = std::max(stats.max, raw);
+        stats.sum += raw;
+        stats.sumSquares += raw * raw;
+    }
+    return stats;
+}
+
+sampleStats convertScalar(short const* in, double* out, int count, double scale, double bias, double const* window)
+{
+    return convertTail(in, out, 0, count, scale, bias, window, emptyStats());
+}
+
+void binTail(short const* in, unsigned short* rows, int begin, int count, float scale, float bias, int limit)
+{
+    for (int i = begin; i < count; ++i) {
+        float const v = in[i] * scale + bias;
+        rows[i] = (v >= 0 && v < limit) ? static_cast<unsigned short>(v) : static_cast<unsigned short>(limit);
+    }
+}
+
+void binScalar(short const* in, unsigned short* rows, int count, float scale, float bias, int limit)
+{
+    binTail(in, rows, 0, count, scale, bias, limit);
+}
+
+// log2 of the mantissa m in [1, 2) is 2/ln2 * atanh(t) with t = (m-1)/(m+1),
+// so at most 1/3; four terms of the atanh series leave an error under 2e-5.
+float const kLog2C1 = 2.8853900817779268f;  // 2/ln2
+float const kLog2C3 = 0.96179669392597560f; // 2/ln2 / 3
+float const kLog2C5 = 0.57707801635558536f; // 2/ln2 / 5
+float const kLog2C7 = 0.41219858311113240f; // 2/ln2 / 7
+float const kDecibelsPerOctave = 3.0102999566398120f; // 10*log10(2)
+
+void decibelsTail(float const* power, double* out, int begin, int count, float reference)
+{
+    for (int i = begin; i < count; ++i) {
+        uint32_t bits;
+        std::memcpy(&bits, power + i, sizeof bits);
+        float const exponent = static_cast<float>(static_cast<int32_t>(bits >> 23) - 127);
+        uint32_t const mantissaBits = (bits & 0x007fffff) | 0x3f800000;
+        float m;
+        std::memcpy(&m, &mantissaBits, sizeof m);
+
+        float const t = (m - 1.f) / (m + 1.f);
+        float const t2 = t * t;
+        float const series = ((kLog2C7 * t2 + kLog2C5) * t2 + kLog2C3) * t2 + kLog2C1;
+        float const log2 = exponent + t * series;
+        float const decibels = log2 * kDecibelsPerOctave + reference;
+        out[i] = decibels;
+    }
+}
+
+void decibelsScalar(float const* power, double* out, int count, float reference)
+{
+    decibelsTail(power, out, 0, count, reference);
+}
+
+// Lanes are folded into the scalar statistics before the tail runs.
+// All inputs are 16-bit integers, so the sums are exact in any order.
+sampleStats foldLanes(double const* min, double const* max, double const* sum, double const* sumSquares, int lanes)
+{
+    sampleStats stats = emptyStats();
+    for (int i = 0; i < lanes; ++i) {
+        stats.min = std::min(stats.min, min[i]);
+        stats.max = std::max(stats.max, max[i]);
+        stats.sum += sum[i];
+        stats.sumSquares += sumSquares[i];
+    }
+    return stats;
+}
+
+#ifdef SAMPLEKERNELS_X86
+
+KERNEL_TARGET("sse2")
+sampleStats convertSse2(short const* in, double* out, int count, double scale, double bias, double const* window)
+{
+    __m128d const vScale = _mm_set1_pd(scale);
+    __m128d const vBias = _mm_set1_pd(bias);
+    __m128d vMin = _mm_set1_pd(std::numeric_limits<double>::max());
+    __m128d vMax = _mm_set1_pd(std::numeric_limits<double>::lowest());
+    __m128d vSum = _mm_setzero_pd();
+    __m128d vSumSquares = _mm_setzero_pd();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i const raw16 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        // Sign-extend to 32 bits; SSE2 has no pmovsx
+        __m128i const lo32 = _mm_srai_epi32(_mm_unpacklo_epi16(raw16, raw16), 16);
+        __m128i const hi32 = _mm_srai_epi32(_mm_unpackhi_epi16(raw16, raw16), 16);
+        __m128d const raw[4] = {
+            _mm_cvtepi32_pd(lo32),
+            _mm_cvtepi32_pd(_mm_srli_si128(lo32, 8)),
+            _mm_cvtepi32_pd(hi32),
+            _mm_cvtepi32_pd(_mm_srli_si128(hi32, 8))
+        };
+
+        for (int j = 0; j < 4; ++j) {
+            vMin = _mm_min_pd(vMin, raw[j]);
+            vMax = _mm_max_pd(vMax, raw[j]);
+            vSum = _mm_add_pd(vSum, raw[j]);
+            vSumSquares = _mm_add_pd(vSumSquares, _mm_mul_pd(raw[j], raw[j]));
+
+            __m128d v = _mm_add_pd(_mm_mul_pd(raw[j], vScale), vBias);
+            if (window)
+                v = _mm_mul_pd(v, _mm_loadu_pd(window + i + 2*j));
+            _mm_storeu_pd(out + i + 2*j, v);
+        }
+    }
+
+    double min[2], max[2], sum[2], sumSquares[2];
+    _mm_storeu_pd(min, vMin);
+    _mm_storeu_pd(max, vMax);
+    _mm_storeu_pd(sum, vSum);
+    _mm_storeu_pd(sumSquares, vSumSquares);
+    return convertTail(in, out, i, count, scale, bias, window, foldLanes(min, max, sum, sumSquares, 2));
+}
+
+// Single precision, so eight samples fit one SSE2 pass.  Out-of-range lanes
+// are swapped for limit with and/andnot, as SSE2 has no blend.
+KERNEL_TARGET("sse2")
+void binSse2(short const* in, unsigned short* rows, int count, float scale, float bias, int limit)
+{
+    __m128 const vScale = _mm_set1_ps(scale);
+    __m128 const vBias = _mm_set1_ps(bias);
+    __m128 const vZero = _mm_setzero_ps();
+    __m128 const vLimit = _mm_set1_ps(static_cast<float>(limit));
+    __m128i const vLimitInt = _mm_set1_epi32(limit);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i const raw16 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        __m128i const raw32[2] = {
+            _mm_srai_epi32(_mm_unpacklo_epi16(raw16, raw16), 16),
+            _mm_srai_epi32(_mm_unpackhi_epi16(raw16, raw16), 16)
+        };
+
+        __m128i row[2];
+        for (int j = 0; j < 2; ++j) {
+            __m128 const v = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(raw32[j]), vScale), vBias);
+            __m128i const inRange = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(v, vZero), _mm_cmplt_ps(v, vLimit)));
+            row[j] = _mm_or_si128(_mm_and_si128(inRange, _mm_cvttps_epi32(v)), _mm_andnot_si128(inRange, vLimitInt));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + i), _mm_packs_epi32(row[0], row[1]));
+    }
+    binTail(in, rows, i, count, scale, bias, limit);
+}
+
+KERNEL_TARGET("sse2")
+void decibelsSse2(float const* power, double* out, int count, float reference)
+{
+    __m128i const vMantissaMask = _mm_set1_epi32(0x007fffff);
+    __m128i const vMantissaOne = _mm_set1_epi32(0x3f800000);
+    __m128i const vExponentBias = _mm_set1_epi32(127);
+    __m128 const vOne = _mm_set1_ps(1.f);
+    __m128 const vC1 = _mm_set1_ps(kLog2C1);
+    __m128 const vC3 = _mm_set1_ps(kLog2C3);
+    __m128 const vC5 = _mm_set1_ps(kLog2C5);
+    __m128 const vC7 = _mm_set1_ps(kLog2C7);
+    __m128 const vPerOctave = _mm_set1_ps(kDecibelsPerOctave);
+    __m128 const vReference = _mm_set1_ps(reference);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i const bits = _mm_castps_si128(_mm_loadu_ps(power + i));
+        __m128 const exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), vExponentBias));
+        __m128 const m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, vMantissaMask), vMantissaOne));
+
+        __m128 const t = _mm_div_ps(_mm_sub_ps(m, vOne), _mm_add_ps(m, vOne));
+        __m128 const t2 = _mm_mul_ps(t, t);
+        __m128 series = _mm_add_ps(_mm_mul_ps(vC7, t2), vC5);
+        series = _mm_add_ps(_mm_mul_ps(series, t2), vC3);
+        series = _mm_add_ps(_mm_mul_ps(series, t2), vC1);
+        __m128 const log2 = _mm_add_ps(exponent, _mm_mul_ps(t, series));
+        __m128 const decibels = _mm_add_ps(_mm_mul_ps(log2, vPerOctave), vReference);
+
+        _mm_storeu_pd(out + i, _mm_cvtps_pd(decibels));
+        _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(decibels, decibels)));
+    }
+    decibelsTail(power, out, i, count, reference);
+}
+
+KERNEL_TARGET("avx2")
+sampleStats convertAvx2(short const* in, double* out, int count, double scale, double bias, double const* window)
+{
+    __m256d const vScale = _mm256_set1_pd(scale);
+    __m256d const vBias = _mm256_set1_pd(bias);
+    __m256d vMin = _mm256_set1_pd(std::numeric_limits<double>::max());
+    __m256d vMax = _mm256_set1_pd(std::numeric_limits<double>::lowest());
+    __m256d vSum = _mm256_setzero_pd();
+    __m256d vSumSquares = _mm256_setzero_pd();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i const raw32 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)));
+        __m256d const raw[2] = {
+            _mm256_cvtepi32_pd(_mm256_castsi256_si128(raw32)),
+            _mm256_cvtepi32_pd(_mm256_extracti128_si256(raw32, 1))
+        };
+
+        for (int j = 0; j < 2; ++j) {
+            vMin = _mm256_min_pd(vMin, raw[j]);
+            vMax = _mm256_max_pd(vMax, raw[j]);
+            vSum = _mm256_add_pd(vSum, raw[j]);
+            vSumSquares = _mm256_add_pd(vSumSquares, _mm256_mul_pd(raw[j], raw[j]));
+
+            // Separate multiply and add (no FMA) to round exactly like the scalar kernel
+            __m256d v = _mm256_add_pd(_mm256_mul_pd(raw[j], vScale), vBias);
+            if (window)
+                v = _mm256_mul_pd(v, _mm256_loadu_pd(window + i + 4*j));
+            _mm256_storeu_pd(out + i + 4*j, v);
+        }
+    }
+
+    double min[4], max[4], sum[4], sumSquares[4];
+    _mm256_storeu_pd(min, vMin);
+    _mm256_storeu_pd(max, vMax);
+    _mm256_storeu_pd(sum, vSum);
+    _mm256_storeu_pd(sumSquares, vSumSquares);
+    return convertTail(in, out, i, count, scale, bias, window, foldLanes(min, max, sum, sumSquares, 4));
+}
+
+KERNEL_TARGET("avx2")
+void binAvx2(short const* in, unsigned short* rows, int count, float scale, float bias, int limit)
+{
+    __m256 const vScale = _mm256_set1_ps(scale);
+    __m256 const vBias = _mm256_set1_ps(bias);
+    __m256 const vZero = _mm256_setzero_ps();
+    __m256 const vLimit = _mm256_set1_ps(static_cast<float>(limit));
+    __m256i const vLimitInt = _mm256_set1_epi32(limit);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i const raw32 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)));
+        __m256 const v = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(raw32), vScale), vBias);
+        __m256 const inRange = _mm256_and_ps(_mm256_cmp_ps(v, vZero, _CMP_GE_OQ), _mm256_cmp_ps(v, vLimit, _CMP_LT_OQ));
+        __m256i const row = _mm256_blendv_epi8(vLimitInt, _mm256_cvttps_epi32(v), _mm256_castps_si256(inRange));
+        // packs works within each 128-bit half, so pack the halves explicitly to keep the order
+        __m128i const packed = _mm_packs_epi32(_mm256_castsi256_si128(row), _mm256_extracti128_si256(row, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + i), packed);
+    }
+    binTail(in, rows, i, count, scale, bias, limit);
+}
+
+KERNEL_TARGET("avx2")
+void decibelsAvx2(float const* power, double* out, int count, float reference)
+{
+    __m256i const vMantissaMask = _mm256_set1_epi32(0x007fffff);
+    __m256i const vMantissaOne = _mm256_set1_epi32(0x3f800000);
+    __m256i const vExponentBias = _mm256_set1_epi32(127);
+    __m256 const vOne = _mm256_set1_ps(1.f);
+    __m256 const vC1 = _mm256_set1_ps(kLog2C1);
+    __m256 const vC3 = _mm256_set1_ps(kLog2C3);
+    __m256 const vC5 = _mm256_set1_ps(kLog2C5);
+    __m256 const vC7 = _mm256_set1_ps(kLog2C7);
+    __m256 const vPerOctave = _mm256_set1_ps(kDecibelsPerOctave);
+    __m256 const vReference = _mm256_set1_ps(reference);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i const bits = _mm256_castps_si256(_mm256_loadu_ps(power + i));
+        __m256 const exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), vExponentBias));
+        __m256 const m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, vMantissaMask), vMantissaOne));
+
+        // Separate multiplies and adds (no FMA), as in the scalar kernel
+        __m256 const t = _mm256_div_ps(_mm256_sub_ps(m, vOne), _mm256_add_ps(m, vOne));
+        __m256 const t2 = _mm256_mul_ps(t, t);
+        __m256 series = _mm256_add_ps(_mm256_mul_ps(vC7, t2), vC5);
+        series = _mm256_add_ps(_mm256_mul_ps(series, t2), vC3);
+        series = _mm256_add_ps(_mm256_mul_ps(series, t2), vC1);
+        __m256 const log2 = _mm256_add_ps(exponent, _mm256_mul_ps(t, series));
+        __m256 const decibels = _mm256_add_ps(_mm256_mul_ps(log2, vPerOctave), vReference);
+
+        _mm256_storeu_pd(out + i, _mm256_cvtps_pd(_mm256_castps256_ps128(decibels)));
+        _mm256_storeu_pd(out + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(decibels, 1)));
+    }
+    decibelsTail(power, out, i, count, reference);
+}
+
+bool cpuHasSse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return info[3] & (1 << 26);
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool const osSavesYmm = (info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    // Also checks that the OS saves the YMM registers
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // SAMPLEKERNELS_X86
+
+#ifdef SAMPLEKERNELS_NEON
+
+sampleStats convertNeon(short const* in, double* out, int count, double scale, double bias, double const* window)
+{
+    float64x2_t const vScale = vdupq_n_f64(scale);
+    float64x2_t const vBias = vdupq_n_f64(bias);
+    float64x2_t vMin = vdupq_n_f64(std::numeric_limits<double>::max());
+    float64x2_t vMax = vdupq_n_f64(std::numeric_limits<double>::lowest());
+    float64x2_t vSum = vdupq_n_f64(0);
+    float64x2_t vSumSquares = vdupq_n_f64(0);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t const raw16 = vld1q_s16(in + i);
+        int32x4_t const lo32 = vmovl_s16(vget_low_s16(raw16));
+        int32x4_t const hi32 = vmovl_s16(vget_high_s16(raw16));
+        float64x2_t const raw[4] = {
+            vcvtq_f64_s64(vmovl_s32(vget_low_s32(lo32))),
+            vcvtq_f64_s64(vmovl_s32(vget_high_s32(lo32))),
+            vcvtq_f64_s64(vmovl_s32(vget_low_s32(hi32))),
+            vcvtq_f64_s64(vmovl_s32(vget_high_s32(hi32)))
+        };
+
+        for (int j = 0; j < 4; ++j) {
+            vMin = vminq_f64(vMin, raw[j]);
+            vMax = vmaxq_f64(vMax, raw[j]);
+            vSum = vaddq_f64(vSum, raw[j]);
+            vSumSquares = vaddq_f64(vSumSquares, vmulq_f64(raw[j], raw[j]));
+
+            // vmulq + vaddq rather than vfmaq, to round exactly like the scalar kernel
+            float64x2_t v = vaddq_f64(vmulq_f64(raw[j], vScale), vBias);
+            if (window)
+                v = vmulq_f64(v, vld1q_f64(window + i + 2*j));
+            vst1q_f64(out + i + 2*j, v);
+        }
+    }
+
+    double min[2], max[2], sum[2], sumSquares[2];
+    vst1q_f64(min, vMin);
+    vst1q_f64(max, vMax);
+    vst1q_f64(sum, vSum);
+    vst1q_f64(sumSquares, vSumSquares);
+    return convertTail(in, out, i, count, scale, bias, window, foldLanes(min, max, sum, sumSquares, 2));
+}
+
+void binNeon(short const* in, unsigned short* rows, int count, float scale, float bias, int limit)
+{
+    float32x4_t const vScale = vdupq_n_f32(scale);
+    float32x4_t const vBias = vdupq_n_f32(bias);
+    float32x4_t const vZero = vdupq_n_f32(0);
+    float32x4_t const vLimit = vdupq_n_f32(static_cast<float>(limit));
+    int32x4_t const vLimitInt = vdupq_n_s32(limit);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t const raw16 = vld1q_s16(in + i);
+        int32x4_t const raw32[2] = {
+            vmovl_s16(vget_low_s16(raw16)),
+            vmovl_s16(vget_high_s16(raw16))
+        };
+
+        int16x4_t row[2];
+        for (int j = 0; j < 2; ++j) {
+            float32x4_t const v = vaddq_f32(vmulq_f32(vcvtq_f32_s32(raw32[j]), vScale), vBias);
+            uint32x4_t const inRange = vandq_u32(vcgeq_f32(v, vZero), vcltq_f32(v, vLimit));
+            row[j] = vqmovn_s32(vbslq_s32(inRange, vcvtq_s32_f32(v), vLimitInt));
+        }
+        vst1q_u16(rows + i, vreinterpretq_u16_s16(vcombine_s16(row[0], row[1])));
+    }
+    binTail(in, rows, i, count, scale, bias, limit);
+}
+
+void decibelsNeon(float const* power, double* out, int count, float reference)
+{
+    uint32x4_t const vMantissaMask = vdupq_n_u32(0x007fffff);
+    uint32x4_t const vMantissaOne = vdupq_n_u32(0x3f800000);
+    int32x4_t const vExponentBias = vdupq_n_s32(127);
+    float32x4_t const vOne = vdupq_n_f32(1.f);
+    float32x4_t const vC1 = vdupq_n_f32(kLog2C1);
+    float32x4_t const vC3 = vdupq_n_f32(kLog2C3);
+    float32x4_t const vC5 = vdupq_n_f32(kLog2C5);
+    float32x4_t const vC7 = vdupq_n_f32(kLog2C7);
+    float32x4_t const vPerOctave = vdupq_n_f32(kDecibelsPerOctave);
+    float32x4_t const vReference = vdupq_n_f32(reference);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t const bits = vreinterpretq_u32_f32(vld1q_f32(power + i));
+        float32x4_t const exponent = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vExponentBias));
+        float32x4_t const m = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vMantissaMask), vMantissaOne));
+
+        float32x4_t const t = vdivq_f32(vsubq_f32(m, vOne), vaddq_f32(m, vOne));
+        float32x4_t const t2 = vmulq_f32(t, t);
+        float32x4_t series = vaddq_f32(vmulq_f32(vC7, t2), vC5);
+        series = vaddq_f32(vmulq_f32(series, t2), vC3);
+        series = vaddq_f32(vmulq_f32(series, t2), vC1);
+        float32x4_t const log2 = vaddq_f32(exponent, vmulq_f32(t, series));
+        float32x4_t const decibels = vaddq_f32(vmulq_f32(log2, vPerOctave), vReference);
+
+        vst1q_f64(out + i, vcvt_f64_f32(vget_low_f32(decibels)));
+        vst1q_f64(out + i + 2, vcvt_high_f64_f32(decibels));
+    }
+    decibelsTail(power, out, i, count, reference);
+}
+
+#endif // SAMPLEKERNELS_NEON
+
+struct kernelChoice
+{
+    convertKernel convert;
+    binKernel bin;
+    decibelsKernel decibels;
+    char const* name;
+};
+
+kernelChoice chooseKernel()
+{
+#if defined(SAMPLEKERNELS_X86)
+    if (cpuHasAvx2())
+        return {convertAvx2, binAvx2, decibelsAvx2, "AVX2"};
+    if (cpuHasSse2())
+        return {convertSse2, binSse2, decibelsSse2, "SSE2"};
+#elif defined(SAMPLEKERNELS_NEON)
+    return {convertNeon, binNeon, decibelsNeon, "NEON"};
+#endif
+    return {convertScalar, binScalar, decibelsScalar, "scalar"};
+}
+
+kernelChoice const& selectedKernel()
+{
+    static kernelChoice const choice = chooseKernel();
+    return choice;
+}
+
+} // namespace
+
+sampleStats convertSamples(short const* in, double* out, int count, double scale, double bias, double const* window)
+{
+    return selectedKernel().convert(in, out, count, scale, bias, window);
+}
+
+void binSamples(short const* in, unsigned short* rows, int count, float scale, float bias, int limit)
+{
+    selectedKernel().bin(in, rows, count, scale, bias, limit);
+}
+
+void powerToDecibels(float const* power, double* out, int count, float reference)
+{
+    selectedKernel().decibels(power, out, count, reference);
+}
+
+char const* sampleKernelName()
+{
+    return selectedKernel().name;
+}
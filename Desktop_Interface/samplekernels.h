@@ -0,0 +1,36 @@
+#ifndef SAMPLEKERNELS_H
+#define SAMPLEKERNELS_H
+
+// Per-frame sample conversion, binning and spectrum scaling, vectorised.
+// The SSE2/AVX2/NEON variant is picked at runtime on first use; every
+// variant produces bit-identical results to the scalar one, as long as the
+// compiler doesn't fuse the scalar multiply-adds (Labrador.pro turns that off).
+
+// Statistics of the raw samples, in raw units.  The conversion is affine,
+// so the caller maps these to volts without another pass over the data.
+struct sampleStats
+{
+    double min;
+    double max;
+    double sum;
+    double sumSquares;
+};
+
+// out[i] = (in[i] * scale + bias) * window[i] for i in [0, count).
+// window may be nullptr for no windowing.  in and out must not overlap.
+sampleStats convertSamples(short const* in, double* out, int count, double scale, double bias, double const* window);
+
+// Histogram bin of each sample: rows[i] = floor(in[i] * scale + bias) when
+// that lands in [0, limit), otherwise limit, so out-of-range samples can all
+// go to one spare bin.  limit must be at most 32767.
+void binSamples(short const* in, unsigned short* rows, int count, float scale, float bias, int limit);
+
+// out[i] = reference + 10*log10(power[i]) for i in [0, count), from a
+// polynomial logarithm that is within about 1e-4 dB.  power must not be
+// negative; zero comes out about 382 dB below reference rather than -inf.
+void powerToDecibels(float const* power, double* out, int count, float reference);
+
+// Name of the variant the kernels above dispatch to, for logging.
+char const* sampleKernelName();
+
+#endif // SAMPLEKERNELS_H
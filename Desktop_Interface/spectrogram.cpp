@@ -0,0 +1,104 @@
+#include "spectrogram.h"
+#include "asyncdft.h"
+#include "isobuffer.h"
+#include "samplekernels.h"
+#include <algorithm>
+#include <cmath>
+
+spectrogram::spectrogram()
+{
+    // A transform this short is best single threaded
+    AsyncDFT::initFftw();
+    m_in = fftwf_alloc_real(kSize);
+    m_out = fftwf_alloc_complex(kBins);
+    fftwf_plan_with_nthreads(1);
+    m_plan = fftwf_plan_dft_r2c_1d(kSize, m_in, m_out, FFTW_ESTIMATE);
+    fftwf_plan_with_nthreads(AsyncDFT::fftwThreads());
+
+    m_window.resize(kSize);
+    for (int i = 0; i < kSize; ++i) {
+        double const factor = AsyncDFT::windowFactor(1, kSize, i); // Hann
+        m_window[i] = float(factor);
+        m_windowSum += factor;
+    }
+    m_power.assign(kBins, 0.f);
+    m_pending.reserve(kMaxBacklog + kSize);
+}
+
+spectrogram::~spectrogram()
+{
+    fftwf_destroy_plan(m_plan);
+    fftwf_free(m_in);
+    fftwf_free(m_out);
+}
+
+void spectrogram::update(isoBuffer const* buffer, double scale, double bias)
+{
+    if (buffer != m_buffer) {
+        m_buffer = buffer;
+        m_position = buffer->m_sampleCount;
+        m_pending.clear();
+        std::fill(m_power.begin(), m_power.end(), 0.f);
+        m_rowTransforms = 0;
+        m_rowSamples = 0;
+        m_rowCount = 0;
+        m_samplesPerRow = std::max(int(kHop), buffer->m_samplesPerSecond / kRowsPerSecond);
+        return;
+    }
+
+    uint64_t const arrived = buffer->m_sampleCount - m_position;
+    m_position = buffer->m_sampleCount;
+    if (arrived == 0)
+        return;
+    // Anything older than the backlog is lost, so the carried over part is no longer contiguous
+    if (arrived > kMaxBacklog)
+        m_pending.clear();
+
+    size_t const carried = m_pending.size();
+    uint32_t const wanted = uint32_t(std::min<uint64_t>(arrived, kMaxBacklog));
+    m_pending.resize(carried + wanted);
+    // Fewer come back if the buffer has been cleared since
+    m_pending.resize(carried + buffer->readLatest(m_pending.data() + carried, wanted));
+
+    float const gain = float(scale);
+    float const offset = float(bias);
+    size_t start = 0;
+    for (; start + kSize <= m_pending.size(); start += kHop) {
+        short const* samples = m_pending.data() + start;
+        for (int i = 0; i < kSize; ++i) {
+            m_in[i] = (samples[i] * gain + offset) * m_window[i];
+        }
+        fftwf_execute(m_plan);
+        for (int k = 0; k < kBins; ++k) {
+            m_power[k] += m_out[k][0]*m_out[k][0] + m_out[k][1]*m_out[k][1];
+        }
+        m_rowTransforms++;
+        m_rowSamples += kHop;
+        if (m_rowSamples >= m_samplesPerRow)
+            finishRow();
+    }
+    m_pending.erase(m_pending.begin(), m_pending.begin() + start);
+}
+
+void spectrogram::finishRow()
+{
+    // Same dBmV as AsyncDFT, averaged over the row's transforms
+    double const reference = 60 - 20*std::log10(m_windowSum) - 10*std::log10(m_rowTransforms);
+    powerToDecibels(m_power.data(), m_history.data() + m_nextRow * kBins, kBins, float(reference));
+    std::fill(m_power.begin(), m_power.end(), 0.f);
+    m_rowTransforms = 0;
+    m_rowSamples = 0;
+    m_nextRow = (m_nextRow + 1) % kRows;
+    m_rowCount = std::min(m_rowCount + 1, int(kRows));
+}
+
+void spectrogram::copyHistory(std::vector<float>& out, float floor) const
+{
+    out.resize(kRows * kBins);
+    int const empty = kRows - m_rowCount;
+    std::fill(out.begin(), out.begin() + empty * kBins, floor);
+    for (int row = empty; row < kRows; ++row) {
+        double const* source = m_history.data() + ((m_nextRow + row) % kRows) * kBins;
+        std::copy(source, source + kBins, out.begin() + row * kBins);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include <cstdint>
+#include <vector>
+#include <fftw3.h>
+
+class isoBuffer;
+
+// Waterfall history for the spectrum view.  The spectrum itself transforms
+// the newest samples afresh every time; this instead follows the buffer,
+// transforming only what has arrived since the last call, hop by hop, and
+// carrying any part transform over to the next call.  Each row is the mean
+// power of the transforms finished within one row period, and the last
+// kRows rows are kept in a ring.
+class spectrogram
+{
+public:
+    static const int kSize = 1024;
+    static const int kHop = kSize / 2;
+    static const int kBins = kSize / 2 + 1;
+    static const int kRows = 250;
+    static const int kRowsPerSecond = 25;
+
+    spectrogram();
+    ~spectrogram();
+    spectrogram(spectrogram const&) = delete;
+    spectrogram& operator=(spectrogram const&) = delete;
+
+    // Starts the history afresh at the next update()
+    void reset() { m_buffer = nullptr; }
+
+    // Transforms what has arrived in buffer since the last call, as
+    // raw * scale + bias volts.  A different buffer starts the history afresh.
+    void update(isoBuffer const* buffer, double scale, double bias);
+
+    // The history, oldest row first, kBins values in dBmV a row.  Rows that
+    // haven't been filled yet read as floor.
+    void copyHistory(std::vector<float>& out, float floor) const;
+
+private:
+    void finishRow();
+
+    // After a long gap only this much of the newest is transformed
+    static const uint32_t kMaxBacklog = 1 << 18;
+
+    fftwf_plan m_plan = nullptr;
+    float* m_in = nullptr;
+    fftwf_complex* m_out = nullptr;
+    std::vector<float> m_window;
+    double m_windowSum = 0;
+
+    isoBuffer const* m_buffer = nullptr;
+    uint64_t m_position = 0;        // The buffer's m_sampleCount when last read
+    std::vector<short> m_pending;   // Read, but not yet a whole hop past the last transform
+
+    std::vector<float> m_power;     // Summed over the row so far
+    int m_rowTransforms = 0;
+    int m_rowSamples = 0;
+    int m_samplesPerRow = kHop;
+
+    std::vector<double> m_history = std::vector<double>(kRows * kBins);
+    int m_nextRow = 0;
+    int m_rowCount = 0;
+};
+
+#endif // SPECTROGRAM_H
@@ -1,6 +1,24 @@
 #include "uartstyledecoder.h"
 #include <QDebug>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+// Index of the lowest set bit of each byte
+struct lowestBitTable
+{
+    uint8_t bit[256] = {};
+    constexpr lowestBitTable()
+    {
+        for (int i = 1; i < 256; ++i)
+            bit[i] = (i & 1) ? 0 : bit[i >> 1] + 1;
+    }
+};
+constexpr lowestBitTable kLowestBit;
+}
 
 uartStyleDecoder::uartStyleDecoder(double baudRate, QObject *parent)
 	: QObject(parent)
@@ -8,9 +26,11 @@ uartStyleDecoder::uartStyleDecoder(double baudRate, QObject *parent)
 	, m_serialBuffer{SERIAL_BUFFER_LENGTH}
 	, m_baudRate{baudRate}
 {
+    m_transitions.reserve(kChunkBits);
 
-	// Begin decoding SAMPLE_DELAY seconds in the past.
-	serialPtr_bit = (int)(m_parent->m_back * 8 - SERIAL_DELAY * m_parent->m_sampleRate_bit + m_parent->m_bufferLen * 8) % (m_parent->m_bufferLen*8);
+	// Begin decoding SERIAL_DELAY seconds in the past.
+	restart(m_parent->m_back, SERIAL_DELAY);
+	m_epoch = m_parent->m_epoch;
 
     m_updateTimer.setTimerType(Qt::PreciseTimer);
     m_updateTimer.start(CONSOLE_UPDATE_TIMER_PERIOD);
@@ -26,56 +46,123 @@ uartStyleDecoder::uartStyleDecoder(double baudRate, QObject *parent)
 
 void uartStyleDecoder::updateConsole()
 {
-	if (!newUartSymbol)
-		return;
-
-    std::lock_guard<std::mutex> lock(mutex);
-
-    console->setPlainText(QString::fromLocal8Bit(m_serialBuffer.begin(), m_serialBuffer.size()));
-    if (m_parent->m_serialAutoScroll)
-	{
-        //http://stackoverflow.com/questions/21059678/how-can-i-set-auto-scroll-for-a-qtgui-qtextedit-in-pyqt4   DANKON
-        QTextCursor c = console->textCursor();
-        c.movePosition(QTextCursor::End);
-        console->setTextCursor(c);
-        // txtedit.ensureCursorVisible(); // you might need this also
-    }
-    newUartSymbol = false;
-    //charPos = 0;
+    int const count = m_records.drain([this](decoderRecord const& record) {
+        formatRecord(record);
+        m_recordLog.add(record);
+    });
+    uint32_t const dropped = m_records.takeDropped();
+    if (dropped)
+        m_serialBuffer.insert(QString("\n<%1 characters lost: console too slow>\n").arg(dropped).toStdString());
+    if (!count && !dropped)
+        return;
+
+    appendToConsole(console, m_serialBuffer, m_parent->m_serialAutoScroll);
 }
 
-void uartStyleDecoder::serialDecode()
+void uartStyleDecoder::formatRecord(decoderRecord const& record)
 {
-    double dist_seconds = (double)serialDistance()/(m_parent->m_sampleRate_bit);
-    double bitPeriod_seconds = 1.0 / m_baudRate;
-
-    // Used to check for wire disconnects.  You should get at least one "1" for a stop bit.
-    bool allZeroes = true;
+    if (record.kind == decoderRecord::Kind::SamplesLost)
+    {
+        m_serialBuffer.insert("\n<Samples lost: decoding fell behind, so what came just before may be garbled>\n");
+        escape_code_started = false;
+        return;
+    }
 
-    while(dist_seconds > (bitPeriod_seconds + SERIAL_DELAY))
-	{
-        // Read next uart bit
-        bool uart_bit = getNextUartBit();
+    char const decodedDatabit = record.value;
 
-        if (uart_bit == 1)
-            allZeroes = false;
+    if (record.parityError)
+        m_serialBuffer.insert("\n<ERROR: Following character contains parity error>\n");
 
-        // Process it
-        if (uartTransmitting)
+    // Start + body of escape code
+    if(decodedDatabit == 0x1b || (escape_code_started && !((decodedDatabit >= 'A' && decodedDatabit <= 'Z') || (decodedDatabit >= 'a' && decodedDatabit <= 'z'))))
+    {
+        escape_code_started = true;
+    }
+    // End of escape code
+    else if(escape_code_started && ((decodedDatabit >= 'A' && decodedDatabit <= 'Z') || (decodedDatabit >= 'a' && decodedDatabit <= 'z')))
+    {
+        escape_code_started = false;
+    }
+    else
+    {
+        if (m_hexDisplay)
         {
-            decodeNextUartBit(uart_bit);
+            m_serialBuffer.insert_hex(decodedDatabit);
+            m_serialBuffer.insert(' ');
         }
         else
         {
-			// Uart starts transmitting after start bit (logic low).
-            uartTransmitting = uart_bit == false;
-            jitterCompensationNeeded = true;
+            m_serialBuffer.insert(decodedDatabit);
         }
+    }
+}
+
+void uartStyleDecoder::restart(uint32_t back, double seconds)
+{
+	serialPtr_bit = (int)(back * 8 - seconds * m_parent->m_sampleRate_bit + m_parent->m_bufferLen * 8) % (m_parent->m_bufferLen*8);
+    uartTransmitting = false;
+    currentUartSymbol = 0;
+    dataBit_current = 0;
+    m_lastCentre = -m_parent->m_sampleRate_bit / m_baudRate;
+}
+
+uint64_t uartStyleDecoder::serialDecode(isoBufferPosition const& position)
+{
+    // Bits of the logic buffer per UART bit
+    double const bitPeriod = m_parent->m_sampleRate_bit / m_baudRate;
+
+    // The buffer was cleared since the last call, so everything before
+    // index 0 is stale. Drop the current symbol and decode from there.
+    if (m_epoch != position.epoch)
+    {
+        serialPtr_bit = 0;
+        uartTransmitting = false;
+        currentUartSymbol = 0;
+        dataBit_current = 0;
+        m_lastCentre = -bitPeriod;
+        m_epoch = position.epoch;
+    }
+    else if (m_samplesLost)
+    {
+        // Far enough back to decode something now, or it looks like a disconnect
+        restart(position.back, 2 * SERIAL_DELAY + 2 / m_baudRate);
+        decoderRecord record;
+        record.kind = decoderRecord::Kind::SamplesLost;
+        record.sample = position.sampleCount * 8 - serialDistance(position.back);
+        m_records.push(record);
+    }
+    m_samplesLost = false;
+
+    // The bit before serialPtr_bit is read too
+    int64_t const firstBit = int64_t(position.sampleCount * 8) - serialDistance(position.back) - 1;
+    uint64_t const oldest = firstBit > 0 ? firstBit / 8 : 0;
+
+    // Used to check for wire disconnects.  You should get at least one "1" for a stop bit.
+    bool allZeroes = true;
+
+    int const bufferBits = m_parent->m_bufferLen * 8;
+    while (true)
+    {
+        // Stay a bit period and SERIAL_DELAY behind the newest sample
+        int const distance = serialDistance(position.back);
+        int const available = int(distance - bitPeriod - SERIAL_DELAY * m_parent->m_sampleRate_bit);
+        if (available <= 0)
+            break;
+        int const length = std::min(available, kChunkBits);
+        m_chunkSample = position.sampleCount * 8 - distance;
 
-        // Update the pointer, accounting for jitter
-        updateSerialPtr(uart_bit);
-        // Calculate stopping condition
-        dist_seconds = (double)serialDistance()/(m_parent->m_sampleRate_bit);
+        indexTransitions(length);
+        if (m_initialLevel || !m_transitions.empty())
+            allZeroes = false;
+        decodeTransitions(length, bitPeriod);
+
+        // Move up to just after the last bit sampled, which is as far back
+        // as the next chunk needs to see edges from
+        int const advance = std::max(0, int(std::floor(m_lastCentre)) + 1);
+        serialPtr_bit = (serialPtr_bit + advance) % bufferBits;
+        m_lastCentre -= advance;
+        if (length == available || advance == 0)
+            break;
     }
 
     //Not a single stop bit, or idle bit, in the whole stream.  Wire must be disconnected.
@@ -84,13 +171,15 @@ void uartStyleDecoder::serialDecode()
         qDebug() << "Wire Disconnect detected!";
         wireDisconnected(m_parent->m_channel);
         m_parent->m_isDecoding = false;
-        m_updateTimer.stop();
+        // The timer belongs to the GUI thread, see isoBuffer::serialManage
+        QMetaObject::invokeMethod(&m_updateTimer, "stop", Qt::QueuedConnection);
     }
+    return oldest;
 }
 
-int uartStyleDecoder::serialDistance() const
+int uartStyleDecoder::serialDistance(uint32_t back) const
 {
-    int back_bit = m_parent->m_back * 8;
+    int back_bit = back * 8;
     int bufferEnd_bit = (m_parent->m_bufferLen-1) * 8;
     if (back_bit >= serialPtr_bit)
         return back_bit - serialPtr_bit;
@@ -98,33 +187,132 @@ int uartStyleDecoder::serialDistance() const
 		return bufferEnd_bit - serialPtr_bit + back_bit;
 }
 
-void uartStyleDecoder::updateSerialPtr(bool current_bit)
+// Fills m_transitions with the offset of every bit in the next length
+// bits that differs from the one before it, in order.
+// The buffer is stored twice over, so the stretch never needs to wrap.
+void uartStyleDecoder::indexTransitions(int length)
 {
-    if (jitterCompensationNeeded && uartTransmitting)
-        jitterCompensationNeeded = jitterCompensationProcedure(current_bit);
-
-    int distance_between_bits = (m_parent->m_sampleRate_bit)/ m_baudRate;
-    if (uartTransmitting)
-        serialPtr_bit += distance_between_bits;
-	else
-		serialPtr_bit += (distance_between_bits - 1);  //Less than one baud period so that it will always see that start bit.
+    short const* const buffer = m_parent->m_buffer;
+    int const bufferBits = m_parent->m_bufferLen * 8;
+    int const previous = (serialPtr_bit + bufferBits - 1) % bufferBits;
+    m_initialLevel = (buffer[previous / 8] >> (previous % 8)) & 1;
+    m_transitions.clear();
+
+    // Each short holds eight samples in its low byte, earliest in bit 0
+    constexpr uint64_t kLowBytes = 0x00ff00ff00ff00ffull;
+    unsigned fill = m_initialLevel ? 0xff : 0x00;
+    int element = serialPtr_bit / 8;
+    int const endElement = (serialPtr_bit + length + 7) / 8;
+    int position = -(serialPtr_bit % 8); // Offset of element's bit 0
+    while (element < endElement)
+    {
+        // Four elements at a time while nothing changes
+        if (element + 4 <= endElement)
+        {
+            uint64_t word;
+            memcpy(&word, buffer + element, sizeof word);
+            if ((word & kLowBytes) == (fill ? kLowBytes : 0))
+            {
+                element += 4;
+                position += 32;
+                continue;
+            }
+        }
 
-    if (serialPtr_bit >= (m_parent->m_bufferLen * 8))
-        serialPtr_bit -= (m_parent->m_bufferLen * 8);
+        unsigned byte = buffer[element] & 0xff;
+        if (position < 0)
+        {
+            // Bits before serialPtr_bit don't count
+            unsigned const before = (1u << -position) - 1;
+            byte = (byte & ~before) | (fill & before);
+        }
+        unsigned changes = (byte ^ (byte << 1 | (fill & 1))) & 0xff;
+        if (position + 8 > length)
+            changes &= (1u << (length - position)) - 1; // Past the end
+        for (; changes; changes &= changes - 1)
+            m_transitions.push_back(position + kLowestBit.bit[changes]);
+        fill = (byte & 0x80) ? 0xff : 0x00;
+        ++element;
+        position += 8;
+    }
 }
 
-bool uartStyleDecoder::getNextUartBit() const
+// Runs the symbol state machine over the indexed length bits, from
+// m_lastCentre on.  Stops where a bit it needs, or the edges before it, lie
+// beyond the index, leaving m_lastCentre for the next chunk to go on from.
+void uartStyleDecoder::decodeTransitions(int length, double bitPeriod)
 {
-	int bitIndex = serialPtr_bit;
+    std::vector<int> const& edges = m_transitions;
+    int const edgeCount = int(edges.size());
+    double const halfPeriod = bitPeriod / 2;
+
+    // cursor counts the edges at or before the position last looked at
+    int cursor = 0;
+    auto levelAt = [&](double position) {
+        while (cursor < edgeCount && edges[cursor] <= position)
+            cursor++;
+        while (cursor > 0 && edges[cursor - 1] > position)
+            cursor--;
+        return m_initialLevel != bool(cursor & 1);
+    };
+
+    double centre = m_lastCentre;
+    while (true)
+    {
+        if (uartTransmitting)
+        {
+            // The next bit is a period on, or half a period after an edge
+            // since the last one
+            double next = centre + bitPeriod;
+            if (next >= length)
+                break;
+            bool bit = levelAt(next);
+            if (cursor > 0 && edges[cursor - 1] > centre)
+            {
+                next = edges[cursor - 1] + halfPeriod;
+                if (next >= length)
+                    break;
+                bit = levelAt(next);
+            }
+            centre = next;
+            decodeNextUartBit(bit, m_chunkSample + uint64_t(next));
+            continue;
+        }
+
+        // Idle.  A symbol starts at the first falling edge, or with the
+        // line still low where the stop bit should have been.
+        levelAt(centre);
+        int falling = cursor;
+        if (falling < edgeCount && m_initialLevel == bool(falling & 1))
+            falling++;  // Rising
+        double const stop = centre + bitPeriod;
+        double start;
+        if (falling < edgeCount && edges[falling] <= stop)
+            start = edges[falling];
+        else if (stop >= length)
+            break;
+        else if (!levelAt(stop))
+            start = stop - halfPeriod;
+        else if (falling < edgeCount)
+            start = edges[falling];
+        else
+        {
+            // High to the end; pick up from there next time
+            centre = std::max(centre, std::floor(length - 1 - bitPeriod));
+            break;
+        }
 
-    int coord_byte = bitIndex/8;
-    int coord_bit = bitIndex - (8*coord_byte);
-    uint8_t dataByte = m_parent->m_buffer[coord_byte];
-    uint8_t mask = (0x01 << coord_bit);
-    return dataByte & mask;
+        // A start bit must still be low halfway through, or it was a glitch
+        double const startCentre = start + halfPeriod;
+        if (startCentre >= length)
+            break;
+        centre = startCentre;
+        uartTransmitting = !levelAt(startCentre);
+    }
+    m_lastCentre = centre;
 }
 
-void uartStyleDecoder::decodeNextUartBit(bool bitValue)
+void uartStyleDecoder::decodeNextUartBit(bool bitValue, uint64_t sample)
 {
     if (dataBit_current == parityIndex)
     {
@@ -138,80 +326,20 @@ void uartStyleDecoder::decodeNextUartBit(bool bitValue)
     }
     else
     {
-        char decodedDatabit = decodeDatabit(dataBit_max + 1, currentUartSymbol);
-
-		if (parityCheckFailed)
-		{
-			m_serialBuffer.insert("\n<ERROR: Following character contains parity error>\n");
-			parityCheckFailed = false;
-		}
-
-        // Start + body of escape code
-        if(decodedDatabit == 0x1b || (escape_code_started && !((decodedDatabit >= 'A' && decodedDatabit <= 'Z') || (decodedDatabit >= 'a' && decodedDatabit <= 'z'))))
-        {
-            escape_code_started = true;
-        }
-        // End of escape code
-        else if(escape_code_started && ((decodedDatabit >= 'A' && decodedDatabit <= 'Z') || (decodedDatabit >= 'a' && decodedDatabit <= 'z')))
-        {
-            escape_code_started = false;
-        }
-        else
-        {
-            if (m_hexDisplay)
-            {
-                m_serialBuffer.insert_hex(decodedDatabit);
-                m_serialBuffer.insert(" ");
-            }
-            else
-            {
-                m_serialBuffer.insert(decodedDatabit);
-            }
-        }
+        decoderRecord record;
+        record.sample = sample;
+        record.kind = decoderRecord::Kind::UartByte;
+        record.value = uint8_t(decodeDatabit(dataBit_max + 1, currentUartSymbol));
+        record.parityError = parityCheckFailed;
+        parityCheckFailed = false;
+        m_records.push(record);
 
         currentUartSymbol = 0;
         dataBit_current = 0;
         uartTransmitting = false;
-        newUartSymbol = true;
     }
 }
 
-//This function compensates for jitter by, when the current bit is a "1", and the last bit was a zero, setting the pointer
-//to the sample at the midpoint between this bit and the last.
-bool uartStyleDecoder::jitterCompensationProcedure(bool current_bit)
-{
-
-    //We only run when the current bit is a "1", to prevent slowdown when there are long breaks between transmissions.
-    if (current_bit == false)
-        return true;
-
-    //Can't be bothered dealing with the corner case where the serial pointer is at the very start of the buffer.
-    //Just return and try again next time.
-    int left_coord = serialPtr_bit - (m_parent->m_sampleRate_bit)/ m_baudRate;
-    //qDebug() << "left_coord =" << left_coord;
-    if (left_coord < 0)
-        return true; //Don't want to read out of bounds!!
-
-    //The usual case, when transmitting anyway.
-    uint8_t left_byte = (m_parent->m_buffer[left_coord/8] & 0xff);
-    //Only run when a zero is detected in the leftmost symbol.
-    if (left_byte != 0xff)
-	{
-        //Step back, one sample at a time, to the 0->1 transition point
-        bool temp_bit = 1;
-        while(temp_bit)
-		{
-            temp_bit = getNextUartBit();
-            serialPtr_bit--;
-        }
-        //Jump the pointer forward by half a uart bit period, and return "done!".
-        serialPtr_bit += (m_parent->m_sampleRate_bit/ m_baudRate)/2;
-        return false;
-    }
-
-    return true;
-}
-
 //Basically scaffolding to add character maps for other modes (5 bit, for example).
 char uartStyleDecoder::decodeDatabit(int mode, short symbol) const
 {
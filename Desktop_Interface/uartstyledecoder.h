@@ -4,7 +4,9 @@
 #include <QObject>
 #include "isobufferbuffer.h"
 #include "isobuffer.h"
-#include <mutex>
+#include "decoderrecord.h"
+#include <atomic>
+#include <vector>
 #include <limits.h>
 #include <stdint.h>
 
@@ -15,6 +17,9 @@ enum class UartParity : uint8_t
     Odd
 };
 
+// Decodes one logic channel as UART.  serialDecode() runs on the decoder
+// worker, and turns each symbol into a decoderRecord; the console timer
+// drains those on the GUI thread and formats them as text.
 class uartStyleDecoder : public QObject
 {
     Q_OBJECT
@@ -26,23 +31,46 @@ public:
 private:
     isoBuffer *m_parent;
 
-	// Indicates the current bit being decoded.
+	// Where the transition index starts, in bits of the logic buffer.
+    // Everything before it has been decoded.
     int serialPtr_bit;
+    // Buffer epoch serialPtr_bit refers to. See isoBuffer::clearBuffer.
+    uint32_t m_epoch;
 
     bool uartTransmitting = false;
-    bool newUartSymbol = false;
     uint32_t dataBit_current = 0;
     uint32_t parityIndex = UINT_MAX;
     uint32_t dataBit_max = 7;
     unsigned short currentUartSymbol = 0;
-    bool jitterCompensationNeeded = true;
 
-    void updateSerialPtr(bool current_bit);
-    bool getNextUartBit() const;
-    void decodeNextUartBit(bool bitValue);
-    bool jitterCompensationProcedure(bool current_bit);
-
-    bool m_hexDisplay = false;
+    // The logic buffer is decoded in chunks of up to kChunkBits.  Each is
+    // indexed first: the offset from serialPtr_bit of every bit that
+    // differs from the one before, found a byte at a time, with runs of
+    // all-0x00 or all-0xff bytes skipped four at a time.  Bits are then
+    // sampled only at symbol centres, each half a bit after the edge it
+    // follows, so idle line costs next to nothing.
+    static const int kChunkBits = 1 << 18;
+    void indexTransitions(int length);
+    void decodeTransitions(int length, double bitPeriod);
+    std::vector<int> m_transitions;
+    bool m_initialLevel = true;  // Of the bit before serialPtr_bit
+    // Centre of the last bit sampled, in bits from serialPtr_bit; one
+    // period back when there is none.  While idle that was a stop or idle bit.
+    double m_lastCentre = 0;
+    // Absolute sample of serialPtr_bit, for records
+    uint64_t m_chunkSample = 0;
+
+    void decodeNextUartBit(bool bitValue, uint64_t sample);
+    // Drops any symbol in progress and starts seconds before back
+    void restart(uint32_t back, double seconds);
+    bool m_samplesLost = false;
+
+    decoderRecordRing m_records;
+
+    // Console formatting, on the GUI thread
+    void formatRecord(decoderRecord const& record);
+    decoderRecordLog m_recordLog;
+    std::atomic_bool m_hexDisplay{false};
     bool escape_code_started = false;
 
     QPlainTextEdit *console;
@@ -50,8 +78,17 @@ private:
 public:
 	double m_baudRate;
     QTimer m_updateTimer; // IMPORTANT: must be after m_serialBuffer. construction / destruction order matters
-    void serialDecode();
-    int serialDistance() const;
+    // Decodes up to a bit period and SERIAL_DELAY behind position.  Returns
+    // the earliest sample it read, to check it wasn't written over meanwhile.
+    uint64_t serialDecode(isoBufferPosition const& position);
+    // What was last decoded may have been written over as it was read, so
+    // the next serialDecode() starts again afresh
+    void samplesLost() { m_samplesLost = true; }
+    isoBuffer* buffer() const { return m_parent; }
+    // What the console has shown, and which console.  GUI thread only.
+    decoderRecordLog const& recordLog() const { return m_recordLog; }
+    char const* consoleName() const { return console == m_parent->m_console2 ? "UART 2" : "UART 1"; }
+    int serialDistance(uint32_t back) const;
 
 signals:
     void wireDisconnected(int);
@@ -65,7 +102,6 @@ private:
     char decodeDatabit(int mode, short symbol) const;
     char decodeBaudot(short symbol) const;
 
-	std::mutex mutex;
     UartParity parity = UartParity::None;
 
     bool isParityCorrect(uint32_t bitField) const;
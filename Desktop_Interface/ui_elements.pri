@@ -7,6 +7,7 @@ SOURCES += \
     ui_elements/deviceconnecteddisplay.cpp \
     ui_elements/espocombobox.cpp \
     ui_elements/esposlider.cpp \
+    ui_elements/framegraph.cpp \
     ui_elements/espospinbox.cpp \
     ui_elements/noclosemenu.cpp \
     ui_elements/qcp$${QCP_VER}/qcustomplot.cpp \
@@ -21,6 +22,7 @@ HEADERS += \
     ui_elements/deviceconnecteddisplay.h \
     ui_elements/espocombobox.h \
     ui_elements/esposlider.h \
+    ui_elements/framegraph.h \
     ui_elements/espospinbox.h \
     ui_elements/noclosemenu.h \
     ui_elements/qcp$${QCP_VER}/qcustomplot.h \
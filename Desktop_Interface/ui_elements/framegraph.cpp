@@ -0,0 +1,226 @@
+#include "framegraph.h"
+
+#if QCP_VER == 1
+
+#include <cmath>
+
+namespace
+{
+bool matchesSignDomain(double value, QCPAbstractPlottable::SignDomain domain)
+{
+    if (domain == QCPAbstractPlottable::sdPositive)
+        return value > 0;
+    if (domain == QCPAbstractPlottable::sdNegative)
+        return value < 0;
+    return true;
+}
+}
+
+frameGraph::frameGraph(QCPAxis *keyAxis, QCPAxis *valueAxis) : QCPGraph(keyAxis, valueAxis)
+{
+}
+
+void frameGraph::setFrameData(double const* values, int count, double xStart, double xStep)
+{
+    m_keys = nullptr;
+    m_values = values;
+    m_lower = m_upper = nullptr;
+    m_count = count;
+    m_xStart = xStart;
+    m_xStep = xStep;
+}
+
+void frameGraph::setFrameData(double const* keys, double const* values, int count)
+{
+    m_keys = keys;
+    m_values = values;
+    m_lower = m_upper = nullptr;
+    m_count = count;
+}
+
+void frameGraph::setFrameEnvelope(double const* lower, double const* upper)
+{
+    m_lower = lower;
+    m_upper = upper;
+}
+
+void frameGraph::clearData()
+{
+    m_keys = nullptr;
+    m_values = nullptr;
+    m_lower = m_upper = nullptr;
+    m_count = 0;
+    QCPGraph::clearData();
+}
+
+double frameGraph::selectTest(const QPointF &pos, bool onlySelectable, QVariant *details) const
+{
+    Q_UNUSED(pos)
+    Q_UNUSED(onlySelectable)
+    Q_UNUSED(details)
+    return -1; //Traces aren't selectable
+}
+
+void frameGraph::draw(QCPPainter *painter)
+{
+    QCPAxis *keyAxis = mKeyAxis.data();
+    if (!keyAxis || !mValueAxis) { qDebug() << Q_FUNC_INFO << "invalid key or value axis"; return; }
+    if (!m_values || m_count < 2 || keyAxis->range().size() <= 0) return;
+    if (mainPen().style() == Qt::NoPen || mainPen().color().alpha() == 0) return;
+
+    //Only the visible part of an implied-key trace is drawn, plus a point
+    //either side so the line runs off the edge of the plot.
+    int begin = 0;
+    int end = m_count;
+    bool decimate = false;
+    if (!m_keys && m_xStep != 0)
+    {
+        double lo = (keyAxis->range().lower - m_xStart) / m_xStep;
+        double hi = (keyAxis->range().upper - m_xStart) / m_xStep;
+        if (lo > hi) std::swap(lo, hi);
+        begin = static_cast<int>(qBound(0.0, std::floor(lo) - 1, double(m_count)));
+        end = static_cast<int>(qBound(0.0, std::ceil(hi) + 2, double(m_count)));
+
+        double pixelsPerSample = qAbs(keyAxis->coordToPixel(m_xStart + m_xStep) - keyAxis->coordToPixel(m_xStart));
+        decimate = pixelsPerSample < 0.5;
+    }
+    if (end - begin < 2) return;
+
+    applyDefaultAntialiasingHint(painter);
+    if (m_lower && m_upper)
+        drawEnvelope(painter, begin, end, decimate);
+    else
+        drawLine(painter, begin, end, decimate);
+}
+
+void frameGraph::drawLine(QCPPainter *painter, int begin, int end, bool decimate)
+{
+    QCPAxis *keyAxis = mKeyAxis.data();
+    m_lines.clear();
+    if (decimate)
+    {
+        //One vertical min-max segment per pixel column, like a scope's peak detect
+        int column = int(keyAxis->coordToPixel(keyAt(begin)));
+        double columnKey = keyAt(begin);
+        double min = m_values[begin];
+        double max = m_values[begin];
+        for (int i = begin + 1; i < end; ++i)
+        {
+            int const c = int(keyAxis->coordToPixel(keyAt(i)));
+            if (c != column)
+            {
+                m_lines.append(coordsToPixels(columnKey, min));
+                m_lines.append(coordsToPixels(columnKey, max));
+                column = c;
+                columnKey = keyAt(i);
+                min = max = m_values[i];
+            }
+            else
+            {
+                min = qMin(min, m_values[i]);
+                max = qMax(max, m_values[i]);
+            }
+        }
+        m_lines.append(coordsToPixels(columnKey, min));
+        m_lines.append(coordsToPixels(columnKey, max));
+    }
+    else
+    {
+        for (int i = begin; i < end; ++i)
+            m_lines.append(coordsToPixels(keyAt(i), m_values[i]));
+    }
+
+    painter->setPen(mainPen());
+    painter->setBrush(Qt::NoBrush);
+    painter->drawPolyline(m_lines.constData(), m_lines.size());
+}
+
+void frameGraph::drawEnvelope(QCPPainter *painter, int begin, int end, bool decimate)
+{
+    //Upper edge left to right, then lower edge right to left, as one polygon.
+    //When decimating, each pixel column takes the widest band among its samples.
+    m_lines.clear();
+    m_lowerLines.clear();
+    int column = 0;
+    double columnKey = 0;
+    double lower = 0;
+    double upper = 0;
+    for (int i = begin; i < end; ++i)
+    {
+        int const c = decimate ? int(mKeyAxis.data()->coordToPixel(keyAt(i))) : i;
+        if (i > begin && c == column)
+        {
+            lower = qMin(lower, m_lower[i]);
+            upper = qMax(upper, m_upper[i]);
+            continue;
+        }
+        if (i > begin)
+        {
+            m_lines.append(coordsToPixels(columnKey, upper));
+            m_lowerLines.append(coordsToPixels(columnKey, lower));
+        }
+        column = c;
+        columnKey = keyAt(i);
+        lower = m_lower[i];
+        upper = m_upper[i];
+    }
+    m_lines.append(coordsToPixels(columnKey, upper));
+    m_lowerLines.append(coordsToPixels(columnKey, lower));
+    for (int i = m_lowerLines.size() - 1; i >= 0; --i)
+        m_lines.append(m_lowerLines[i]);
+
+    QColor fill = mainPen().color();
+    fill.setAlpha(fill.alpha() / 2);
+    painter->setPen(mainPen());
+    painter->setBrush(fill);
+    painter->drawPolygon(m_lines.constData(), m_lines.size());
+}
+
+QCPRange frameGraph::getKeyRange(bool &foundRange, SignDomain inSignDomain) const
+{
+    QCPRange range;
+    foundRange = false;
+    for (int i = 0; i < m_count; ++i)
+    {
+        double const key = keyAt(i);
+        if (!matchesSignDomain(key, inSignDomain))
+            continue;
+        if (!foundRange)
+            range = QCPRange(key, key);
+        else
+            range.expand(key);
+        foundRange = true;
+    }
+    return range;
+}
+
+QCPRange frameGraph::getValueRange(bool &foundRange, SignDomain inSignDomain) const
+{
+    QCPRange range;
+    foundRange = false;
+    for (int i = 0; i < m_count; ++i)
+    {
+        if (!matchesSignDomain(m_values[i], inSignDomain))
+            continue;
+        if (!foundRange)
+            range = QCPRange(m_values[i], m_values[i]);
+        else
+            range.expand(m_values[i]);
+        foundRange = true;
+    }
+    return range;
+}
+
+QCPRange frameGraph::getKeyRange(bool &foundRange, SignDomain inSignDomain, bool includeErrors) const
+{
+    Q_UNUSED(includeErrors)
+    return getKeyRange(foundRange, inSignDomain);
+}
+
+QCPRange frameGraph::getValueRange(bool &foundRange, SignDomain inSignDomain, bool includeErrors) const
+{
+    Q_UNUSED(includeErrors)
+    return getValueRange(foundRange, inSignDomain);
+}
+
+#endif // QCP_VER == 1
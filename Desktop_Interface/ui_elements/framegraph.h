@@ -0,0 +1,58 @@
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+#include "qcustomplot.h"
+
+#if QCP_VER == 1
+
+//frameGraph is a QCPGraph that draws straight from an array owned by
+//someone else, instead of copying it into QCP's QMap every frame.
+//Keys are either implied (key = xStart + i*xStep) or given as a second array.
+//When there are several samples per pixel it draws each pixel column as a
+//min-max line, so long traces cost about as much as the plot is wide.
+//It can also draw a filled min-max band instead of a line, for peak detect.
+//It is still a QCPGraph, so axes->graph(n) and the pen/visibility calls work as before.
+
+class frameGraph : public QCPGraph
+{
+    Q_OBJECT
+public:
+    explicit frameGraph(QCPAxis *keyAxis, QCPAxis *valueAxis);
+
+    //The arrays are not copied and must stay valid (and unchanged) until
+    //the next setFrameData() or clearData().
+    void setFrameData(double const* values, int count, double xStart, double xStep);
+    void setFrameData(double const* keys, double const* values, int count);
+    //Fills between lower and upper instead of drawing the values.  Uses the
+    //count and keys of the last setFrameData(), which also turns it off again.
+    void setFrameEnvelope(double const* lower, double const* upper);
+
+    virtual void clearData();
+    virtual double selectTest(const QPointF &pos, bool onlySelectable, QVariant *details=0) const;
+
+protected:
+    virtual void draw(QCPPainter *painter);
+    virtual QCPRange getKeyRange(bool &foundRange, SignDomain inSignDomain=sdBoth) const;
+    virtual QCPRange getValueRange(bool &foundRange, SignDomain inSignDomain=sdBoth) const;
+    virtual QCPRange getKeyRange(bool &foundRange, SignDomain inSignDomain, bool includeErrors) const;
+    virtual QCPRange getValueRange(bool &foundRange, SignDomain inSignDomain, bool includeErrors) const;
+
+private:
+    double keyAt(int i) const { return m_keys ? m_keys[i] : m_xStart + i*m_xStep; }
+    void drawLine(QCPPainter *painter, int begin, int end, bool decimate);
+    void drawEnvelope(QCPPainter *painter, int begin, int end, bool decimate);
+
+    double const* m_keys = nullptr;
+    double const* m_values = nullptr;
+    double const* m_lower = nullptr;
+    double const* m_upper = nullptr;
+    int m_count = 0;
+    double m_xStart = 0;
+    double m_xStep = 0;
+    QVector<QPointF> m_lines; //Reused between replots
+    QVector<QPointF> m_lowerLines;
+};
+
+#endif // QCP_VER == 1
+
+#endif // FRAMEGRAPH_H
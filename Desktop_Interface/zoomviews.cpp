@@ -0,0 +1,98 @@
+#include "zoomviews.h"
+#include "isobuffer.h"
+#include "samplekernels.h"
+#include "allocationcounter.h"
+
+zoomViews::zoomViews()
+{
+    for (job& j : m_jobs) {
+        j.setAutoDelete(false);
+        j.done = &m_done;
+    }
+    // The processing thread does one view itself
+    m_pool.setMaxThreadCount(RenderFrame::kMaxZoomViews - 1);
+}
+
+void zoomViews::render(RenderFrame& frame, ZoomWindow const* windows, int count, ZoomChannel const (&channels)[2],
+                       int graphSamples, double triggerDelay, bool envelope)
+{
+    if (count > RenderFrame::kMaxZoomViews)
+        count = RenderFrame::kMaxZoomViews;
+    frame.zoomCount = count;
+    if (count == 0)
+        return;
+
+    for (int i = 0; i < count; ++i) {
+        job& j = m_jobs[i];
+        j.window = windows[i];
+        j.channels = channels;
+        j.graphSamples = graphSamples;
+        j.triggerDelay = triggerDelay;
+        j.envelope = envelope;
+        j.out = &frame.zooms[i];
+    }
+
+    {
+        // QThreadPool keeps its queue on the heap
+        allocationExempt exempt;
+        for (int i = 1; i < count; ++i)
+            m_pool.start(&m_jobs[i]);
+    }
+    m_jobs[0].run();
+    m_done.acquire(count);
+}
+
+void zoomViews::job::run()
+{
+    double const delay = window.delay + triggerDelay;
+    QVector<double>* traces[2] = {&out->ch1, &out->ch2};
+    QVector<double>* mins[2] = {&out->ch1Min, &out->ch2Min};
+    QVector<double>* maxes[2] = {&out->ch1Max, &out->ch2Max};
+
+    for (int channel = 0; channel < 2; ++channel) {
+        ZoomChannel const& source = channels[channel];
+        QVector<double>& trace = *traces[channel];
+        QVector<double>& min = *mins[channel];
+        QVector<double>& max = *maxes[channel];
+        trace.clear();
+        min.clear();
+        max.clear();
+        if (source.buffer == nullptr || source.mode == 0)
+            continue;
+
+        bool const digital = source.mode == 2;
+        source.buffer->readBuffer(raw, window.window, graphSamples, digital, delay);
+        trace.resize(raw.size());
+        if (digital) {
+            for (int i = 0; i < trace.size(); ++i)
+                trace[i] = raw[i] ? source.high : source.low;
+            continue;
+        }
+
+        convertSamples(raw.data(), trace.data(), trace.size(), source.scale, source.bias, nullptr);
+        if (envelope) {
+            source.buffer->readEnvelope(rawMin, rawMax, window.window, graphSamples, delay);
+            min.resize(rawMin.size());
+            max.resize(rawMax.size());
+            convertSamples(rawMin.data(), min.data(), min.size(), source.scale, source.bias, nullptr);
+            convertSamples(rawMax.data(), max.data(), max.size(), source.scale, source.bias, nullptr);
+        }
+    }
+
+    out->xStart = -window.delay;
+    out->xStep = -window.window / (graphSamples - 1);
+    out->xLower = -window.window - window.delay;
+    out->xUpper = -window.delay;
+
+    // Nothing has been captured after "now"
+    for (int i = 0; i < graphSamples && out->xStart + i * out->xStep > 0; ++i) {
+        for (int channel = 0; channel < 2; ++channel) {
+            if (i < traces[channel]->size())
+                (*traces[channel])[i] = 0;
+            if (i < mins[channel]->size())
+                (*mins[channel])[i] = (*maxes[channel])[i] = 0;
+        }
+    }
+
+    done->release();
+}
@@ -0,0 +1,69 @@
+#ifndef ZOOMVIEWS_H
+#define ZOOMVIEWS_H
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <vector>
+#include "renderframe.h"
+
+class isoBuffer;
+
+// Time window of one zoom view, measured like DisplayControl's
+struct ZoomWindow
+{
+    double window = 0;
+    double delay = 0;
+};
+
+// How one channel becomes a zoom trace.  Analog channels (mode 1 or -1) use
+// the scale and bias the main trace was converted with, so every view of
+// the frame agrees; logic analyzer channels (mode 2) are drawn high or low.
+struct ZoomChannel
+{
+    isoBuffer const* buffer = nullptr;
+    int mode = 0;
+    double scale = 1;
+    double bias = 0;
+    double high = 0;
+    double low = 0;
+};
+
+// Computes the zoom views of a frame.  Nothing writes to the buffers while
+// the processing thread is in here, so each view reads its own window from
+// them side by side on a small thread pool; the processing thread does the
+// first view itself and waits for the rest.
+class zoomViews
+{
+public:
+    zoomViews();
+
+    void render(RenderFrame& frame, ZoomWindow const* windows, int count, ZoomChannel const (&channels)[2],
+                int graphSamples, double triggerDelay, bool envelope);
+
+private:
+    class job : public QRunnable
+    {
+    public:
+        void run() override;
+
+        ZoomWindow window;
+        ZoomChannel const* channels = nullptr;
+        int graphSamples = 0;
+        double triggerDelay = 0;
+        bool envelope = false;
+        RenderFrame::ZoomTrace* out = nullptr;
+        QSemaphore* done = nullptr;
+        // Kept between frames so they stop allocating once warmed up
+        std::vector<short> raw;
+        std::vector<short> rawMin;
+        std::vector<short> rawMax;
+    };
+
+    // The pool is declared last so it has finished with the jobs before they go
+    job m_jobs[RenderFrame::kMaxZoomViews];
+    QSemaphore m_done;
+    QThreadPool m_pool;
+};
+
+#endif // ZOOMVIEWS_H